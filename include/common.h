@@ -84,4 +84,5 @@ void *calloc_s(size_t nmemb, size_t size);
 		output_term(); \
 		plugins_unload_all(); \
 		pev_cleanup_config(config); \
+		pe_library_shutdown(); \
 	} while (0)
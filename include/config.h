@@ -37,6 +37,7 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stdint.h>
 
 struct _pev_config_t; // Forward declaration.
 typedef bool (*pev_config_parse_callback_t)(struct _pev_config_t * const config, const char *name, const char *value);
@@ -44,6 +45,7 @@ typedef void (*pev_config_cleanup_callback_t)(void *data);
 
 typedef struct _pev_config_t {
 	char *plugins_path;
+	uint16_t load_options; // pe_options_e for pe_load_file_ext, from `io_backend`
 	struct {
 		pev_config_parse_callback_t parse_callback;
 		pev_config_cleanup_callback_t cleanup_callback;
@@ -0,0 +1,151 @@
+/*
+    libpe - the PE library
+
+    Copyright (C) 2010 - 2017 libpe authors
+    
+    This file is part of libpe.
+
+    libpe is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libpe is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with libpe.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "libpe/allocator.h"
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Every block is prefixed with its size, so pe_free can keep bytes_in_use
+// right. The union keeps the user part aligned like malloc would.
+typedef union {
+	size_t size;
+	long double ld;
+	void *ptr;
+	uint64_t u64;
+} alloc_header_t;
+
+static void *default_malloc(void *opaque, size_t size) {
+	(void)opaque;
+	return malloc(size);
+}
+
+static void default_free(void *opaque, void *ptr) {
+	(void)opaque;
+	free(ptr);
+}
+
+static const pe_allocator_t default_allocator = { default_malloc, default_free, NULL };
+
+static pe_allocator_t allocator = { default_malloc, default_free, NULL };
+static pe_alloc_stats_t stats;
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void pe_set_allocator(const pe_allocator_t *new_allocator) {
+	allocator = new_allocator != NULL ? *new_allocator : default_allocator;
+}
+
+void pe_get_alloc_stats(pe_alloc_stats_t *out) {
+	pthread_mutex_lock(&stats_lock);
+	*out = stats;
+	pthread_mutex_unlock(&stats_lock);
+}
+
+void pe_reset_alloc_stats(void) {
+	pthread_mutex_lock(&stats_lock);
+	const uint64_t bytes_in_use = stats.bytes_in_use;
+	memset(&stats, 0, sizeof(stats));
+	stats.bytes_in_use = bytes_in_use;
+	stats.peak_bytes = bytes_in_use;
+	pthread_mutex_unlock(&stats_lock);
+}
+
+void *pe_malloc(size_t size) {
+	alloc_header_t *header = NULL;
+	if (size <= SIZE_MAX - sizeof(alloc_header_t))
+		header = allocator.malloc_fn(allocator.opaque, sizeof(alloc_header_t) + size);
+
+	pthread_mutex_lock(&stats_lock);
+	if (header == NULL) {
+		stats.failed_calls++;
+	} else {
+		stats.alloc_calls++;
+		stats.bytes_allocated += size;
+		stats.bytes_in_use += size;
+		if (stats.bytes_in_use > stats.peak_bytes)
+			stats.peak_bytes = stats.bytes_in_use;
+	}
+	pthread_mutex_unlock(&stats_lock);
+
+	if (header == NULL)
+		return NULL;
+	header->size = size;
+	return header + 1;
+}
+
+void *pe_calloc(size_t nmemb, size_t size) {
+	if (size != 0 && nmemb > SIZE_MAX / size)
+		return NULL;
+
+	void *ptr = pe_malloc(nmemb * size);
+	if (ptr != NULL)
+		memset(ptr, 0, nmemb * size);
+	return ptr;
+}
+
+char *pe_strdup(const char *str) {
+	return pe_strndup(str, SIZE_MAX);
+}
+
+char *pe_strndup(const char *str, size_t size) {
+	const size_t len = strnlen(str, size);
+	char *copy = pe_malloc(len + 1);
+	if (copy == NULL)
+		return NULL;
+	memcpy(copy, str, len);
+	copy[len] = '\0';
+	return copy;
+}
+
+int pe_asprintf(char **strp, const char *format, ...) {
+	va_list args;
+
+	va_start(args, format);
+	const int len = vsnprintf(NULL, 0, format, args);
+	va_end(args);
+	if (len < 0)
+		return -1;
+
+	*strp = pe_malloc((size_t)len + 1);
+	if (*strp == NULL)
+		return -1;
+
+	va_start(args, format);
+	vsnprintf(*strp, (size_t)len + 1, format, args);
+	va_end(args);
+	return len;
+}
+
+void pe_free(void *ptr) {
+	if (ptr == NULL)
+		return;
+
+	alloc_header_t *header = (alloc_header_t *)ptr - 1;
+
+	pthread_mutex_lock(&stats_lock);
+	stats.free_calls++;
+	stats.bytes_in_use -= header->size;
+	pthread_mutex_unlock(&stats_lock);
+
+	allocator.free_fn(allocator.opaque, header);
+}
@@ -0,0 +1,183 @@
+/*
+    libpe - the PE library
+
+    Copyright (C) 2010 - 2017 libpe authors
+    
+    This file is part of libpe.
+
+    libpe is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libpe is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with libpe.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "libpe/arena.h"
+#include "libpe/utils.h"
+#include <stdint.h>
+#include <string.h>
+
+// Every allocation is aligned to this, which is enough for any libpe struct.
+#define ARENA_ALIGNMENT 16
+// Default block size. Larger requests get a block of their own.
+#define ARENA_BLOCK_SIZE (64 * 1024)
+
+struct pe_arena_block {
+	pe_arena_block_t *next;
+	size_t size; // Usable bytes in `data`
+	size_t used;
+	// Keep `data` aligned.
+	union {
+		long double ld;
+		void *ptr;
+		uint64_t u64;
+	} data[];
+};
+
+static size_t align_up(size_t size) {
+	return (size + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+}
+
+void pe_arena_init(pe_arena_t *arena) {
+	memset(arena, 0, sizeof(*arena));
+	pthread_mutex_init(&arena->lock, NULL);
+}
+
+static void free_blocks(pe_arena_block_t *block) {
+	while (block != NULL) {
+		pe_arena_block_t *next = block->next;
+		pe_free(block);
+		block = next;
+	}
+}
+
+void pe_arena_reset(pe_arena_t *arena) {
+	pthread_mutex_lock(&arena->lock);
+
+	// Keep the standard blocks for reuse, but give oversized ones back.
+	pe_arena_block_t *block = arena->blocks;
+	while (block != NULL) {
+		pe_arena_block_t *next = block->next;
+		if (block->size == ARENA_BLOCK_SIZE) {
+			block->used = 0;
+			block->next = arena->free_blocks;
+			arena->free_blocks = block;
+		} else {
+			pe_free(block);
+		}
+		block = next;
+	}
+	arena->blocks = NULL;
+	memset(&arena->stats, 0, sizeof(arena->stats));
+
+	pthread_mutex_unlock(&arena->lock);
+}
+
+void pe_arena_destroy(pe_arena_t *arena) {
+	free_blocks(arena->blocks);
+	free_blocks(arena->free_blocks);
+	pthread_mutex_destroy(&arena->lock);
+	memset(arena, 0, sizeof(*arena));
+}
+
+static pe_arena_block_t *new_block(pe_arena_t *arena, size_t size) {
+	if (size <= ARENA_BLOCK_SIZE && arena->free_blocks != NULL) {
+		pe_arena_block_t *block = arena->free_blocks;
+		arena->free_blocks = block->next;
+		return block;
+	}
+
+	const size_t block_size = size <= ARENA_BLOCK_SIZE ? ARENA_BLOCK_SIZE : size;
+	if (block_size > SIZE_MAX - sizeof(pe_arena_block_t))
+		return NULL;
+
+	pe_arena_block_t *block = pe_malloc(sizeof(pe_arena_block_t) + block_size);
+	if (block == NULL)
+		return NULL;
+	block->size = block_size;
+	block->used = 0;
+	return block;
+}
+
+void *pe_arena_alloc(pe_arena_t *arena, size_t size) {
+	if (size == 0)
+		size = 1;
+	if (size > SIZE_MAX - ARENA_ALIGNMENT)
+		return NULL;
+	size = align_up(size);
+
+	pthread_mutex_lock(&arena->lock);
+
+	if (arena->limit != 0 && size > arena->limit - pe_utils_min(arena->limit, arena->stats.bytes_in_use)) {
+		arena->stats.failed_calls++;
+		pthread_mutex_unlock(&arena->lock);
+		return NULL;
+	}
+
+	pe_arena_block_t *block = arena->blocks;
+	if (block == NULL || block->size - block->used < size) {
+		block = new_block(arena, size);
+		if (block == NULL) {
+			arena->stats.failed_calls++;
+			pthread_mutex_unlock(&arena->lock);
+			return NULL;
+		}
+		if (block->size > ARENA_BLOCK_SIZE && arena->blocks != NULL) {
+			// Dedicated block. Keep bumping the current one.
+			block->next = arena->blocks->next;
+			arena->blocks->next = block;
+		} else {
+			block->next = arena->blocks;
+			arena->blocks = block;
+		}
+	}
+
+	void *ptr = (char *)block->data + block->used;
+	block->used += size;
+
+	arena->stats.alloc_calls++;
+	arena->stats.bytes_allocated += size;
+	arena->stats.bytes_in_use += size;
+	if (arena->stats.bytes_in_use > arena->stats.peak_bytes)
+		arena->stats.peak_bytes = arena->stats.bytes_in_use;
+
+	pthread_mutex_unlock(&arena->lock);
+	return ptr;
+}
+
+void *pe_arena_calloc(pe_arena_t *arena, size_t nmemb, size_t size) {
+	if (size != 0 && nmemb > SIZE_MAX / size)
+		return NULL;
+
+	void *ptr = pe_arena_alloc(arena, nmemb * size);
+	if (ptr != NULL)
+		memset(ptr, 0, nmemb * size);
+	return ptr;
+}
+
+char *pe_arena_strdup(pe_arena_t *arena, const char *str) {
+	const size_t size = strlen(str) + 1;
+	char *copy = pe_arena_alloc(arena, size);
+	if (copy != NULL)
+		memcpy(copy, str, size);
+	return copy;
+}
+
+void pe_arena_set_limit(pe_arena_t *arena, size_t limit) {
+	pthread_mutex_lock(&arena->lock);
+	arena->limit = limit;
+	pthread_mutex_unlock(&arena->lock);
+}
+
+void pe_arena_get_stats(pe_arena_t *arena, pe_alloc_stats_t *stats) {
+	pthread_mutex_lock(&arena->lock);
+	*stats = arena->stats;
+	pthread_mutex_unlock(&arena->lock);
+}
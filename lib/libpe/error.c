@@ -68,7 +68,11 @@ const char *pe_error_msg(pe_err_e error) {
 		"fstat() failed", 		// LIBPE_E_FSTAT_FAILED,
 		"fdopen() failed", 		// LIBPE_E_FDOPEN_FAILED,
 		"open() failed", 		// LIBPE_E_OPEN_FAILED,
-		"allocation failure"  	// LIBPE_E_ALLOCATION_FAILURE,
+		"allocation failure",  	// LIBPE_E_ALLOCATION_FAILURE,
+		"invalid buffer",	  	// LIBPE_E_INVALID_BUFFER,
+		"read() failed",	  	// LIBPE_E_READ_FAILED,
+		"invalid certificate table", // LIBPE_E_INVALID_CERT_TABLE,
+		"invalid ssdeep signature", // LIBPE_E_INVALID_SSDEEP,
 	};
 
   // FIX: Convoluted way to use negative errors! The code below is easier and faster.
@@ -25,11 +25,13 @@
 #include <stdlib.h>
 #include <string.h>
 
-pe_exports_t *pe_exports(pe_ctx_t *ctx) {
+static pe_exports_t *load_exports(pe_ctx_t *ctx) {
 	if (ctx->cached_data.exports != NULL)
 		return ctx->cached_data.exports;
 
-	pe_exports_t *exports = ctx->cached_data.exports = calloc(1, sizeof(pe_exports_t));
+	pe_map_file(ctx);
+
+	pe_exports_t *exports = ctx->cached_data.exports = pe_arena_calloc(ctx->arena, 1, sizeof(pe_exports_t));
 	if (exports == NULL) {
 		// TODO(jweyrich): Should we report an error? If yes, we need a redesign.
 		return NULL;
@@ -64,7 +66,7 @@ pe_exports_t *pe_exports(pe_ctx_t *ctx) {
 		return exports;
 	}
 
-	exports->name = strdup(name_ptr);
+	exports->name = pe_arena_strdup(ctx->arena, name_ptr);
 	
 	const uint32_t ordinal_base = exp->Base;
 	
@@ -91,7 +93,7 @@ pe_exports_t *pe_exports(pe_ctx_t *ctx) {
 	// functions/symbols exported by name only.
 
 	exports->functions_count = exp->NumberOfFunctions;
-	exports->functions = calloc(exp->NumberOfFunctions, sizeof(pe_exported_function_t));
+	exports->functions = pe_arena_calloc(ctx->arena, exp->NumberOfFunctions, sizeof(pe_exported_function_t));
 	if (exports->functions == NULL) {
 		exports->err = LIBPE_E_ALLOCATION_FAILURE;
 		return exports;
@@ -176,7 +178,7 @@ pe_exports_t *pe_exports(pe_ctx_t *ctx) {
 		exports->functions[i].ordinal = ordinal_base + i;
 		exports->functions[i].address = entry_va;
 
-		exports->functions[i].name = strdup(fname);
+		exports->functions[i].name = pe_arena_strdup(ctx->arena, fname);
 		if (exports->functions[i].name == NULL) {
 			exports->err = LIBPE_E_ALLOCATION_FAILURE;
 			return exports;
@@ -196,7 +198,7 @@ pe_exports_t *pe_exports(pe_ctx_t *ctx) {
 				break;
 			}
 
-			exports->functions[i].fwd_name = strdup(fw_entry_name);
+			exports->functions[i].fwd_name = pe_arena_strdup(ctx->arena, fw_entry_name);
 			if (exports->functions[i].fwd_name == NULL) {
 				exports->err = LIBPE_E_ALLOCATION_FAILURE;
 				return exports;
@@ -207,14 +209,14 @@ pe_exports_t *pe_exports(pe_ctx_t *ctx) {
 	return exports;
 }
 
-void pe_exports_dealloc(pe_exports_t *obj) {
-	if (obj == NULL)
-		return;
-
-	for (uint32_t i=0; i < obj->functions_count; i++)
-		free(obj->functions[i].name);
+pe_exports_t *pe_exports(pe_ctx_t *ctx) {
+	pthread_mutex_lock(&ctx->cached_locks.exports);
+	pe_exports_t *result = load_exports(ctx);
+	pthread_mutex_unlock(&ctx->cached_locks.exports);
+	return result;
+}
 
-	free(obj->functions);
-	free(obj->name);
-	free(obj);
+void pe_exports_dealloc(pe_exports_t *obj) {
+	// Nothing to do. It lives in the context arena and is released by pe_unload.
+	(void)obj;
 }
@@ -23,15 +23,19 @@
 
 #include "libpe/pe.h"
 #include "libfuzzy/fuzzy.h"
+#include "libxxhash/xxhash.h"
 #include "libpe/ordlookup.h"
-#include "libpe/utlist.h"
 
 #include <openssl/evp.h>
 #include <openssl/md5.h>
 #include <ctype.h>
 #include <math.h>
+#include <stddef.h>
 #include <string.h>
+#include <strings.h>
 #include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
 
 // add utility
 #define PEV_ABORT_IF(cond) \
@@ -54,85 +58,73 @@ static char *last_strstr(char *haystack, const char *needle) {
 	return result;
 }
 
-static pe_err_e get_hashes(pe_hash_t *output, const char *name, const unsigned char *data, size_t data_size) {
-	pe_err_e ret = LIBPE_E_OK;
-
-	const size_t hash_maxsize = pe_hash_recommended_size();
-	char *hash_value = calloc(1, hash_maxsize);
-	if (hash_value == NULL) {
-		ret = LIBPE_E_ALLOCATION_FAILURE;
-		goto error;
-	}
+// Copies `digest` to the context's arena, or leaves `*output` NULL if the
+// algorithm was not requested.
+static bool store_digest(pe_ctx_t *ctx, char **output, const char *digest, unsigned int algorithms, unsigned int alg) {
+	if (!(algorithms & alg))
+		return true;
+	*output = pe_arena_strdup(ctx->arena, digest);
+	return *output != NULL;
+}
 
-	output->name = strdup(name);
-	if (output->name == NULL) {
-		ret = LIBPE_E_ALLOCATION_FAILURE;
-		goto error;
-	}
+// Stores the requested `digests` in `output`, allocated from the context's arena.
+static pe_err_e store_hashes(pe_ctx_t *ctx, pe_hash_t *output, const char *name, unsigned int algorithms, const pe_hash_digests_t *digests) {
+	output->name = pe_arena_strdup(ctx->arena, name);
+	if (output->name == NULL
+		|| !store_digest(ctx, &output->md5, digests->md5, algorithms, LIBPE_HASH_MD5)
+		|| !store_digest(ctx, &output->sha1, digests->sha1, algorithms, LIBPE_HASH_SHA1)
+		|| !store_digest(ctx, &output->sha256, digests->sha256, algorithms, LIBPE_HASH_SHA256)
+		|| !store_digest(ctx, &output->ssdeep, digests->ssdeep, algorithms, LIBPE_HASH_SSDEEP)
+		|| !store_digest(ctx, &output->xxh64, digests->xxh64, algorithms, LIBPE_HASH_XXH64)
+		|| !store_digest(ctx, &output->xxh3, digests->xxh3, algorithms, LIBPE_HASH_XXH3)
+		|| !store_digest(ctx, &output->xxh128, digests->xxh128, algorithms, LIBPE_HASH_XXH128)
+		|| !store_digest(ctx, &output->crc32c, digests->crc32c, algorithms, LIBPE_HASH_CRC32C))
+		return LIBPE_E_ALLOCATION_FAILURE;
+	return LIBPE_E_OK;
+}
 
-	bool hash_ok;
+static pe_err_e get_hashes(pe_ctx_t *ctx, pe_hash_t *output, const char *name, const unsigned char *data, size_t data_size) {
+	pe_hash_multi_t multi;
+	pe_err_e ret = pe_hash_multi_init(&multi, LIBPE_HASH_ALL);
+	if (ret != LIBPE_E_OK)
+		return ret;
 
-	hash_ok = pe_hash_raw_data(hash_value, hash_maxsize, "md5", data, data_size);
-	if (!hash_ok) {
-		ret = LIBPE_E_HASHING_FAILED;
-		goto error;
-	}
-	output->md5 = strdup(hash_value);
-	if (output->md5 == NULL) {
-		ret = LIBPE_E_ALLOCATION_FAILURE;
-		goto error;
+	ret = pe_hash_multi_update(&multi, data, data_size);
+	if (ret != LIBPE_E_OK) {
+		pe_hash_multi_cleanup(&multi);
+		return ret;
 	}
 
-	hash_ok = pe_hash_raw_data(hash_value, hash_maxsize, "sha1", data, data_size);
-	if (!hash_ok) {
-		ret = LIBPE_E_HASHING_FAILED;
-		goto error;
-	}
-	output->sha1 = strdup(hash_value);
-	if (output->sha1 == NULL) {
-		ret = LIBPE_E_ALLOCATION_FAILURE;
-		goto error;
-	}
+	pe_hash_digests_t digests;
+	ret = pe_hash_multi_final(&multi, &digests);
+	if (ret != LIBPE_E_OK)
+		return ret;
 
-	hash_ok = pe_hash_raw_data(hash_value, hash_maxsize, "sha256", data, data_size);
-	if (!hash_ok) {
-		ret = LIBPE_E_HASHING_FAILED;
-		goto error;
-	}
-	output->sha256 = strdup(hash_value);
-	if (output->sha256 == NULL) {
-		ret = LIBPE_E_ALLOCATION_FAILURE;
-		goto error;
-	}
+	return store_hashes(ctx, output, name, LIBPE_HASH_ALL, &digests);
+}
 
-	hash_ok = pe_hash_raw_data(hash_value, hash_maxsize, "ssdeep", data, data_size);
-	if (!hash_ok) {
-		ret = LIBPE_E_HASHING_FAILED;
-		goto error;
-	}
-	output->ssdeep = strdup(hash_value);
-	if (output->ssdeep == NULL) {
-		ret = LIBPE_E_ALLOCATION_FAILURE;
-		goto error;
-	}
+// Like get_hashes, but streams a range of the file through the context's I/O backend.
+static pe_err_e get_file_range_hashes(pe_ctx_t *ctx, pe_hash_t *output, const char *name, unsigned int algorithms, uint64_t offset, uint64_t size) {
+	pe_hash_digests_t digests;
+	const pe_err_e ret = pe_hash_file_range(ctx, algorithms, offset, size, &digests);
+	if (ret != LIBPE_E_OK)
+		return ret;
 
-error:
-	free(hash_value);
-	return ret;
+	return store_hashes(ctx, output, name, algorithms, &digests);
 }
 
 static pe_err_e get_headers_dos_hash(pe_ctx_t *ctx, pe_hash_t *output) {
 	const IMAGE_DOS_HEADER *sample = pe_dos(ctx);
 	const unsigned char *data = (const unsigned char *)sample;
 	const uint64_t data_size = sizeof(IMAGE_DOS_HEADER);
-	return get_hashes(output, "IMAGE_DOS_HEADER", data, data_size);
+	return get_hashes(ctx, output, "IMAGE_DOS_HEADER", data, data_size);
 }
 
 static pe_err_e get_headers_coff_hash(pe_ctx_t *ctx, pe_hash_t *output) {
 	const IMAGE_COFF_HEADER *sample = pe_coff(ctx);
 	const unsigned char *data = (const unsigned char *)sample;
 	const uint64_t data_size = sizeof(IMAGE_COFF_HEADER);
-	return get_hashes(output, "IMAGE_COFF_HEADER", data, data_size);
+	return get_hashes(ctx, output, "IMAGE_COFF_HEADER", data, data_size);
 }
 
 static pe_err_e get_headers_optional_hash(pe_ctx_t *ctx, pe_hash_t *output) {
@@ -146,13 +138,13 @@ static pe_err_e get_headers_optional_hash(pe_ctx_t *ctx, pe_hash_t *output) {
 		{
 			const unsigned char *data = (const unsigned char *)sample->_32;
 			const uint64_t data_size = sizeof(IMAGE_OPTIONAL_HEADER_32);
-			return get_hashes(output, "IMAGE_OPTIONAL_HEADER_32", data, data_size);
+			return get_hashes(ctx, output, "IMAGE_OPTIONAL_HEADER_32", data, data_size);
 		}
 		case MAGIC_PE64:
 		{
 			const unsigned char *data = (const unsigned char *)sample->_64;
 			const uint64_t data_size = sizeof(IMAGE_OPTIONAL_HEADER_64);
-			return get_hashes(output, "IMAGE_OPTIONAL_HEADER_64", data, data_size);
+			return get_hashes(ctx, output, "IMAGE_OPTIONAL_HEADER_64", data, data_size);
 		}
 	}
 }
@@ -179,9 +171,49 @@ static void to_hex_str(const uint8_t* input, char* output, size_t n)
 		*output++ = "0123456789abcdef"[b >> 4];
 		*output++ = "0123456789abcdef"[b & 0xf];
 	}
+	*output = '\0';
 }
 
+// Digests of pe_hash_multi_t, which pe_hash_raw_data computes with cached
+// digest contexts. Other names are looked up in OpenSSL.
+static const struct {
+	const char *name;
+	unsigned int algorithm;
+	size_t offset; // Of the printable digest in pe_hash_digests_t
+	size_t size;
+} named_hashes[] = {
+	{ "md5",    LIBPE_HASH_MD5,    offsetof(pe_hash_digests_t, md5),    sizeof(((pe_hash_digests_t *)0)->md5) },
+	{ "sha1",   LIBPE_HASH_SHA1,   offsetof(pe_hash_digests_t, sha1),   sizeof(((pe_hash_digests_t *)0)->sha1) },
+	{ "sha256", LIBPE_HASH_SHA256, offsetof(pe_hash_digests_t, sha256), sizeof(((pe_hash_digests_t *)0)->sha256) },
+	{ "xxh64",  LIBPE_HASH_XXH64,  offsetof(pe_hash_digests_t, xxh64),  sizeof(((pe_hash_digests_t *)0)->xxh64) },
+	{ "xxh3",   LIBPE_HASH_XXH3,   offsetof(pe_hash_digests_t, xxh3),   sizeof(((pe_hash_digests_t *)0)->xxh3) },
+	{ "xxh128", LIBPE_HASH_XXH128, offsetof(pe_hash_digests_t, xxh128), sizeof(((pe_hash_digests_t *)0)->xxh128) },
+	{ "crc32c", LIBPE_HASH_CRC32C, offsetof(pe_hash_digests_t, crc32c), sizeof(((pe_hash_digests_t *)0)->crc32c) },
+};
+
 bool pe_hash_raw_data(char *output, size_t output_size, const char *alg_name, const unsigned char *data, size_t data_size) {
+	for (size_t i=0; i < LIBPE_SIZEOF_ARRAY(named_hashes); i++) {
+		if (strcasecmp(named_hashes[i].name, alg_name) != 0)
+			continue;
+		if (output_size < named_hashes[i].size) {
+			// Not enough space.
+			return false;
+		}
+
+		pe_hash_multi_t multi;
+		if (pe_hash_multi_init(&multi, named_hashes[i].algorithm) != LIBPE_E_OK)
+			return false;
+		if (pe_hash_multi_update(&multi, data, data_size) != LIBPE_E_OK) {
+			pe_hash_multi_cleanup(&multi);
+			return false;
+		}
+		pe_hash_digests_t digests;
+		if (pe_hash_multi_final(&multi, &digests) != LIBPE_E_OK)
+			return false;
+		memcpy(output, (const char *)&digests + named_hashes[i].offset, named_hashes[i].size);
+		return true;
+	}
+
 	if (strcmp("ssdeep", alg_name) == 0) {
 		if (output_size < G_SSDEEP_HASH_MAXSIZE) {
 			// Not enough space.
@@ -231,11 +263,794 @@ bool pe_hash_raw_data(char *output, size_t output_size, const char *alg_name, co
 	return true;
 }
 
-pe_hash_headers_t *pe_get_headers_hashes(pe_ctx_t *ctx) {
+//
+// Multi-digest engine
+//
+// Computing md5, sha1, sha256 and ssdeep one after the other reads the data
+// four times, which is memory-bandwidth bound on big files. The engine reads
+// it once instead, handing each cache-sized block to every requested digest
+// before moving on to the next one.
+//
+
+// Small enough to stay in L2 while every digest goes over it.
+#define HASH_BLOCK_SIZE (64 * 1024)
+
+// See https://wiki.openssl.org/index.php/1.1_API_Changes
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+#define EVP_MD_CTX_new EVP_MD_CTX_create
+#define EVP_MD_CTX_free EVP_MD_CTX_destroy
+#endif
+
+//
+// Digest cache
+//
+// Looking a digest up by name, and initializing a context from the legacy
+// EVP_md5() style handles, both go through the OpenSSL 3 provider fetch
+// machinery on every call. The digests libpe uses are fetched once instead,
+// and each thread keeps the contexts it is done with for its next hash.
+// Initializing a context again with the same digest is the cheapest way to
+// reuse it, so they are pooled per digest.
+//
+
+#define DIGEST_COUNT 3 // MD5, SHA1 and SHA256, in pe_hash_alg_e order
+#define DIGEST_SHA256 2
+#define DIGEST_POOL_SIZE 4 // Per digest; imphash flavours hash at the same time
+
+typedef struct {
+	size_t count[DIGEST_COUNT];
+	EVP_MD_CTX *free_ctx[DIGEST_COUNT][DIGEST_POOL_SIZE];
+} digest_pool_t;
+
+static const EVP_MD *digest_mds[DIGEST_COUNT];
+static EVP_MD *digest_fetched[DIGEST_COUNT]; // The ones of digest_mds to EVP_MD_free
+static pthread_mutex_t digest_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static bool digest_cache_ready; // Cleared by pe_hash_library_cleanup
+static pthread_key_t digest_pool_key;
+static bool digest_pool_key_valid;
+
+static void digest_pool_free(void *ptr) {
+	digest_pool_t *pool = ptr;
+	for (size_t i=0; i < DIGEST_COUNT; i++) {
+		for (size_t j=0; j < pool->count[i]; j++)
+			EVP_MD_CTX_free(pool->free_ctx[i][j]);
+	}
+	pe_free(pool);
+}
+
+static void digest_cache_setup(void) {
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+	static const char * const names[DIGEST_COUNT] = { "MD5", "SHA1", "SHA256" };
+	for (size_t i=0; i < DIGEST_COUNT; i++)
+		digest_mds[i] = digest_fetched[i] = EVP_MD_fetch(NULL, names[i], NULL);
+#endif
+	// Fall back to the implicitly fetched handles, e.g. when a provider
+	// refuses an explicit fetch.
+	if (digest_mds[0] == NULL)
+		digest_mds[0] = EVP_md5();
+	if (digest_mds[1] == NULL)
+		digest_mds[1] = EVP_sha1();
+	if (digest_mds[2] == NULL)
+		digest_mds[2] = EVP_sha256();
+
+	digest_pool_key_valid = pthread_key_create(&digest_pool_key, digest_pool_free) == 0;
+}
+
+static const EVP_MD *digest_md(size_t index) {
+	if (!__atomic_load_n(&digest_cache_ready, __ATOMIC_ACQUIRE)) {
+		pthread_mutex_lock(&digest_cache_lock);
+		if (!digest_cache_ready) {
+			digest_cache_setup();
+			__atomic_store_n(&digest_cache_ready, true, __ATOMIC_RELEASE);
+		}
+		pthread_mutex_unlock(&digest_cache_lock);
+	}
+	return digest_mds[index];
+}
+
+// Returns a context initialized for digest `index`, or NULL on failure.
+static EVP_MD_CTX *digest_ctx_acquire(size_t index) {
+	const EVP_MD *md = digest_md(index);
+	digest_pool_t *pool = digest_pool_key_valid ? pthread_getspecific(digest_pool_key) : NULL;
+
+	EVP_MD_CTX *md_ctx = pool != NULL && pool->count[index] > 0
+		? pool->free_ctx[index][--pool->count[index]]
+		: EVP_MD_CTX_new();
+	if (md_ctx != NULL && !EVP_DigestInit_ex(md_ctx, md, NULL)) {
+		EVP_MD_CTX_free(md_ctx);
+		md_ctx = NULL;
+	}
+	return md_ctx;
+}
+
+// Hands a context acquired for digest `index` back for reuse by this thread.
+static void digest_ctx_release(size_t index, EVP_MD_CTX *md_ctx) {
+	if (md_ctx == NULL)
+		return;
+
+	digest_pool_t *pool = NULL;
+	if (digest_pool_key_valid) {
+		pool = pthread_getspecific(digest_pool_key);
+		if (pool == NULL) {
+			pool = pe_calloc(1, sizeof(digest_pool_t));
+			if (pool != NULL && pthread_setspecific(digest_pool_key, pool) != 0) {
+				pe_free(pool);
+				pool = NULL;
+			}
+		}
+	}
+
+	if (pool != NULL && pool->count[index] < DIGEST_POOL_SIZE)
+		pool->free_ctx[index][pool->count[index]++] = md_ctx;
+	else
+		EVP_MD_CTX_free(md_ctx);
+}
+
+void pe_hash_thread_cleanup(void) {
+	if (!digest_pool_key_valid)
+		return;
+	digest_pool_t *pool = pthread_getspecific(digest_pool_key);
+	if (pool == NULL)
+		return;
+	pthread_setspecific(digest_pool_key, NULL);
+	digest_pool_free(pool);
+}
+
+void pe_hash_library_cleanup(void) {
+	pthread_mutex_lock(&digest_cache_lock);
+	if (digest_cache_ready) {
+		pe_hash_thread_cleanup();
+		if (digest_pool_key_valid) {
+			pthread_key_delete(digest_pool_key);
+			digest_pool_key_valid = false;
+		}
+
+		// The next digest_md sets them up again.
+		for (size_t i=0; i < DIGEST_COUNT; i++) {
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+			EVP_MD_free(digest_fetched[i]);
+#endif
+			digest_fetched[i] = NULL;
+			digest_mds[i] = NULL;
+		}
+		__atomic_store_n(&digest_cache_ready, false, __ATOMIC_RELEASE);
+	}
+	pthread_mutex_unlock(&digest_cache_lock);
+}
+
+//
+// CRC-32C
+//
+// The SSE4.2 and ARMv8 CRC32 instructions compute the Castagnoli polynomial
+// eight bytes at a time. Other CPUs use a slicing-by-8 table instead.
+//
+
+#define CRC32C_POLY 0x82f63b78 // Reflected
+
+typedef uint32_t (*crc32c_update_fn)(uint32_t crc, const uint8_t *data, size_t size);
+
+static uint32_t crc32c_table[8][256];
+
+static uint32_t crc32c_update_sw(uint32_t crc, const uint8_t *data, size_t size) {
+	while (size > 0 && ((uintptr_t)data & 7) != 0) {
+		crc = crc32c_table[0][(crc ^ *data++) & 0xff] ^ (crc >> 8);
+		size--;
+	}
+	for (; size >= 8; data += 8, size -= 8) {
+		uint64_t word;
+		memcpy(&word, data, sizeof(word));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+		word = __builtin_bswap64(word);
+#endif
+		word ^= crc;
+		crc = crc32c_table[7][word & 0xff]
+			^ crc32c_table[6][(word >> 8) & 0xff]
+			^ crc32c_table[5][(word >> 16) & 0xff]
+			^ crc32c_table[4][(word >> 24) & 0xff]
+			^ crc32c_table[3][(word >> 32) & 0xff]
+			^ crc32c_table[2][(word >> 40) & 0xff]
+			^ crc32c_table[1][(word >> 48) & 0xff]
+			^ crc32c_table[0][word >> 56];
+	}
+	while (size-- > 0)
+		crc = crc32c_table[0][(crc ^ *data++) & 0xff] ^ (crc >> 8);
+	return crc;
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <nmmintrin.h>
+#define CRC32C_HW
+
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_update_hw(uint32_t crc, const uint8_t *data, size_t size) {
+	while (size > 0 && ((uintptr_t)data & 7) != 0) {
+		crc = _mm_crc32_u8(crc, *data++);
+		size--;
+	}
+	uint64_t crc64 = crc;
+	for (; size >= 8; data += 8, size -= 8) {
+		uint64_t word;
+		memcpy(&word, data, sizeof(word));
+		crc64 = _mm_crc32_u64(crc64, word);
+	}
+	crc = (uint32_t)crc64;
+	while (size-- > 0)
+		crc = _mm_crc32_u8(crc, *data++);
+	return crc;
+}
+
+static bool crc32c_hw_supported(void) {
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("sse4.2");
+}
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#define CRC32C_HW
+
+static uint32_t crc32c_update_hw(uint32_t crc, const uint8_t *data, size_t size) {
+	while (size > 0 && ((uintptr_t)data & 7) != 0) {
+		crc = __crc32cb(crc, *data++);
+		size--;
+	}
+	for (; size >= 8; data += 8, size -= 8) {
+		uint64_t word;
+		memcpy(&word, data, sizeof(word));
+		crc = __crc32cd(crc, word);
+	}
+	while (size-- > 0)
+		crc = __crc32cb(crc, *data++);
+	return crc;
+}
+
+static bool crc32c_hw_supported(void) {
+	return true; // Checked at build time
+}
+#endif
+
+static crc32c_update_fn crc32c_update = crc32c_update_sw;
+static pthread_once_t crc32c_once = PTHREAD_ONCE_INIT;
+
+static void crc32c_setup(void) {
+#ifdef CRC32C_HW
+	if (crc32c_hw_supported()) {
+		crc32c_update = crc32c_update_hw;
+		return;
+	}
+#endif
+	for (uint32_t i=0; i < 256; i++) {
+		uint32_t crc = i;
+		for (int bit=0; bit < 8; bit++)
+			crc = (crc >> 1) ^ (CRC32C_POLY & -(crc & 1));
+		crc32c_table[0][i] = crc;
+	}
+	for (uint32_t i=0; i < 256; i++) {
+		for (size_t slice=1; slice < 8; slice++)
+			crc32c_table[slice][i] = crc32c_table[0][crc32c_table[slice - 1][i] & 0xff] ^ (crc32c_table[slice - 1][i] >> 8);
+	}
+}
+
+//
+// PE CheckSum
+//
+// The CheckSum is a 16-bit one's complement sum of the file's little-endian
+// words, plus the file size. As 65536 is 1 modulo 0xffff, adding dwords up
+// in a 64-bit integer and folding the total at the end gives the same result
+// as folding after each word, so whole vectors of dwords can be added at once.
+//
+
+typedef uint64_t (*checksum_sum_fn)(const uint8_t *data, size_t size);
+
+// Adds up the little-endian dwords of `data`; `size` is a multiple of 4.
+static uint64_t checksum_sum_scalar(const uint8_t *data, size_t size) {
+	uint64_t sum = 0;
+	for (size_t i=0; i < size; i += 4)
+		sum += (uint32_t)data[i] | (uint32_t)data[i + 1] << 8 | (uint32_t)data[i + 2] << 16 | (uint32_t)data[i + 3] << 24;
+	return sum;
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define CHECKSUM_SIMD
+
+// SSE2 is part of x86-64, so this needs no run-time check.
+static uint64_t checksum_sum_sse2(const uint8_t *data, size_t size) {
+	const __m128i zero = _mm_setzero_si128();
+	__m128i lo = zero;
+	__m128i hi = zero;
+	size_t i = 0;
+	for (; i + 16 <= size; i += 16) {
+		const __m128i dwords = _mm_loadu_si128((const __m128i *)(data + i));
+		lo = _mm_add_epi64(lo, _mm_unpacklo_epi32(dwords, zero));
+		hi = _mm_add_epi64(hi, _mm_unpackhi_epi32(dwords, zero));
+	}
+	uint64_t lanes[2];
+	_mm_storeu_si128((__m128i *)lanes, _mm_add_epi64(lo, hi));
+	return lanes[0] + lanes[1] + checksum_sum_scalar(data + i, size - i);
+}
+
+__attribute__((target("avx2")))
+static uint64_t checksum_sum_avx2(const uint8_t *data, size_t size) {
+	const __m256i zero = _mm256_setzero_si256();
+	__m256i lo = zero;
+	__m256i hi = zero;
+	size_t i = 0;
+	for (; i + 32 <= size; i += 32) {
+		const __m256i dwords = _mm256_loadu_si256((const __m256i *)(data + i));
+		lo = _mm256_add_epi64(lo, _mm256_unpacklo_epi32(dwords, zero));
+		hi = _mm256_add_epi64(hi, _mm256_unpackhi_epi32(dwords, zero));
+	}
+	uint64_t lanes[4];
+	_mm256_storeu_si256((__m256i *)lanes, _mm256_add_epi64(lo, hi));
+	return lanes[0] + lanes[1] + lanes[2] + lanes[3] + checksum_sum_scalar(data + i, size - i);
+}
+#endif
+
+static checksum_sum_fn checksum_sum = checksum_sum_scalar;
+static pthread_once_t checksum_once = PTHREAD_ONCE_INIT;
+
+static void checksum_setup(void) {
+#ifdef CHECKSUM_SIMD
+	__builtin_cpu_init();
+	checksum_sum = __builtin_cpu_supports("avx2") ? checksum_sum_avx2 : checksum_sum_sse2;
+#endif
+}
+
+static void checksum_update(pe_hash_multi_t *multi, const uint8_t *data, size_t size) {
+	const uint64_t start = multi->checksum_size;
+	uint64_t sum = multi->checksum_sum;
+	uint64_t offset = start;
+	size_t i = 0;
+
+	// Bytes are weighted by their position in the dword they belong to, so
+	// data may be fed in pieces of any size.
+	for (; i < size && (offset & 3) != 0; i++, offset++)
+		sum += (uint64_t)data[i] << (8 * (offset & 3));
+	const size_t dwords_size = (size - i) & ~(size_t)3;
+	sum += checksum_sum(data + i, dwords_size);
+	i += dwords_size;
+	offset += dwords_size;
+	for (; i < size; i++, offset++)
+		sum += (uint64_t)data[i] << (8 * (offset & 3));
+
+	// The CheckSum field counts as zero. Taking its bytes back out is exact.
+	const uint64_t field = multi->checksum_field;
+	if (field != UINT64_MAX) {
+		for (uint64_t pos = pe_utils_max(field, start); pos < field + sizeof(uint32_t) && pos < start + size; pos++)
+			sum -= (uint64_t)data[pos - start] << (8 * (pos & 3));
+	}
+
+	multi->checksum_sum = sum;
+	multi->checksum_size = start + size;
+}
+
+static uint32_t checksum_final(const pe_hash_multi_t *multi) {
+	uint64_t sum = multi->checksum_sum;
+	while (sum >> 16)
+		sum = (sum & 0xffff) + (sum >> 16);
+	return (uint32_t)(sum + multi->checksum_size);
+}
+
+// Big-endian, so the bytes print as the number.
+static void u64_to_hex_str(uint64_t value, char *output) {
+	for (int i=0; i < 16; i++)
+		output[i] = "0123456789abcdef"[(value >> (60 - 4 * i)) & 0xf];
+	output[16] = '\0';
+}
+
+pe_err_e pe_hash_multi_init(pe_hash_multi_t *multi, unsigned int algorithms) {
+	memset(multi, 0, sizeof(pe_hash_multi_t));
+	multi->algorithms = algorithms;
+
+	for (size_t i=0; i < LIBPE_SIZEOF_ARRAY(multi->md_ctx); i++) {
+		if (!(algorithms & (1u << i)))
+			continue;
+		multi->md_ctx[i] = digest_ctx_acquire(i);
+		if (multi->md_ctx[i] == NULL) {
+			pe_hash_multi_cleanup(multi);
+			return LIBPE_E_HASHING_FAILED;
+		}
+	}
+
+	if (algorithms & LIBPE_HASH_SSDEEP) {
+		multi->ssdeep = fuzzy_new();
+		if (multi->ssdeep == NULL) {
+			pe_hash_multi_cleanup(multi);
+			return LIBPE_E_ALLOCATION_FAILURE;
+		}
+	}
+
+	if (algorithms & LIBPE_HASH_XXH64) {
+		multi->xxh64 = XXH64_createState();
+		if (multi->xxh64 == NULL) {
+			pe_hash_multi_cleanup(multi);
+			return LIBPE_E_ALLOCATION_FAILURE;
+		}
+		XXH64_reset(multi->xxh64, 0);
+	}
+
+	// Both XXH3 widths accumulate the same state and differ only when finalized.
+	if (algorithms & (LIBPE_HASH_XXH3 | LIBPE_HASH_XXH128)) {
+		multi->xxh3 = XXH3_createState();
+		if (multi->xxh3 == NULL) {
+			pe_hash_multi_cleanup(multi);
+			return LIBPE_E_ALLOCATION_FAILURE;
+		}
+		XXH3_64bits_reset(multi->xxh3);
+	}
+
+	if (algorithms & LIBPE_HASH_CRC32C)
+		pthread_once(&crc32c_once, crc32c_setup);
+	multi->crc32c = 0xffffffff;
+
+	if (algorithms & LIBPE_HASH_PE_CHECKSUM)
+		pthread_once(&checksum_once, checksum_setup);
+	multi->checksum_field = UINT64_MAX;
+
+	return LIBPE_E_OK;
+}
+
+pe_err_e pe_hash_multi_update(pe_hash_multi_t *multi, const void *data, size_t data_size) {
+	const uint8_t *block = data;
+	while (data_size > 0) {
+		const size_t block_size = pe_utils_min(data_size, (size_t)HASH_BLOCK_SIZE);
+		for (size_t i=0; i < LIBPE_SIZEOF_ARRAY(multi->md_ctx); i++) {
+			if (multi->md_ctx[i] != NULL && !EVP_DigestUpdate(multi->md_ctx[i], block, block_size))
+				return LIBPE_E_HASHING_FAILED;
+		}
+		if (multi->ssdeep != NULL && fuzzy_update(multi->ssdeep, block, block_size) != 0)
+			return LIBPE_E_HASHING_FAILED;
+		if (multi->xxh64 != NULL && XXH64_update(multi->xxh64, block, block_size) != XXH_OK)
+			return LIBPE_E_HASHING_FAILED;
+		if (multi->xxh3 != NULL && XXH3_64bits_update(multi->xxh3, block, block_size) != XXH_OK)
+			return LIBPE_E_HASHING_FAILED;
+		if (multi->algorithms & LIBPE_HASH_CRC32C)
+			multi->crc32c = crc32c_update(multi->crc32c, block, block_size);
+		if (multi->algorithms & LIBPE_HASH_PE_CHECKSUM)
+			checksum_update(multi, block, block_size);
+		block += block_size;
+		data_size -= block_size;
+	}
+	return LIBPE_E_OK;
+}
+
+pe_err_e pe_hash_multi_final(pe_hash_multi_t *multi, pe_hash_digests_t *digests) {
+	char * const outputs[] = { digests->md5, digests->sha1, digests->sha256 };
+	pe_err_e ret = LIBPE_E_OK;
+
+	memset(digests, 0, sizeof(pe_hash_digests_t));
+
+	for (size_t i=0; i < LIBPE_SIZEOF_ARRAY(multi->md_ctx); i++) {
+		if (multi->md_ctx[i] == NULL)
+			continue;
+		unsigned char md_value[EVP_MAX_MD_SIZE];
+		unsigned int md_len;
+		if (!EVP_DigestFinal_ex(multi->md_ctx[i], md_value, &md_len)) {
+			ret = LIBPE_E_HASHING_FAILED;
+			break;
+		}
+		to_hex_str(md_value, outputs[i], md_len);
+	}
+
+	if (ret == LIBPE_E_OK && multi->ssdeep != NULL && fuzzy_digest(multi->ssdeep, digests->ssdeep, 0) != 0)
+		ret = LIBPE_E_HASHING_FAILED;
+
+	if (ret == LIBPE_E_OK) {
+		if (multi->xxh64 != NULL)
+			u64_to_hex_str(XXH64_digest(multi->xxh64), digests->xxh64);
+		if (multi->algorithms & LIBPE_HASH_XXH3)
+			u64_to_hex_str(XXH3_64bits_digest(multi->xxh3), digests->xxh3);
+		if (multi->algorithms & LIBPE_HASH_XXH128) {
+			const XXH128_hash_t hash = XXH3_128bits_digest(multi->xxh3);
+			u64_to_hex_str(hash.high64, digests->xxh128);
+			u64_to_hex_str(hash.low64, digests->xxh128 + 16);
+		}
+		if (multi->algorithms & LIBPE_HASH_CRC32C)
+			snprintf(digests->crc32c, sizeof(digests->crc32c), "%08"PRIx32, ~multi->crc32c);
+		if (multi->algorithms & LIBPE_HASH_PE_CHECKSUM)
+			digests->pe_checksum = checksum_final(multi);
+	}
+
+	pe_hash_multi_cleanup(multi);
+	return ret;
+}
+
+void pe_hash_multi_cleanup(pe_hash_multi_t *multi) {
+	for (size_t i=0; i < LIBPE_SIZEOF_ARRAY(multi->md_ctx); i++) {
+		digest_ctx_release(i, multi->md_ctx[i]);
+		multi->md_ctx[i] = NULL;
+	}
+	if (multi->ssdeep != NULL)
+		fuzzy_free(multi->ssdeep);
+	multi->ssdeep = NULL;
+	if (multi->xxh64 != NULL)
+		XXH64_freeState(multi->xxh64);
+	multi->xxh64 = NULL;
+	if (multi->xxh3 != NULL)
+		XXH3_freeState(multi->xxh3);
+	multi->xxh3 = NULL;
+}
+
+// File offset of a pointer into the headers. They are mapped from the start of
+// the file in every load mode.
+static uint64_t header_offset(const pe_ctx_t *ctx, const void *ptr) {
+	return (uintptr_t)ptr - (uintptr_t)ctx->map_addr;
+}
+
+// The CheckSum field of the optional header, or NULL if there is none.
+static const uint32_t *optional_checksum(pe_ctx_t *ctx) {
+	const IMAGE_OPTIONAL_HEADER *optional = pe_optional(ctx);
+	if (optional == NULL || (optional->_32 == NULL && optional->_64 == NULL))
+		return NULL;
+	return optional->type == MAGIC_PE64
+		? &optional->_64->CheckSum
+		: &optional->_32->CheckSum;
+}
+
+pe_err_e pe_hash_file_range(pe_ctx_t *ctx, unsigned int algorithms, uint64_t offset, uint64_t size, pe_hash_digests_t *digests) {
+	pe_chunk_iter_t iter;
+	pe_err_e ret = pe_chunks_begin(ctx, &iter, offset, size, 0);
+	if (ret != LIBPE_E_OK) {
+		pe_chunks_end(&iter);
+		return ret;
+	}
+
+	pe_hash_multi_t multi;
+	ret = pe_hash_multi_init(&multi, algorithms);
+	if (ret != LIBPE_E_OK) {
+		pe_chunks_end(&iter);
+		return ret;
+	}
+
+	const uint32_t *checksum = optional_checksum(ctx);
+	if (checksum != NULL && header_offset(ctx, checksum) >= offset)
+		multi.checksum_field = header_offset(ctx, checksum) - offset;
+
+	const void *chunk;
+	size_t chunk_size;
+	while (ret == LIBPE_E_OK && (chunk = pe_chunks_next(&iter, &chunk_size)) != NULL)
+		ret = pe_hash_multi_update(&multi, chunk, chunk_size);
+	if (ret == LIBPE_E_OK)
+		ret = iter.err;
+	pe_chunks_end(&iter);
+
+	if (ret != LIBPE_E_OK) {
+		pe_hash_multi_cleanup(&multi);
+		return ret;
+	}
+	return pe_hash_multi_final(&multi, digests);
+}
+
+pe_err_e pe_compute_checksum(pe_ctx_t *ctx, uint32_t *checksum) {
+	if (optional_checksum(ctx) == NULL)
+		return LIBPE_E_MISSING_OPTIONAL_HEADER;
+
+	pe_hash_digests_t digests;
+	const pe_err_e ret = pe_hash_file_range(ctx, LIBPE_HASH_PE_CHECKSUM, 0, pe_filesize(ctx), &digests);
+	if (ret == LIBPE_E_OK)
+		*checksum = digests.pe_checksum;
+	return ret;
+}
+
+//
+// Authenticode image digest
+//
+
+typedef struct {
+	uint64_t offset;
+	uint64_t size;
+} byte_range_t;
+
+// Feeds the part of a chunk that lies outside of the `skip` ranges, which
+// must be sorted by offset and not overlap.
+static pe_err_e hash_multi_update_excluding(pe_hash_multi_t *multi, const uint8_t *chunk, uint64_t chunk_offset, size_t chunk_size, const byte_range_t *skip, size_t skip_count) {
+	const uint64_t chunk_end = chunk_offset + chunk_size;
+	uint64_t cursor = chunk_offset;
+	pe_err_e ret = LIBPE_E_OK;
+
+	for (size_t i=0; i < skip_count && cursor < chunk_end && ret == LIBPE_E_OK; i++) {
+		const uint64_t skip_end = skip[i].offset + skip[i].size;
+		if (skip_end <= cursor || skip[i].offset >= chunk_end)
+			continue;
+		if (skip[i].offset > cursor)
+			ret = pe_hash_multi_update(multi, chunk + (cursor - chunk_offset), skip[i].offset - cursor);
+		cursor = pe_utils_min(skip_end, chunk_end);
+	}
+
+	if (ret == LIBPE_E_OK && cursor < chunk_end)
+		ret = pe_hash_multi_update(multi, chunk + (cursor - chunk_offset), chunk_end - cursor);
+	return ret;
+}
+
+pe_err_e pe_authenticode_digest(pe_ctx_t *ctx, unsigned int algorithms, pe_hash_digests_t *digests) {
+	memset(digests, 0, sizeof(pe_hash_digests_t));
+
+	const uint32_t *checksum = optional_checksum(ctx);
+	if (checksum == NULL)
+		return LIBPE_E_MISSING_OPTIONAL_HEADER;
+
+	// The CheckSum field comes before the data directories, so `skip` is sorted.
+	byte_range_t skip[2];
+	size_t skip_count = 0;
+	skip[skip_count++] = (byte_range_t){ header_offset(ctx, checksum), sizeof(uint32_t) };
+
+	uint64_t end = pe_filesize(ctx);
+
+	const IMAGE_DATA_DIRECTORY *security = pe_directory_by_entry(ctx, IMAGE_DIRECTORY_ENTRY_SECURITY);
+	if (security != NULL) {
+		skip[skip_count++] = (byte_range_t){ header_offset(ctx, security), sizeof(IMAGE_DATA_DIRECTORY) };
+
+		// The VirtualAddress of the security directory is a file offset. The
+		// certificate table is appended to the image, so the digest stops there.
+		if (security->VirtualAddress != 0 && security->Size != 0) {
+			if (security->VirtualAddress > end || security->Size > end - security->VirtualAddress)
+				return LIBPE_E_INVALID_CERT_TABLE;
+			end = security->VirtualAddress;
+		}
+	}
+
+	pe_chunk_iter_t iter;
+	pe_err_e ret = pe_chunks_begin(ctx, &iter, 0, end, 0);
+	if (ret != LIBPE_E_OK) {
+		pe_chunks_end(&iter);
+		return ret;
+	}
+
+	pe_hash_multi_t multi;
+	ret = pe_hash_multi_init(&multi, algorithms & (LIBPE_HASH_MD5 | LIBPE_HASH_SHA1 | LIBPE_HASH_SHA256));
+	if (ret != LIBPE_E_OK) {
+		pe_chunks_end(&iter);
+		return ret;
+	}
+
+	const void *chunk;
+	size_t chunk_size;
+	uint64_t chunk_offset = 0;
+	while (ret == LIBPE_E_OK && (chunk = pe_chunks_next(&iter, &chunk_size)) != NULL) {
+		ret = hash_multi_update_excluding(&multi, chunk, chunk_offset, chunk_size, skip, skip_count);
+		chunk_offset += chunk_size;
+	}
+	if (ret == LIBPE_E_OK)
+		ret = iter.err;
+	pe_chunks_end(&iter);
+
+	if (ret != LIBPE_E_OK) {
+		pe_hash_multi_cleanup(&multi);
+		return ret;
+	}
+	return pe_hash_multi_final(&multi, digests);
+}
+
+//
+// Page hashes
+//
+
+#define FNV1A64_OFFSET_BASIS 0xcbf29ce484222325ULL
+#define FNV1A64_PRIME 0x100000001b3ULL
+
+static size_t page_digest_size(pe_page_hash_alg_e algorithm) {
+	switch (algorithm) {
+		case LIBPE_PAGE_HASH_FNV1A64: return sizeof(uint64_t);
+		case LIBPE_PAGE_HASH_SHA256: return 32;
+	}
+	return 0;
+}
+
+// Digest of the page being filled.
+typedef struct {
+	pe_page_hash_alg_e algorithm;
+	uint64_t fnv;
+	EVP_MD_CTX *md_ctx;
+} page_digest_t;
+
+static bool page_digest_begin(page_digest_t *digest) {
+	if (digest->algorithm == LIBPE_PAGE_HASH_SHA256)
+		return EVP_DigestInit_ex(digest->md_ctx, digest_md(DIGEST_SHA256), NULL) == 1;
+	digest->fnv = FNV1A64_OFFSET_BASIS;
+	return true;
+}
+
+static bool page_digest_update(page_digest_t *digest, const uint8_t *data, size_t size) {
+	if (digest->algorithm == LIBPE_PAGE_HASH_SHA256)
+		return EVP_DigestUpdate(digest->md_ctx, data, size) == 1;
+	uint64_t fnv = digest->fnv;
+	for (size_t i=0; i < size; i++)
+		fnv = (fnv ^ data[i]) * FNV1A64_PRIME;
+	digest->fnv = fnv;
+	return true;
+}
+
+static bool page_digest_final(page_digest_t *digest, uint8_t *output) {
+	if (digest->algorithm == LIBPE_PAGE_HASH_SHA256)
+		return EVP_DigestFinal_ex(digest->md_ctx, output, NULL) == 1;
+	// Big-endian, so the bytes print as the number.
+	for (size_t i=0; i < sizeof(uint64_t); i++)
+		output[i] = (uint8_t)(digest->fnv >> (56 - 8 * i));
+	return true;
+}
+
+pe_page_hashes_t *pe_get_page_hashes(pe_ctx_t *ctx, pe_page_hash_alg_e algorithm, uint32_t page_size) {
+	pe_page_hashes_t *result = pe_calloc(1, sizeof(pe_page_hashes_t));
+	if (result == NULL)
+		return NULL;
+
+	result->algorithm = algorithm;
+	result->page_size = page_size > 0 ? page_size : LIBPE_PAGE_SIZE_DEFAULT;
+	result->digest_size = page_digest_size(algorithm);
+	if (result->digest_size == 0) {
+		result->err = LIBPE_E_HASHING_FAILED;
+		return result;
+	}
+
+	const uint64_t file_size = pe_filesize(ctx);
+	const uint64_t count = file_size / result->page_size + (file_size % result->page_size != 0);
+	if (count == 0)
+		return result;
+	if (count > SIZE_MAX / result->digest_size) {
+		result->err = LIBPE_E_ALLOCATION_FAILURE;
+		return result;
+	}
+
+	result->digests = pe_malloc(count * result->digest_size);
+	page_digest_t digest = { .algorithm = algorithm };
+	if (algorithm == LIBPE_PAGE_HASH_SHA256)
+		digest.md_ctx = digest_ctx_acquire(DIGEST_SHA256);
+	if (result->digests == NULL || (algorithm == LIBPE_PAGE_HASH_SHA256 && digest.md_ctx == NULL)) {
+		digest_ctx_release(DIGEST_SHA256, digest.md_ctx);
+		result->err = LIBPE_E_ALLOCATION_FAILURE;
+		return result;
+	}
+
+	pe_chunk_iter_t iter;
+	pe_err_e ret = pe_chunks_begin(ctx, &iter, 0, file_size, 0);
+	uint64_t page = 0;
+	uint32_t filled = 0; // Bytes of the current page hashed so far
+
+	if (ret == LIBPE_E_OK && !page_digest_begin(&digest))
+		ret = LIBPE_E_HASHING_FAILED;
+
+	// Pages may straddle chunks, so each one is hashed as its bytes arrive.
+	const uint8_t *chunk;
+	size_t chunk_size;
+	while (ret == LIBPE_E_OK && (chunk = pe_chunks_next(&iter, &chunk_size)) != NULL) {
+		while (chunk_size > 0 && ret == LIBPE_E_OK) {
+			const size_t size = pe_utils_min(chunk_size, (size_t)(result->page_size - filled));
+			if (!page_digest_update(&digest, chunk, size))
+				ret = LIBPE_E_HASHING_FAILED;
+			chunk += size;
+			chunk_size -= size;
+			filled += size;
+
+			if (ret == LIBPE_E_OK && filled == result->page_size) {
+				if (!page_digest_final(&digest, result->digests + page * result->digest_size)
+					|| !page_digest_begin(&digest))
+					ret = LIBPE_E_HASHING_FAILED;
+				page++;
+				filled = 0;
+			}
+		}
+	}
+	if (ret == LIBPE_E_OK)
+		ret = iter.err;
+	pe_chunks_end(&iter);
+
+	// The last page is hashed as it is, without padding.
+	if (ret == LIBPE_E_OK && filled > 0) {
+		if (!page_digest_final(&digest, result->digests + page * result->digest_size))
+			ret = LIBPE_E_HASHING_FAILED;
+		page++;
+	}
+
+	digest_ctx_release(DIGEST_SHA256, digest.md_ctx);
+
+	result->count = page;
+	result->err = ret;
+	return result;
+}
+
+static pe_hash_headers_t *load_headers_hashes(pe_ctx_t *ctx) {
 	if (ctx->cached_data.hash_headers != NULL)
 		return ctx->cached_data.hash_headers;
 
-	pe_hash_headers_t *result = ctx->cached_data.hash_headers = calloc(1, sizeof(pe_hash_headers_t));
+	pe_hash_headers_t *result = ctx->cached_data.hash_headers = pe_arena_calloc(ctx->arena, 1, sizeof(pe_hash_headers_t));
 	if (result == NULL) {
 		// TODO(jweyrich): Should we report an error? If yes, we need a redesign.
 		return NULL;
@@ -245,7 +1060,7 @@ pe_hash_headers_t *pe_get_headers_hashes(pe_ctx_t *ctx) {
 
 	pe_err_e status = LIBPE_E_OK;
 
-	result->dos = malloc(sizeof(pe_hash_t));
+	result->dos = pe_arena_calloc(ctx->arena, 1, sizeof(pe_hash_t));
 	if (result->dos == NULL) {
 		result->err = LIBPE_E_ALLOCATION_FAILURE;
 		goto error;
@@ -256,7 +1071,7 @@ pe_hash_headers_t *pe_get_headers_hashes(pe_ctx_t *ctx) {
 		goto error;
 	}
 
-	result->optional = malloc(sizeof(pe_hash_t));
+	result->optional = pe_arena_calloc(ctx->arena, 1, sizeof(pe_hash_t));
 	if (result->optional == NULL) {
 		result->err = LIBPE_E_ALLOCATION_FAILURE;
 		goto error;
@@ -267,7 +1082,7 @@ pe_hash_headers_t *pe_get_headers_hashes(pe_ctx_t *ctx) {
 		goto error;
 	}
 
-	result->coff = malloc(sizeof(pe_hash_t));
+	result->coff = pe_arena_calloc(ctx->arena, 1, sizeof(pe_hash_t));
 	if (result->coff == NULL) {
 		status = LIBPE_E_ALLOCATION_FAILURE;
 		result->err = status;
@@ -283,15 +1098,89 @@ error:
 	return result;
 }
 
-pe_hash_sections_t *pe_get_sections_hash(pe_ctx_t *ctx) {
-	if (ctx->cached_data.hash_sections != NULL)
+pe_hash_headers_t *pe_get_headers_hashes(pe_ctx_t *ctx) {
+	pthread_mutex_lock(&ctx->cached_locks.hash_headers);
+	pe_hash_headers_t *result = load_headers_hashes(ctx);
+	pthread_mutex_unlock(&ctx->cached_locks.hash_headers);
+	return result;
+}
+
+// One section to be hashed by load_sections_hash.
+typedef struct {
+	const char *name;
+	uint64_t offset;
+	uint64_t size;
+	pe_hash_t *hash;
+	pe_err_e status;
+} section_hash_task_t;
+
+// Work shared by the threads of load_sections_hash. Each thread claims the
+// next unclaimed task until none is left, so a large section does not hold
+// back the others.
+typedef struct {
+	pe_ctx_t *ctx;
+	unsigned int algorithms;
+	section_hash_task_t *tasks;
+	size_t count;
+	size_t next;
+	pthread_mutex_t lock;
+} section_hash_work_t;
+
+static void *section_hash_worker(void *arg) {
+	section_hash_work_t *work = arg;
+
+	for (;;) {
+		pthread_mutex_lock(&work->lock);
+		const size_t i = work->next++;
+		pthread_mutex_unlock(&work->lock);
+		if (i >= work->count)
+			break;
+
+		section_hash_task_t *task = &work->tasks[i];
+		task->status = get_file_range_hashes(work->ctx, task->hash, task->name,
+			work->algorithms, task->offset, task->size);
+	}
+
+	return NULL;
+}
+
+// Runs the tasks on up to `jobs` threads, the calling thread included.
+static void run_section_hash_tasks(section_hash_work_t *work, unsigned int jobs) {
+	if (jobs > work->count)
+		jobs = work->count;
+
+	pthread_t threads[LIBPE_HASH_MAX_JOBS];
+	unsigned int started = 0;
+	while (started + 1 < jobs) {
+		if (pthread_create(&threads[started], NULL, section_hash_worker, work) != 0)
+			break; // The remaining tasks are picked up by the threads already running.
+		started++;
+	}
+
+	section_hash_worker(work);
+
+	for (unsigned int i=0; i < started; i++)
+		pthread_join(threads[i], NULL);
+}
+
+// The cached hashes are reused when they cover every requested algorithm.
+// Otherwise they are computed again for the union of both sets, and the
+// previous result stays valid in the arena for callers still holding it.
+static pe_hash_sections_t *load_sections_hash(pe_ctx_t *ctx, unsigned int algorithms, unsigned int jobs) {
+	const unsigned int cached_algorithms = ctx->cached_data.hash_sections_algorithms;
+	if (ctx->cached_data.hash_sections != NULL && (cached_algorithms & algorithms) == algorithms)
 		return ctx->cached_data.hash_sections;
 
-	pe_hash_sections_t *result = ctx->cached_data.hash_sections = calloc(1, sizeof(pe_hash_sections_t));
+	if (ctx->cached_data.hash_sections != NULL)
+		algorithms |= cached_algorithms;
+
+	pe_hash_sections_t *result = pe_arena_calloc(ctx->arena, 1, sizeof(pe_hash_sections_t));
 	if (result == NULL) {
 		// TODO(jweyrich): Should we report an error? If yes, we need a redesign.
 		return NULL;
 	}
+	ctx->cached_data.hash_sections = result;
+	ctx->cached_data.hash_sections_algorithms = algorithms;
 	
 	result->err = LIBPE_E_OK;
 
@@ -299,110 +1188,280 @@ pe_hash_sections_t *pe_get_sections_hash(pe_ctx_t *ctx) {
 	
 	// Allocate an array of pointers once so we can store each pe_hash_t pointer in the
 	// respective result->sections[i].
-	result->sections = calloc(num_sections, sizeof(pe_hash_t *));
-	if (result->sections == NULL) {
+	result->sections = pe_arena_calloc(ctx->arena, num_sections, sizeof(pe_hash_t *));
+	section_hash_task_t *tasks = pe_calloc(num_sections, sizeof(section_hash_task_t));
+	if (result->sections == NULL || tasks == NULL) {
+		pe_free(tasks);
 		result->err = LIBPE_E_ALLOCATION_FAILURE;
 		return result;
 	}
 
 	IMAGE_SECTION_HEADER ** const sections = pe_sections(ctx);
+	const uint64_t file_size = pe_filesize(ctx);
+	size_t num_tasks = 0;
 
 	for (size_t i=0; i < num_sections; i++) {
-		uint64_t data_size = sections[i]->SizeOfRawData;
-		const unsigned char *data = LIBPE_PTR_ADD(ctx->map_addr, sections[i]->PointerToRawData);
+		const uint64_t data_offset = sections[i]->PointerToRawData;
+		const uint64_t data_size = sections[i]->SizeOfRawData;
 
-		if (!pe_can_read(ctx, data, data_size)) {
+		if (data_offset > file_size || data_size > file_size - data_offset) {
 			//fprintf(stderr, "%s\n", "unable to read sections data");
 			continue;
 		}
 
 		if (data_size) {
-			char *name = (char *)sections[i]->Name;
-
-			pe_hash_t *section_hash = calloc(1, sizeof(pe_hash_t));
-			if (section_hash == NULL) {
+			section_hash_task_t *task = &tasks[num_tasks++];
+			task->name = (char *)sections[i]->Name;
+			task->offset = data_offset;
+			task->size = data_size;
+			task->hash = pe_arena_calloc(ctx->arena, 1, sizeof(pe_hash_t));
+			if (task->hash == NULL) {
+				num_tasks--;
 				result->err = LIBPE_E_ALLOCATION_FAILURE;
 				break;
 			}
+		}
+	}
 
-			pe_err_e status = get_hashes(section_hash, name, data, data_size);
-			if (status != LIBPE_E_OK) {
-				// TODO: Should we skip this section and continue the loop?
-				result->err = status;
-				free(section_hash);
-				break;
-			}
-
-			result->sections[result->count] = section_hash;
-			result->count++;
+	section_hash_work_t work = {
+		.ctx = ctx,
+		.algorithms = algorithms,
+		.tasks = tasks,
+		.count = num_tasks,
+		.next = 0
+	};
+	pthread_mutex_init(&work.lock, NULL);
+	run_section_hash_tasks(&work, jobs);
+	pthread_mutex_destroy(&work.lock);
+
+	// Collect the results in section order, up to the first failure.
+	for (size_t i=0; i < num_tasks; i++) {
+		if (tasks[i].status != LIBPE_E_OK) {
+			// TODO: Should we skip this section and continue the loop?
+			result->err = tasks[i].status;
+			break;
 		}
+		result->sections[result->count] = tasks[i].hash;
+		result->count++;
 	}
 
+	pe_free(tasks);
 	return result;
 }
 
-pe_hash_t *pe_get_file_hash(pe_ctx_t *ctx) {
-	if (ctx->cached_data.hash_file != NULL)
+pe_hash_sections_t *pe_get_sections_hash_parallel(pe_ctx_t *ctx, unsigned int algorithms, unsigned int jobs) {
+	if (jobs == 0) {
+		const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		jobs = cpus > 0 ? (unsigned int)cpus : 1;
+	}
+	if (jobs > LIBPE_HASH_MAX_JOBS)
+		jobs = LIBPE_HASH_MAX_JOBS;
+
+	pthread_mutex_lock(&ctx->cached_locks.hash_sections);
+	pe_hash_sections_t *result = load_sections_hash(ctx, algorithms & (LIBPE_HASH_ALL | LIBPE_HASH_FAST), jobs);
+	pthread_mutex_unlock(&ctx->cached_locks.hash_sections);
+	return result;
+}
+
+pe_hash_sections_t *pe_get_sections_hash_ext(pe_ctx_t *ctx, unsigned int algorithms) {
+	return pe_get_sections_hash_parallel(ctx, algorithms, 1);
+}
+
+pe_hash_sections_t *pe_get_sections_hash(pe_ctx_t *ctx) {
+	return pe_get_sections_hash_ext(ctx, LIBPE_HASH_ALL);
+}
+
+// Cached the same way as load_sections_hash.
+static pe_hash_t *load_file_hash(pe_ctx_t *ctx, unsigned int algorithms) {
+	const unsigned int cached_algorithms = ctx->cached_data.hash_file_algorithms;
+	if (ctx->cached_data.hash_file != NULL && (cached_algorithms & algorithms) == algorithms)
 		return ctx->cached_data.hash_file;
 
-	pe_hash_t *hash = ctx->cached_data.hash_file = calloc(1, sizeof(pe_hash_t));
+	if (ctx->cached_data.hash_file != NULL)
+		algorithms |= cached_algorithms;
+
+	pe_hash_t *hash = pe_arena_calloc(ctx->arena, 1, sizeof(pe_hash_t));
 	if (hash == NULL) {
 		// TODO(jweyrich): Should we report an error? If yes, we need a redesign.
 		return NULL;
 	}
 
 	const uint64_t data_size = pe_filesize(ctx);
-	pe_err_e status = get_hashes(hash, "PEfile hash", ctx->map_addr, data_size);
-	if (status != LIBPE_E_OK)
-		abort();
+	pe_err_e status = get_file_range_hashes(ctx, hash, "PEfile hash", algorithms, 0, data_size);
+	if (status != LIBPE_E_OK) {
+		// A read error of the I/O backend, such as EIO or a file truncated
+		// meanwhile. Nothing is cached, so the next call tries again.
+		return NULL;
+	}
+
+	ctx->cached_data.hash_file = hash;
+	ctx->cached_data.hash_file_algorithms = algorithms;
 	return hash;
-} 
+}
 
-typedef struct element {
-	char *dll_name;
-	char *function_name;
-	//struct element *prev; // needed for a doubly-linked list only
-	struct element *next; // needed for singly- or doubly-linked lists
-} element_t;
+pe_hash_t *pe_get_file_hash_ext(pe_ctx_t *ctx, unsigned int algorithms) {
+	pthread_mutex_lock(&ctx->cached_locks.hash_file);
+	pe_hash_t *result = load_file_hash(ctx, algorithms & (LIBPE_HASH_ALL | LIBPE_HASH_FAST));
+	pthread_mutex_unlock(&ctx->cached_locks.hash_file);
+	return result;
+}
 
-// strlwr - string lowercase
-static void pe_transform_to_lowercase_str(char* str)
-{
-	if (str == NULL)
-		// TODO: Should we warn here?
-		return;
+pe_hash_t *pe_get_file_hash(pe_ctx_t *ctx) {
+	return pe_get_file_hash_ext(ctx, LIBPE_HASH_ALL);
+}
 
-	for (char* p = str; *p; ++p)
-		*p = tolower((unsigned char)*p);
+// Copies up to `src_size` bytes of the string at `src` into `dst` in lowercase,
+// stopping at the first NUL or after `dst_size - 1` characters.
+static size_t copy_lowercase(char *dst, size_t dst_size, const char *src, size_t src_size) {
+	const size_t max_len = pe_utils_min(dst_size - 1, src_size);
+	size_t len = 0;
+	for (; len < max_len && src[len] != '\0'; len++)
+		dst[len] = tolower((unsigned char)src[len]);
+	dst[len] = '\0';
+	return len;
 }
 
-static void pe_get_all_ord_lkp_func_name_with_hint(element_t* elem_ptr, ord_t* ord_ptr, int hint)
-{
-	for (ord_t* p = ord_ptr; p->number; ++p)
-	{
-		if (hint == p->number)
+// Bytes of the mapping that can be read from `ptr` onwards.
+static size_t readable_size(const pe_ctx_t *ctx, const void *ptr) {
+	if (!pe_can_read(ctx, ptr, 1))
+		return 0;
+	return ctx->map_end - (uintptr_t)ptr;
+}
+
+// Strips the extension of an already lowercased DLL name, as each flavor does it.
+static void imphash_normalize_dll_name(char *dll_name, pe_imphash_flavor_e flavor) {
+	static const char * const pefile_extensions[] = { ".dll", ".ocx", ".sys" };
+
+	switch (flavor) {
+		case LIBPE_IMPHASH_FLAVOR_MANDIANT:
+		{
+			char *aux = last_strstr(dll_name, ".");
+			if (aux)
+				*aux = '\0';
+			break;
+		}
+		case LIBPE_IMPHASH_FLAVOR_PEFILE:
 		{
-			errno = 0;
-			elem_ptr->function_name = strdup(p->fname);
-			PEV_ABORT_IF(!elem_ptr->function_name || errno == ENOMEM);
+			for (size_t i=0; i < LIBPE_SIZEOF_ARRAY(pefile_extensions); i++) {
+				char *aux = last_strstr(dll_name, pefile_extensions[i]);
+				if (aux)
+					*aux = '\0';
+			}
 			break;
 		}
 	}
 }
 
-static void imphash_load_imported_functions(pe_ctx_t *ctx, uint64_t offset, char *dll_name, element_t **head, pe_imphash_flavor_e flavor) {
-	if (dll_name == NULL || dll_name[0] == '\0')
+static const char *imphash_lookup_ordinal(const ord_t *ord_ptr, uint64_t ordinal) {
+	for (const ord_t *p = ord_ptr; p->number; ++p) {
+		if ((uint64_t)p->number == ordinal)
+			return p->fname;
+	}
+	return NULL;
+}
+
+// Feeds comma separated tokens, such as the "dll.function" ones of an imphash,
+// straight into MD5. Tokens are batched in `buf` so short names don't cost a
+// digest update each.
+typedef struct {
+	pe_hash_multi_t md5;
+	pe_err_e err;
+	size_t count; // Tokens appended so far
+	size_t len;   // Bytes pending in `buf`
+	char buf[4096];
+} token_builder_t;
+
+static pe_err_e token_builder_init(token_builder_t *builder) {
+	builder->err = LIBPE_E_OK;
+	builder->count = 0;
+	builder->len = 0;
+	return pe_hash_multi_init(&builder->md5, LIBPE_HASH_MD5);
+}
+
+static void token_builder_flush(token_builder_t *builder) {
+	if (builder->len > 0 && builder->err == LIBPE_E_OK)
+		builder->err = pe_hash_multi_update(&builder->md5, builder->buf, builder->len);
+	builder->len = 0;
+}
+
+static void token_builder_feed(token_builder_t *builder, const char *data, size_t size) {
+	if (builder->len + size > sizeof(builder->buf))
+		token_builder_flush(builder);
+	if (size > sizeof(builder->buf)) {
+		if (builder->err == LIBPE_E_OK)
+			builder->err = pe_hash_multi_update(&builder->md5, data, size);
 		return;
+	}
+	memcpy(builder->buf + builder->len, data, size);
+	builder->len += size;
+}
 
-	uint64_t ofs = offset;
+// Appends the token "prefix.name", or just "name" if `prefix` is NULL.
+static void token_builder_append(token_builder_t *builder, const char *prefix, const char *name) {
+	if (builder->count++ > 0)
+		token_builder_feed(builder, ",", 1);
+	if (prefix != NULL) {
+		token_builder_feed(builder, prefix, strlen(prefix));
+		token_builder_feed(builder, ".", 1);
+	}
+	token_builder_feed(builder, name, strlen(name));
+}
 
-	char* hint_str = NULL;
-	char* fname = NULL;
+// Writes the MD5 of the tokens to `output`, or an empty string if no token
+// was appended. Releases `builder`.
+static pe_err_e token_builder_final(token_builder_t *builder, char output[static 16 * 2 + 1]) {
+	output[0] = '\0';
 
-	bool is_ordinal = false;
-	int errcode = 0; // for asprintf return code
+	token_builder_flush(builder);
+	if (builder->count == 0 || builder->err != LIBPE_E_OK) {
+		pe_hash_multi_cleanup(&builder->md5);
+		return builder->err;
+	}
+
+	pe_hash_digests_t digests;
+	const pe_err_e ret = pe_hash_multi_final(&builder->md5, &digests);
+	if (ret == LIBPE_E_OK)
+		memcpy(output, digests.md5, sizeof(digests.md5));
+	return ret;
+}
+
+// One imphash flavor computed by imphash_walk.
+typedef struct {
+	pe_imphash_flavor_e flavor;
+	token_builder_t tokens;
+	char dll_name[MAX_DLL_NAME]; // Normalised name of the DLL being walked
+} imphash_builder_t;
+
+// Writes the name `builder` hashes for an import by ordinal.
+static void imphash_ordinal_name(char *fname, size_t fname_size, const imphash_builder_t *builder, uint64_t ordinal) {
+	if (builder->flavor == LIBPE_IMPHASH_FLAVOR_MANDIANT) {
+		snprintf(fname, fname_size, "%"PRIu64, ordinal);
+		return;
+	}
+
+	// pefile resolves the ordinals of a few well-known DLLs to names.
+	const char *known_name = NULL;
+	if (strncmp(builder->dll_name, "oleaut32", 8) == 0)
+		known_name = imphash_lookup_ordinal(oleaut32_arr, ordinal);
+	else if (strncmp(builder->dll_name, "ws2_32", 6) == 0)
+		known_name = imphash_lookup_ordinal(ws2_32_arr, ordinal);
+
+	if (known_name != NULL)
+		copy_lowercase(fname, fname_size, known_name, fname_size);
+	else
+		snprintf(fname, fname_size, "ord%"PRIu64, ordinal);
+}
+
+// Appends one token per function imported from the DLL being walked to every builder.
+static void imphash_load_imported_functions(pe_ctx_t *ctx, uint64_t offset, imphash_builder_t *builders, size_t count) {
+	uint64_t ofs = offset;
+	char fname[MAX_FUNCTION_NAME];
 
 	while (1) {
+		bool is_ordinal = false;
+		uint64_t ordinal = 0;
+		const IMAGE_IMPORT_BY_NAME *imp_name = NULL;
+
 		switch (ctx->pe.optional_hdr.type) {
 			case MAGIC_PE32:
 				{
@@ -420,31 +1479,14 @@ static void imphash_load_imported_functions(pe_ctx_t *ctx, uint64_t offset, char
 					is_ordinal = (thunk_type & IMAGE_ORDINAL_FLAG32) != 0;
 
 					if (is_ordinal) {
-						errcode = asprintf(&hint_str, "%"PRIu32, 
-										   thunk->u1.Ordinal & ~IMAGE_ORDINAL_FLAG32);
-						
-						// FIX-ME: devemos abortar a execucao?
-						PEV_ABORT_IF(errcode == -1);
-						
+						ordinal = thunk->u1.Ordinal & ~IMAGE_ORDINAL_FLAG32;
 					} else {
 						const uint64_t imp_ofs = pe_rva2ofs(ctx, thunk->u1.AddressOfData);
-						const IMAGE_IMPORT_BY_NAME *imp_name = LIBPE_PTR_ADD(ctx->map_addr, imp_ofs);
+						imp_name = LIBPE_PTR_ADD(ctx->map_addr, imp_ofs);
 						if (!pe_can_read(ctx, imp_name, sizeof(IMAGE_IMPORT_BY_NAME))) {
 							// TODO: Should we report something?
 							return;
 						}
-
-						errcode = asprintf(&hint_str, "%"PRIu16, imp_name->Hint);
-						PEV_ABORT_IF(errcode == -1);
-
-						errno = 0;
-
-						// if the character '\0' comes before MAX_FUNCTION_NAME - 1
-						// we duplicate the string and put it in fname
-						// if you can't find '\ 0' copy up to the maximum
-						// MAX_FUNCTION_NAME - 1 characters
-						fname = strndup((char*)imp_name->Name, MAX_FUNCTION_NAME - 1);
-						PEV_ABORT_IF(!fname || errno == ENOMEM);
 					}
 
 					ofs += sizeof(IMAGE_THUNK_DATA32);
@@ -466,27 +1508,16 @@ static void imphash_load_imported_functions(pe_ctx_t *ctx, uint64_t offset, char
 					is_ordinal = (thunk_type & IMAGE_ORDINAL_FLAG64) != 0;
 
 					if (is_ordinal) {
-						errcode = asprintf(&hint_str, "%"PRIu64,
-										   (uint64_t)(thunk->u1.Ordinal & ~IMAGE_ORDINAL_FLAG64));
-						
-						PEV_ABORT_IF(errcode == -1);
-
+						ordinal = thunk->u1.Ordinal & ~IMAGE_ORDINAL_FLAG64;
 					} else {
-						uint64_t imp_ofs = pe_rva2ofs(ctx, thunk->u1.AddressOfData);
-						const IMAGE_IMPORT_BY_NAME *imp_name = LIBPE_PTR_ADD(ctx->map_addr, imp_ofs);
+						const uint64_t imp_ofs = pe_rva2ofs(ctx, thunk->u1.AddressOfData);
+						imp_name = LIBPE_PTR_ADD(ctx->map_addr, imp_ofs);
 						if (!pe_can_read(ctx, imp_name, sizeof(IMAGE_IMPORT_BY_NAME))) {
 							// TODO: Should we report something?
 							return;
 						}
-
-						errcode = asprintf(&hint_str, "%"PRIu16, imp_name->Hint);
-						PEV_ABORT_IF(errcode == -1);
-
-
-						errno = 0;
-						fname = strndup((char*)imp_name->Name, MAX_FUNCTION_NAME - 1);
-						PEV_ABORT_IF(!fname || errno == ENOMEM);
 					}
+
 					ofs += sizeof(IMAGE_THUNK_DATA64);
 					break;
 				}
@@ -494,132 +1525,43 @@ static void imphash_load_imported_functions(pe_ctx_t *ctx, uint64_t offset, char
 				return;
 		}
 
-		// Beginning of imphash logic - that's the weirdest thing I've even seen...
-		pe_transform_to_lowercase_str(dll_name);
-		char *aux = NULL;
-
-		//TODO use a reverse search function instead
-
-		switch (flavor) {
-			default: abort();
-			case LIBPE_IMPHASH_FLAVOR_MANDIANT:
-			{
-				aux = last_strstr(dll_name, ".");
-				break;
-			}
-			case LIBPE_IMPHASH_FLAVOR_PEFILE:
-			{
-				aux = last_strstr(dll_name, ".dll");
-				if (aux)
-					*aux = '\0';
-
-				aux = last_strstr(dll_name, ".ocx");
-				if (aux)
-					*aux = '\0';
-
-				aux = last_strstr(dll_name, ".sys");
-				if (aux)
-					*aux = '\0';
-				break;
-			}
-		}
-
-		if (aux)
-			*aux = '\0';
-
-		pe_transform_to_lowercase_str(fname);
-
-		element_t *el = calloc(1, sizeof(element_t));
-		if (el == NULL) {
-			// TODO: Handle allocation failure.
-			abort();
+		// Names are the same for every flavor, only ordinals differ.
+		if (!is_ordinal) {
+			const char *name = (const char *)imp_name->Name;
+			copy_lowercase(fname, sizeof(fname), name, readable_size(ctx, name));
 		}
 
-		errno = 0;
-		el->dll_name = strdup(dll_name);
-
-		// add verification of allocation error
-		PEV_ABORT_IF(!el->dll_name || errno == ENOMEM);
-
-		switch (flavor) {
-			default: abort();
-			case LIBPE_IMPHASH_FLAVOR_MANDIANT:
-			{
-				el->function_name = is_ordinal ? hint_str : fname;
-				break;
-			}
-			case LIBPE_IMPHASH_FLAVOR_PEFILE:
-			{
-				errno = 0;
-
-				char* rest = NULL;
-				int hint = (int) strtol(hint_str, &rest, 10);
-
-				// should we treat the error or abort?
-				PEV_ABORT_IF(hint_str == rest || errno == ERANGE);
-
-				if (strncmp(dll_name, "oleaut32", 8) == 0 && is_ordinal) {
-					pe_get_all_ord_lkp_func_name_with_hint(el, oleaut32_arr, hint);
-				} else if (strncmp(dll_name, "ws2_32", 6) == 0 && is_ordinal) {
-					pe_get_all_ord_lkp_func_name_with_hint(el, ws2_32_arr, hint);
-				} 
-				else 
-				{
-					if (is_ordinal) {
-						char* ord_str = NULL;
-
-						errcode = asprintf(&ord_str, "ord%s", hint_str);
-						PEV_ABORT_IF(errcode == -1);
-
-						el->function_name = ord_str;
-					} else {
-						el->function_name = fname;
-					}
-				}
-
-				break;
-			}
+		for (size_t i=0; i < count; i++) {
+			if (is_ordinal)
+				imphash_ordinal_name(fname, sizeof(fname), &builders[i], ordinal);
+			token_builder_append(&builders[i].tokens, builders[i].dll_name, fname);
 		}
-
-		pe_transform_to_lowercase_str(el->function_name);
-		LL_APPEND(*head, el);
 	}
 }
 
-static void freeNodes(element_t *currentNode) {
-	if (currentNode == NULL)
-		return;
-
-	while(currentNode != NULL) {
-		element_t *temp = currentNode;
-		currentNode = currentNode->next;
-		free(temp->function_name);
-		free(temp->dll_name);
-		free(temp);
-	}
-}
+// Walks the import table once, feeding every builder. Returns false if the
+// import directory is malformed, in which case no imphash is reported.
+static bool imphash_walk(pe_ctx_t *ctx, imphash_builder_t *builders, size_t count) {
+	if (count == 0)
+		return true;
 
-char *pe_imphash(pe_ctx_t *ctx, pe_imphash_flavor_e flavor) {
 	const IMAGE_DATA_DIRECTORY *dir = pe_directory_by_entry(ctx, IMAGE_DIRECTORY_ENTRY_IMPORT);
 	if (dir == NULL)
-		return NULL;
+		return true;
 
 	const uint64_t va = dir->VirtualAddress;
 	if (va == 0) {
 		//fprintf(stderr, "import directory not found\n");
-		return NULL;
+		return true;
 	}
 
 	uint64_t ofs = pe_rva2ofs(ctx, va);
-	
-	element_t *elt, *tmp, *head = NULL;
-	int count = 0;
 
 	while (1) {
 		IMAGE_IMPORT_DESCRIPTOR *id = LIBPE_PTR_ADD(ctx->map_addr, ofs);
 		if (!pe_can_read(ctx, id, sizeof(IMAGE_IMPORT_DESCRIPTOR))) {
 			// TODO: Should we report something?
-			return NULL;
+			return false;
 		}
 
 		if (!id->u1.OriginalFirstThunk && !id->FirstThunk)
@@ -630,7 +1572,7 @@ char *pe_imphash(pe_ctx_t *ctx, pe_imphash_flavor_e flavor) {
 
 		ofs = pe_rva2ofs(ctx, id->Name);
 		if (ofs == 0 || ofs > (uint64_t) ctx->map_size)
-			return NULL;
+			return false;
 
 		const char *dll_name_ptr = LIBPE_PTR_ADD(ctx->map_addr, ofs);
 		if (!pe_can_read(ctx, dll_name_ptr, 1)) {
@@ -638,116 +1580,158 @@ char *pe_imphash(pe_ctx_t *ctx, pe_imphash_flavor_e flavor) {
 			break;
 		}
 
-		char* dll_name = NULL;
-		errno = 0;
-
-		// if the character '\0' comes before MAX_DLL_NAME - 1
-		// we duplicate the string and put it in fname
-		// if you can't find '\ 0' copy up to the maximum
-		// MAX_DLL_NAME - 1 characters
-		dll_name = strndup(dll_name_ptr, MAX_DLL_NAME - 1);
-		PEV_ABORT_IF(!dll_name || errno == ENOMEM);
+		// The name is lowercased and normalised once for all of its functions.
+		size_t dll_name_len = 0;
+		for (size_t i=0; i < count; i++) {
+			dll_name_len = copy_lowercase(builders[i].dll_name, sizeof(builders[i].dll_name),
+				dll_name_ptr, readable_size(ctx, dll_name_ptr));
+			imphash_normalize_dll_name(builders[i].dll_name, builders[i].flavor);
+		}
 
 		ofs = pe_rva2ofs(ctx, id->u1.OriginalFirstThunk ? id->u1.OriginalFirstThunk : id->FirstThunk);
-		if (ofs == 0) {
-			free(dll_name);
+		if (ofs == 0)
 			break;
-		}
 
-		imphash_load_imported_functions(ctx, ofs, dll_name, &head, flavor);
-
-		// release dll_name from memory
-		free(dll_name);
+		if (dll_name_len > 0)
+			imphash_load_imported_functions(ctx, ofs, builders, count);
 
 		// Restore previous ofs
 		ofs = aux; 
 	}
 
-	LL_COUNT(head, elt, count);
+	return true;
+}
 
-	// Allocate enough memory to store N times "dll_name.func_name,", plus 1 byte for the NUL terminator.
-	const size_t imphash_string_size = count * (MAX_DLL_NAME + MAX_FUNCTION_NAME + 2) + 1;
-	char *imphash_string = calloc(1, imphash_string_size);
+// Feeds the lowercased names of the exports, in the order of the name
+// pointer table (which the linker sorts), to `tokens`.
+static void exphash_walk(pe_ctx_t *ctx, token_builder_t *tokens) {
+	const IMAGE_DATA_DIRECTORY *dir = pe_directory_by_entry(ctx, IMAGE_DIRECTORY_ENTRY_EXPORT);
+	if (dir == NULL || dir->VirtualAddress == 0)
+		return;
 
-	if (imphash_string == NULL) {
-		// TODO: Handle allocation failure.
-		abort();
-	}
+	const IMAGE_EXPORT_DIRECTORY *exp = LIBPE_PTR_ADD(ctx->map_addr, pe_rva2ofs(ctx, dir->VirtualAddress));
+	if (!pe_can_read(ctx, exp, sizeof(IMAGE_EXPORT_DIRECTORY)))
+		return;
 
-	LL_FOREACH_SAFE(head, elt, tmp) {
-		sprintf(imphash_string + strlen(imphash_string), "%s.%s,", elt->dll_name, elt->function_name);
-		LL_DELETE(head, elt);
-	}
+	// An RVA outside of every section translates to 0, which would read the
+	// name RVAs from the DOS header.
+	const uint64_t offset_to_AddressOfNames = pe_rva2ofs(ctx, exp->AddressOfNames);
+	if (offset_to_AddressOfNames == 0)
+		return;
 
-	assert(!elt);
-	freeNodes(head);
+	char fname[MAX_FUNCTION_NAME];
 
-	size_t imphash_string_len = strlen(imphash_string);
-	if (imphash_string_len == 0) {
-		free(imphash_string);
-		//ret = LIBPE_E_ALLOCATION_FAILURE;
-		return NULL;
-	}
+	for (uint32_t i=0; i < exp->NumberOfNames; i++) {
+		const uint32_t *entry_name_rva = LIBPE_PTR_ADD(ctx->map_addr, offset_to_AddressOfNames + sizeof(uint32_t) * i);
+		if (!pe_can_read(ctx, entry_name_rva, sizeof(uint32_t)))
+			break;
 
-	// Remove the last comma sign and decrement the string length by 1.
-	imphash_string[imphash_string_len-1] = '\0';
-	imphash_string_len--;
+		const char *entry_name = LIBPE_PTR_ADD(ctx->map_addr, pe_rva2ofs(ctx, *entry_name_rva));
+		if (!pe_can_read(ctx, entry_name, 1))
+			break;
 
-	const unsigned char *data = (const unsigned char *)imphash_string;
-	const size_t data_size = imphash_string_len;
+		copy_lowercase(fname, sizeof(fname), entry_name, readable_size(ctx, entry_name));
+		token_builder_append(tokens, NULL, fname);
+	}
+}
 
-	const size_t hash_maxsize = pe_hash_recommended_size();
-	char *hash_value = calloc(1, hash_maxsize);
-	if (hash_value == NULL) {
-		free(imphash_string);
-		//ret = LIBPE_E_ALLOCATION_FAILURE;
-		return NULL;
+pe_err_e pe_get_symbol_hashes(pe_ctx_t *ctx, unsigned int which, pe_symbol_hashes_t *hashes) {
+	memset(hashes, 0, sizeof(pe_symbol_hashes_t));
+
+	pe_err_e ret = pe_map_file(ctx);
+	if (ret != LIBPE_E_OK)
+		return ret;
+
+	static const struct {
+		pe_symbol_hash_e which;
+		pe_imphash_flavor_e flavor;
+	} flavors[] = {
+		{ LIBPE_SYMHASH_IMPHASH_MANDIANT, LIBPE_IMPHASH_FLAVOR_MANDIANT },
+		{ LIBPE_SYMHASH_IMPHASH_PEFILE, LIBPE_IMPHASH_FLAVOR_PEFILE },
+	};
+	char * const outputs[] = { hashes->imphash_mandiant, hashes->imphash_pefile };
+
+	// Both imphash flavors come from a single walk of the import table.
+	imphash_builder_t builders[LIBPE_SIZEOF_ARRAY(flavors)];
+	char *builder_outputs[LIBPE_SIZEOF_ARRAY(flavors)];
+	size_t count = 0;
+
+	for (size_t i=0; i < LIBPE_SIZEOF_ARRAY(flavors); i++) {
+		if (!(which & flavors[i].which))
+			continue;
+		builders[count].flavor = flavors[i].flavor;
+		builder_outputs[count] = outputs[i];
+		ret = token_builder_init(&builders[count].tokens);
+		if (ret != LIBPE_E_OK)
+			break;
+		count++;
 	}
 
-	const bool hash_ok = pe_hash_raw_data(hash_value, hash_maxsize, "md5", data, data_size);
+	if (ret == LIBPE_E_OK && imphash_walk(ctx, builders, count)) {
+		for (size_t i=0; i < count; i++) {
+			const pe_err_e status = token_builder_final(&builders[i].tokens, builder_outputs[i]);
+			if (ret == LIBPE_E_OK)
+				ret = status;
+		}
+	} else {
+		for (size_t i=0; i < count; i++)
+			pe_hash_multi_cleanup(&builders[i].tokens.md5);
+	}
 
-	free(imphash_string);
+	if (ret != LIBPE_E_OK || !(which & LIBPE_SYMHASH_EXPHASH))
+		return ret;
 
-	//printf("### DEBUG imphash_string [%zu] = %s\n", imphash_string_len, imphash_string);
+	token_builder_t tokens;
+	ret = token_builder_init(&tokens);
+	if (ret != LIBPE_E_OK)
+		return ret;
+	exphash_walk(ctx, &tokens);
+	return token_builder_final(&tokens, hashes->exphash);
+}
 
-	if (!hash_ok) {
-		free(hash_value);
-		return NULL;
+char *pe_imphash(pe_ctx_t *ctx, pe_imphash_flavor_e flavor) {
+	pe_symbol_hashes_t hashes;
+	const char *imphash;
+
+	switch (flavor) {
+		case LIBPE_IMPHASH_FLAVOR_MANDIANT:
+			pe_get_symbol_hashes(ctx, LIBPE_SYMHASH_IMPHASH_MANDIANT, &hashes);
+			imphash = hashes.imphash_mandiant;
+			break;
+		case LIBPE_IMPHASH_FLAVOR_PEFILE:
+			pe_get_symbol_hashes(ctx, LIBPE_SYMHASH_IMPHASH_PEFILE, &hashes);
+			imphash = hashes.imphash_pefile;
+			break;
+		default:
+			return NULL;
 	}
 
-	return hash_value;
+	if (imphash[0] == '\0')
+		return NULL;
+
+	// NOTE: Not pe_strdup, as the caller releases the result with free().
+	return strdup(imphash);
 }
 
-void pe_hash_headers_dealloc(pe_hash_headers_t *obj) {
-	if (obj == NULL)
-		return;
+// Nothing to do in the functions below. Hashes live in the context arena
+// and are released by pe_unload.
 
-	pe_hash_dealloc(obj->dos);
-	pe_hash_dealloc(obj->coff);
-	pe_hash_dealloc(obj->optional);
-	free(obj);
+void pe_hash_headers_dealloc(pe_hash_headers_t *obj) {
+	(void)obj;
 }
 
 void pe_hash_sections_dealloc(pe_hash_sections_t *obj) {
-	if (obj == NULL)
-		return;
-
-	for (uint32_t i=0; i < obj->count; i++) {
-		pe_hash_dealloc(obj->sections[i]);
-	}
-
-	free(obj->sections);
-	free(obj);
+	(void)obj;
 }
 
-void pe_hash_dealloc(pe_hash_t *obj) {
+void pe_page_hashes_dealloc(pe_page_hashes_t *obj) {
+	// Not cached, so not in the context arena either.
 	if (obj == NULL)
 		return;
+	pe_free(obj->digests);
+	pe_free(obj);
+}
 
-	free(obj->name);
-	free(obj->md5);
-	free(obj->sha1);
-	free(obj->sha256);
-	free(obj->ssdeep);
-	free(obj);
+void pe_hash_dealloc(pe_hash_t *obj) {
+	(void)obj;
 }
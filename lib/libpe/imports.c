@@ -136,7 +136,7 @@ static pe_err_e parse_imported_functions(pe_ctx_t *ctx, pe_imported_dll_t *impor
 	imported_dll->err = LIBPE_E_OK;
 	imported_dll->functions_count = get_functions_count(ctx, offset);
 
-	imported_dll->functions = calloc(imported_dll->functions_count, sizeof(pe_imported_function_t));
+	imported_dll->functions = pe_arena_calloc(ctx->arena, imported_dll->functions_count, sizeof(pe_imported_function_t));
 	if (imported_dll->functions == NULL) {
 		imported_dll->err = LIBPE_E_ALLOCATION_FAILURE;
 		return imported_dll->err;
@@ -239,7 +239,7 @@ static pe_err_e parse_imported_functions(pe_ctx_t *ctx, pe_imported_dll_t *impor
 		imported_dll->functions[i].ordinal = ordinal;
 
 		if (!is_ordinal) {
-			imported_dll->functions[i].name = strdup(fname);
+			imported_dll->functions[i].name = pe_arena_strdup(ctx->arena, fname);
 			if (imported_dll->functions[i].name == NULL) {
 				imported_dll->err = LIBPE_E_ALLOCATION_FAILURE;
 				return imported_dll->err;
@@ -250,11 +250,13 @@ static pe_err_e parse_imported_functions(pe_ctx_t *ctx, pe_imported_dll_t *impor
 	return LIBPE_E_OK;
 }
 
-pe_imports_t *pe_imports(pe_ctx_t *ctx) {
+static pe_imports_t *load_imports(pe_ctx_t *ctx) {
 	if (ctx->cached_data.imports != NULL)
 		return ctx->cached_data.imports;
 
-	pe_imports_t *imports = ctx->cached_data.imports = calloc(1, sizeof(pe_imports_t));
+	pe_map_file(ctx);
+
+	pe_imports_t *imports = ctx->cached_data.imports = pe_arena_calloc(ctx->arena, 1, sizeof(pe_imports_t));
 	if (imports == NULL) {
 		// TODO(jweyrich): Should we report an error? If yes, we need a redesign.
 		return NULL;
@@ -267,7 +269,7 @@ pe_imports_t *pe_imports(pe_ctx_t *ctx) {
 		return imports;
 
 	// Allocate array to store DLLs
-	imports->dlls = calloc(imports->dll_count, sizeof(pe_imported_dll_t));
+	imports->dlls = pe_arena_calloc(ctx->arena, imports->dll_count, sizeof(pe_imported_dll_t));
 	if (imports->dlls == NULL) {
 		imports->err = LIBPE_E_ALLOCATION_FAILURE;
 		return imports;
@@ -312,7 +314,7 @@ pe_imports_t *pe_imports(pe_ctx_t *ctx) {
 
 		// Allocate string to store DLL name
 		const size_t dll_name_size = MAX_DLL_NAME;
-		dll->name = calloc(1, dll_name_size);
+		dll->name = pe_arena_calloc(ctx->arena, 1, dll_name_size);
 		if (dll->name == NULL) {
 			imports->err = LIBPE_E_ALLOCATION_FAILURE;
 			return imports;
@@ -343,19 +345,14 @@ pe_imports_t *pe_imports(pe_ctx_t *ctx) {
 	return imports;
 }
 
+pe_imports_t *pe_imports(pe_ctx_t *ctx) {
+	pthread_mutex_lock(&ctx->cached_locks.imports);
+	pe_imports_t *result = load_imports(ctx);
+	pthread_mutex_unlock(&ctx->cached_locks.imports);
+	return result;
+}
+
 void pe_imports_dealloc(pe_imports_t *obj) {
-	if (obj == NULL)
-		return;
-
-	for (uint32_t i=0; i < obj->dll_count; i++) {
-		const pe_imported_dll_t *dll = &obj->dlls[i];
-		for (uint32_t j=0; j < dll->functions_count; j++) {
-			const pe_imported_function_t *function = &dll->functions[j];
-			free(function->name);
-		}
-		free(dll->name);
-		free(dll->functions);
-	}
-	free(obj->dlls);
-	free(obj);
+	// Nothing to do. It lives in the context arena and is released by pe_unload.
+	(void)obj;
 }
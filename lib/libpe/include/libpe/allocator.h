@@ -0,0 +1,68 @@
+/*
+    libpe - the PE library
+
+    Copyright (C) 2010 - 2017 libpe authors
+    
+    This file is part of libpe.
+
+    libpe is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libpe is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with libpe.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LIBPE_ALLOCATOR_H
+#define LIBPE_ALLOCATOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Memory functions used by libpe for everything it allocates and releases
+// itself. Strings handed to the caller to be released with free() (e.g. the
+// result of pe_imphash) still come from the C library.
+typedef struct {
+	void *(*malloc_fn)(void *opaque, size_t size);
+	void (*free_fn)(void *opaque, void *ptr);
+	void *opaque;
+} pe_allocator_t;
+
+typedef struct {
+	uint64_t alloc_calls;     // Successful allocations
+	uint64_t failed_calls;    // Allocations that returned NULL, including refusals over a limit
+	uint64_t free_calls;
+	uint64_t bytes_allocated; // Total bytes ever allocated
+	uint64_t bytes_in_use;
+	uint64_t peak_bytes;      // Highest bytes_in_use seen
+} pe_alloc_stats_t;
+
+// Replaces the allocator used by libpe, or restores malloc/free if NULL.
+// NOTE: Only call it while no memory obtained from the previous allocator is alive,
+//       i.e. before loading the first file or after unloading the last one.
+void pe_set_allocator(const pe_allocator_t *allocator);
+void pe_get_alloc_stats(pe_alloc_stats_t *stats);
+void pe_reset_alloc_stats(void); // Keeps bytes_in_use, peak restarts from it
+
+void *pe_malloc(size_t size);
+void *pe_calloc(size_t nmemb, size_t size);
+char *pe_strdup(const char *str);
+char *pe_strndup(const char *str, size_t size);
+int pe_asprintf(char **strp, const char *format, ...);
+void pe_free(void *ptr);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
@@ -0,0 +1,61 @@
+/*
+    libpe - the PE library
+
+    Copyright (C) 2010 - 2017 libpe authors
+    
+    This file is part of libpe.
+
+    libpe is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libpe is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with libpe.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LIBPE_ARENA_H
+#define LIBPE_ARENA_H
+
+#include <pthread.h>
+#include <stddef.h>
+
+#include "allocator.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct pe_arena_block pe_arena_block_t;
+
+// Bump allocator backing every object libpe caches in a context (imports,
+// exports, resources and hashes). Memory is never given back piece by piece:
+// pe_arena_reset() keeps the blocks for the next file, and pe_arena_destroy()
+// returns them to the allocator.
+typedef struct {
+	pthread_mutex_t lock;
+	pe_arena_block_t *blocks;      // Blocks in use, the one being bumped first
+	pe_arena_block_t *free_blocks; // Blocks kept around by pe_arena_reset()
+	size_t limit;                  // Max. bytes handed out until the next reset, 0 for no limit
+	pe_alloc_stats_t stats;        // Allocations since the last reset
+} pe_arena_t;
+
+void pe_arena_init(pe_arena_t *arena);
+void pe_arena_reset(pe_arena_t *arena);
+void pe_arena_destroy(pe_arena_t *arena);
+void *pe_arena_alloc(pe_arena_t *arena, size_t size);
+void *pe_arena_calloc(pe_arena_t *arena, size_t nmemb, size_t size);
+char *pe_arena_strdup(pe_arena_t *arena, const char *str);
+void pe_arena_set_limit(pe_arena_t *arena, size_t limit);
+void pe_arena_get_stats(pe_arena_t *arena, pe_alloc_stats_t *stats);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
@@ -24,7 +24,10 @@
 
 #include <stdio.h>
 #include <inttypes.h>
+#include <pthread.h>
+#include <stdbool.h>
 
+#include "arena.h"
 #include "hdr_dos.h"
 #include "hdr_coff.h"
 #include "hdr_optional.h"
@@ -35,6 +38,24 @@
 #include "hashes.h"
 #include "types_resources.h"
 
+// Sorted interval index over one address space of the section table.
+// `bounds` holds `count + 1` ascending boundaries, and `owner[i]` is the
+// index of the first section (in header order) covering the interval
+// [bounds[i], bounds[i+1]), or -1 if no section covers it.
+typedef struct {
+	uint32_t count;
+	uint64_t *bounds;
+	int32_t *owner;
+} pe_section_map_t;
+
+typedef struct {
+	pe_section_map_t rva;     // pe_rva2section: [VirtualAddress, VirtualAddress + VirtualSize]
+	pe_section_map_t rva2ofs; // pe_rva2ofs: [VirtualAddress, VirtualAddress + (VirtualSize or SizeOfRawData))
+	pe_section_map_t ofs2rva; // pe_ofs2rva: [PointerToRawData, PointerToRawData + SizeOfRawData)
+	pe_section_map_t ofs;     // pe_ofs2section: [PointerToRawData, PointerToRawData + SizeOfRawData]
+	void *storage;            // Single allocation backing all maps above.
+} pe_section_index_t;
+
 typedef struct {
 	// DOS header
 	IMAGE_DOS_HEADER *dos_hdr;
@@ -53,6 +74,7 @@ typedef struct {
 	uint16_t num_sections;
 	void *sections_ptr;
 	IMAGE_SECTION_HEADER **sections; // array up to MAX_SECTIONS
+	pe_section_index_t section_index; // built by pe_parse
 	uint64_t entrypoint;
 	uint64_t imagebase;
 } pe_file_t;
@@ -65,18 +87,57 @@ typedef struct {
 	pe_hash_headers_t *hash_headers;
 	pe_hash_sections_t *hash_sections;
 	pe_hash_t *hash_file;
+	unsigned int hash_sections_algorithms; // pe_hash_alg_e bitmask computed for hash_sections
+	unsigned int hash_file_algorithms;     // pe_hash_alg_e bitmask computed for hash_file
 	// Resources
 	pe_resources_t *resources;
 } pe_cached_data_t;
 
+// One lock per slot of pe_cached_data_t, so each view is built exactly once
+// even when a context is shared between threads, and different views can be
+// built at the same time.
+typedef struct {
+	pthread_mutex_t imports;
+	pthread_mutex_t exports;
+	pthread_mutex_t hash_headers;
+	pthread_mutex_t hash_sections;
+	pthread_mutex_t hash_file;
+	pthread_mutex_t resources;
+	pthread_mutex_t mapping; // pe_map_file: upgrade from the header window to the full mapping
+} pe_cached_locks_t;
+
+typedef enum {
+	LIBPE_MAP_MMAP     = 0, // pe_load_file_ext: released with munmap
+	LIBPE_MAP_BORROWED = 1, // pe_load_buffer: caller-owned, never released by libpe
+	LIBPE_MAP_OWNED    = 2, // pe_load_buffer with LIBPE_OPT_BUFFER_OWNED: released with pe_free
+	LIBPE_MAP_HEADERS  = 3  // LIBPE_OPT_HEADERS_ONLY: only the header pages are mapped yet, see pe_map_file
+} pe_map_kind_e;
+
+// How the file behind a context is read, set by the load functions.
+typedef struct {
+	int fd;             // Descriptor the file is mapped or read from; -1 when none is kept.
+	                    // LIBPE_OPT_HEADERS_ONLY keeps it until pe_map_file, while
+	                    // LIBPE_OPT_WINDOWED and the LIBPE_OPT_IO_* backends keep it until pe_unload.
+	bool owns_fd;       // `fd` was opened by libpe and is closed by pe_map_file or pe_unload
+	int direct_fd;      // LIBPE_OPT_IO_DIRECT: the file opened again with O_DIRECT, or -1
+	uint16_t options;   // pe_options_e given to the load function
+	uint64_t file_size;
+	uint64_t reserved;  // LIBPE_OPT_HEADERS_ONLY: address range reserved for pe_map_file at `map_addr`
+} pe_file_io_t;
+
 typedef struct pe_ctx {
 	FILE *stream;
-	char *path;
+	char *path; // Informational only; NULL when loaded from a buffer or fd
+	pe_map_kind_e map_kind;
 	void *map_addr;
 	off_t map_size;
 	uintptr_t map_end;
 	pe_file_t pe;
 	pe_cached_data_t cached_data;
+	pe_cached_locks_t cached_locks;
+	pe_file_io_t io;
+	pe_arena_t *arena; // Backs cached_data; &own_arena unless pe_use_arena() was called
+	pe_arena_t own_arena;
 } pe_ctx_t;
 
 #endif
@@ -33,6 +33,12 @@ typedef enum {
 	LIBPE_E_OK = 0,
 	// Declaring negative values this way is EVIL because it
 	// BREAKS compatiblity every time we add/remove an error code.
+	// NOTE: New error codes are added above this line, counting down from -24,
+	//       so the existing values below are kept as they are.
+	LIBPE_E_INVALID_SSDEEP = -27,
+	LIBPE_E_INVALID_CERT_TABLE = -26,
+	LIBPE_E_READ_FAILED = -25,
+	LIBPE_E_INVALID_BUFFER = -24,
 	LIBPE_E_ALLOCATION_FAILURE = -23,
 	LIBPE_E_OPEN_FAILED,
 	LIBPE_E_FDOPEN_FAILED,
@@ -34,12 +34,81 @@ typedef enum {
 	LIBPE_IMPHASH_FLAVOR_PEFILE = 2,
 } pe_imphash_flavor_e;
 
+// Hashes derived from the import and export tables, as a bitmask.
+typedef enum {
+	LIBPE_SYMHASH_IMPHASH_MANDIANT = (1 << 0),
+	LIBPE_SYMHASH_IMPHASH_PEFILE   = (1 << 1),
+	LIBPE_SYMHASH_EXPHASH          = (1 << 2), // MD5 of the lowercased export names, comma separated
+	LIBPE_SYMHASH_ALL = LIBPE_SYMHASH_IMPHASH_MANDIANT | LIBPE_SYMHASH_IMPHASH_PEFILE | LIBPE_SYMHASH_EXPHASH
+} pe_symbol_hash_e;
+
+// Filled by pe_get_symbol_hashes. A hash is an empty string when it was not
+// requested or the table has nothing to hash.
+typedef struct {
+	char imphash_mandiant[16 * 2 + 1];
+	char imphash_pefile[16 * 2 + 1];
+	char exphash[16 * 2 + 1];
+} pe_symbol_hashes_t;
+
+// Digests computed by pe_hash_multi_t, as a bitmask.
+typedef enum {
+	LIBPE_HASH_MD5    = (1 << 0),
+	LIBPE_HASH_SHA1   = (1 << 1),
+	LIBPE_HASH_SHA256 = (1 << 2),
+	LIBPE_HASH_SSDEEP = (1 << 3),
+	// Non-cryptographic, for fast deduplication. Not part of LIBPE_HASH_ALL.
+	LIBPE_HASH_XXH64  = (1 << 4),
+	LIBPE_HASH_XXH3   = (1 << 5), // XXH3 64-bit
+	LIBPE_HASH_XXH128 = (1 << 6), // XXH3 128-bit
+	LIBPE_HASH_CRC32C = (1 << 7), // Castagnoli CRC-32, as used by iSCSI and ext4
+	LIBPE_HASH_PE_CHECKSUM = (1 << 8), // Optional header CheckSum, see pe_compute_checksum
+	LIBPE_HASH_ALL    = LIBPE_HASH_MD5 | LIBPE_HASH_SHA1 | LIBPE_HASH_SHA256 | LIBPE_HASH_SSDEEP,
+	LIBPE_HASH_FAST   = LIBPE_HASH_XXH64 | LIBPE_HASH_XXH3 | LIBPE_HASH_XXH128 | LIBPE_HASH_CRC32C
+} pe_hash_alg_e;
+
+// Upper bound for the `jobs` argument of pe_get_sections_hash_parallel
+// and the pe_ssdeep_compare_* functions.
+#define LIBPE_HASH_MAX_JOBS 64
+
+// Printable digests of a pe_hash_multi_t. Those not requested are empty strings.
+typedef struct {
+	char md5[16 * 2 + 1];
+	char sha1[20 * 2 + 1];
+	char sha256[32 * 2 + 1];
+	char ssdeep[2 * 64 + 20]; // FUZZY_MAX_RESULT
+	char xxh64[8 * 2 + 1];
+	char xxh3[8 * 2 + 1];
+	char xxh128[16 * 2 + 1];
+	char crc32c[4 * 2 + 1];
+	uint32_t pe_checksum; // A number, unlike the digests above
+} pe_hash_digests_t;
+
+struct fuzzy_state;
+
+// Feeds the same data to several digests in a single pass.
+typedef struct {
+	unsigned int algorithms; // pe_hash_alg_e bitmask
+	void *md_ctx[3];         // EVP_MD_CTX for MD5, SHA1 and SHA256
+	struct fuzzy_state *ssdeep;
+	void *xxh64;             // XXH64_state_t
+	void *xxh3;              // XXH3_state_t, shared by XXH3 64-bit and 128-bit
+	uint32_t crc32c;
+	uint64_t checksum_sum;   // LIBPE_HASH_PE_CHECKSUM: little-endian dwords fed so far, added up
+	uint64_t checksum_size;  // Bytes fed so far
+	uint64_t checksum_field; // Offset of the CheckSum field in the data, which counts as zero; UINT64_MAX if none
+} pe_hash_multi_t;
+
+// Digests not requested with the `_ext` functions are NULL.
 typedef struct {
 	char *name;
 	char *md5;
 	char *ssdeep;
 	char *sha1;
 	char *sha256;
+	char *xxh64;
+	char *xxh3;
+	char *xxh128;
+	char *crc32c;
 } pe_hash_t;
 
 typedef struct {
@@ -55,9 +124,54 @@ typedef struct {
 	pe_hash_t **sections;
 } pe_hash_sections_t;
 
+typedef enum {
+	LIBPE_PAGE_HASH_FNV1A64 = 1, // Fast, non-cryptographic, 8 bytes
+	LIBPE_PAGE_HASH_SHA256  = 2  // 32 bytes
+} pe_page_hash_alg_e;
+
+#define LIBPE_PAGE_SIZE_DEFAULT 4096
+
+// Digest of every `page_size` bytes of the file, the last page being possibly
+// shorter. Returned by pe_get_page_hashes and released with pe_page_hashes_dealloc.
+typedef struct {
+	pe_err_e err;
+	pe_page_hash_alg_e algorithm;
+	uint32_t page_size;
+	uint64_t count;
+	size_t digest_size;
+	uint8_t *digests; // `count` digests of `digest_size` bytes, in file order
+} pe_page_hashes_t;
+
+struct fuzzy_prepared;
+
+// ssdeep signatures parsed once to be compared many times. Starts zeroed,
+// grows with pe_ssdeep_set_add and is released with pe_ssdeep_set_dealloc.
+typedef struct {
+	size_t count;
+	size_t capacity;
+	struct fuzzy_prepared *signatures; // In the order they were added
+} pe_ssdeep_set_t;
+
+// Two entries of a pe_ssdeep_set_t, `first` < `second`, and their score.
+typedef struct {
+	size_t first;
+	size_t second;
+	int score;
+} pe_ssdeep_match_t;
+
+// Returned by pe_ssdeep_compare_pairs and released with pe_ssdeep_matches_dealloc.
+typedef struct {
+	pe_err_e err;
+	size_t count;
+	pe_ssdeep_match_t *matches; // Sorted by `first`, then `second`
+} pe_ssdeep_matches_t;
+
 void pe_hash_headers_dealloc(pe_hash_headers_t *obj);
 void pe_hash_sections_dealloc(pe_hash_sections_t *obj);
 void pe_hash_dealloc(pe_hash_t *obj);
+void pe_page_hashes_dealloc(pe_page_hashes_t *obj);
+void pe_ssdeep_set_dealloc(pe_ssdeep_set_t *set);
+void pe_ssdeep_matches_dealloc(pe_ssdeep_matches_t *obj);
 
 #ifdef __cplusplus
 } // extern "C"
@@ -63,22 +63,78 @@ static const uint64_t IMAGE_ORDINAL_FLAG64 = 0x8000000000000000;
 
 typedef enum {
 	LIBPE_OPT_NOCLOSE_FD = (1 << 0), // Keeps `stream` open for further usage.
-	LIBPE_OPT_OPEN_RW    = (1 << 1)  // Open file for read and writing
+	LIBPE_OPT_OPEN_RW    = (1 << 1), // Open file for read and writing
+	LIBPE_OPT_BUFFER_OWNED = (1 << 2), // pe_load_buffer: libpe takes ownership of a pe_malloc()ed buffer, even if loading fails, and pe_free()s it
+	LIBPE_OPT_HEADERS_ONLY = (1 << 3), // Read only the headers and section table; the rest is mapped on first use
+	LIBPE_OPT_WINDOWED     = (1 << 4), // Like LIBPE_OPT_HEADERS_ONLY, but never map past the section data; see pe_window_map
+	// I/O backend of the chunk iterator. The default walks the memory mapping.
+	LIBPE_OPT_IO_PREAD     = (1 << 5), // Sequential pread() with readahead
+	LIBPE_OPT_IO_DIRECT    = (1 << 6)  // pread() with O_DIRECT, bypassing the page cache where supported.
+	                                   // The file is opened again for it; pe_load_fd goes through /proc/self/fd.
+	                                   // Where that fails it is LIBPE_OPT_IO_PREAD.
 } pe_option_e;
 
 typedef uint16_t pe_options_e; // bitmasked pe_option_e values
 
+// A region of the file returned by pe_window_map.
+typedef struct {
+	void *addr;    // Mapping created for the window, or NULL if it lies within the context's mapping
+	size_t length;
+} pe_window_t;
+
+#define PE_CHUNK_SIZE_DEFAULT (1024 * 1024)
+
+// State of a pe_chunks_* walk over a range of the file.
+typedef struct {
+	pe_ctx_t *ctx;
+	uint64_t offset;     // Start of the next chunk
+	uint64_t end;
+	size_t chunk_size;
+	int fd;              // pread backends; -1 walks the mapping through `window`
+	size_t align;        // O_DIRECT block alignment, 1 otherwise
+	void *buffer;        // pread backends: holds the current chunk
+	void *buffer_base;   // Allocation `buffer` was aligned within
+	pe_window_t window;  // Mapping backend: the current chunk
+	pe_err_e err;
+} pe_chunk_iter_t;
+
+// Library functions
+void pe_library_init(void); // Optional, called by every pe_load_* function
+void pe_library_shutdown(void); // Once every context is unloaded; the next pe_load_* sets libpe up again
+
 // General functions
 bool pe_can_read(const pe_ctx_t *ctx, const void *ptr, size_t size);
 pe_err_e pe_load_file(pe_ctx_t *ctx, const char *path);
 pe_err_e pe_load_file_ext(pe_ctx_t *ctx, const char *path, pe_options_e options);
+pe_err_e pe_load_fileat(pe_ctx_t *ctx, int dirfd, const char *path, pe_options_e options);
+pe_err_e pe_load_fd(pe_ctx_t *ctx, int fd, pe_options_e options);
+pe_err_e pe_load_buffer(pe_ctx_t *ctx, const void *buffer, size_t size, pe_options_e options);
 pe_err_e pe_unload(pe_ctx_t *ctx);
+// Map the whole file of a context loaded with LIBPE_OPT_HEADERS_ONLY, or up to the end
+// of the section data with LIBPE_OPT_WINDOWED. Every function reading past the headers
+// calls it, so it rarely needs to be called directly.
+pe_err_e pe_map_file(pe_ctx_t *ctx);
+// Checked access to `size` bytes at file offset `offset`. Returns NULL if they are not
+// in the file. The pointer stays valid until pe_window_unmap(window), which must be
+// called once the region is no longer needed.
+const void *pe_window_map(pe_ctx_t *ctx, pe_window_t *window, uint64_t offset, uint64_t size);
+void pe_window_unmap(pe_window_t *window);
+// Streaming access for whole-file passes: pe_chunks_begin, then pe_chunks_next
+// until it returns NULL, then pe_chunks_end. `err` tells a read error from the end
+// of the range. A `chunk_size` of 0 picks PE_CHUNK_SIZE_DEFAULT.
+pe_err_e pe_chunks_begin(pe_ctx_t *ctx, pe_chunk_iter_t *iter, uint64_t offset, uint64_t size, size_t chunk_size);
+const void *pe_chunks_next(pe_chunk_iter_t *iter, size_t *size);
+void pe_chunks_end(pe_chunk_iter_t *iter);
+// Make the cached data of `ctx` live in `arena`, which pe_unload resets rather
+// than destroys. Call it right after loading. An arena serves one context at a time.
+void pe_use_arena(pe_ctx_t *ctx, pe_arena_t *arena);
 pe_err_e pe_parse(pe_ctx_t *ctx);
 bool pe_is_loaded(const pe_ctx_t *ctx);
 bool pe_is_pe(const pe_ctx_t *ctx);
 bool pe_is_dll(const pe_ctx_t *ctx);
 uint64_t pe_filesize(const pe_ctx_t *ctx);
 IMAGE_SECTION_HEADER *pe_rva2section(pe_ctx_t *ctx, uint64_t rva);
+IMAGE_SECTION_HEADER *pe_ofs2section(const pe_ctx_t *ctx, uint64_t ofs);
 uint64_t pe_rva2ofs(const pe_ctx_t *ctx, uint64_t rva);
 uint64_t pe_ofs2rva(const pe_ctx_t *ctx, uint64_t ofs);
 
@@ -104,10 +160,34 @@ const char *pe_section_characteristic_name(SectionCharacteristics characteristic
 // Hash functions
 size_t pe_hash_recommended_size(void);
 bool pe_hash_raw_data(char *output, size_t output_size, const char *alg_name, const unsigned char *data, size_t data_size);
+pe_err_e pe_hash_multi_init(pe_hash_multi_t *multi, unsigned int algorithms);
+pe_err_e pe_hash_multi_update(pe_hash_multi_t *multi, const void *data, size_t data_size);
+pe_err_e pe_hash_multi_final(pe_hash_multi_t *multi, pe_hash_digests_t *digests); // Also releases `multi`
+void pe_hash_multi_cleanup(pe_hash_multi_t *multi); // Releases `multi` without pe_hash_multi_final
+void pe_hash_thread_cleanup(void); // Frees the digest contexts the calling thread keeps for reuse; exiting threads free theirs
+void pe_hash_library_cleanup(void); // pe_hash_thread_cleanup, then frees the digest handles; called by pe_library_shutdown
+// Single pass over `size` bytes at file offset `offset`, read through the context's I/O backend.
+pe_err_e pe_hash_file_range(pe_ctx_t *ctx, unsigned int algorithms, uint64_t offset, uint64_t size, pe_hash_digests_t *digests);
+// Optional header CheckSum of the file as the loader computes it, the CheckSum field counting as zero.
+pe_err_e pe_compute_checksum(pe_ctx_t *ctx, uint32_t *checksum);
+pe_page_hashes_t *pe_get_page_hashes(pe_ctx_t *ctx, pe_page_hash_alg_e algorithm, uint32_t page_size); // page_size 0: LIBPE_PAGE_SIZE_DEFAULT
+pe_err_e pe_authenticode_digest(pe_ctx_t *ctx, unsigned int algorithms, pe_hash_digests_t *digests); // MD5, SHA1 and/or SHA256
 pe_hash_headers_t *pe_get_headers_hashes(pe_ctx_t *ctx);
 pe_hash_sections_t *pe_get_sections_hash(pe_ctx_t *ctx);
-pe_hash_t *pe_get_file_hash(pe_ctx_t *ctx);
+pe_hash_sections_t *pe_get_sections_hash_ext(pe_ctx_t *ctx, unsigned int algorithms);
+pe_hash_sections_t *pe_get_sections_hash_parallel(pe_ctx_t *ctx, unsigned int algorithms, unsigned int jobs); // jobs == 0: one per online CPU
+pe_hash_t *pe_get_file_hash(pe_ctx_t *ctx); // NULL if the file can't be read
+pe_hash_t *pe_get_file_hash_ext(pe_ctx_t *ctx, unsigned int algorithms);
 char *pe_imphash(pe_ctx_t *ctx, pe_imphash_flavor_e flavor);
+pe_err_e pe_get_symbol_hashes(pe_ctx_t *ctx, unsigned int which, pe_symbol_hashes_t *hashes); // Walks each table once for all of `which`
+
+// ssdeep functions. Scores are those of fuzzy_compare, from 0 to 100, and
+// `jobs` == 0 means one thread per online CPU.
+pe_err_e pe_ssdeep_set_add(pe_ssdeep_set_t *set, const char *signature); // LIBPE_E_INVALID_SSDEEP if malformed
+// Scores `signature` against every entry of `set`, into scores[0..set->count).
+pe_err_e pe_ssdeep_compare_set(const pe_ssdeep_set_t *set, const char *signature, int *scores, unsigned int jobs);
+// Every pair of entries of `set` scoring at least `min_score`, which should be at least 1.
+pe_ssdeep_matches_t *pe_ssdeep_compare_pairs(const pe_ssdeep_set_t *set, int min_score, unsigned int jobs);
 
 // Imports functions
 pe_imports_t *pe_imports(pe_ctx_t *ctx);
@@ -119,6 +199,8 @@ pe_exports_t *pe_exports(pe_ctx_t *ctx);
 pe_resources_t *pe_resources(pe_ctx_t *ctx);
 
 // Misc functions
+void pe_byte_histogram(uint64_t counts[256], const void *data, size_t size); // Adds the bytes of data to counts
+double pe_calculate_entropy_histogram(const uint64_t counts[256]);
 double pe_calculate_entropy_file(pe_ctx_t *ctx);
 bool pe_fpu_trick(pe_ctx_t *ctx);
 int pe_get_cpl_analysis(pe_ctx_t *ctx);
@@ -30,6 +30,10 @@
 #include <string.h>
 #include "fuzzy.h"
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #if defined(__GNUC__) && __GNUC__ >= 3
 #define likely(x)       __builtin_expect(!!(x), 1)
 #define unlikely(x)     __builtin_expect(!!(x), 0)
@@ -51,11 +55,12 @@
 #define HASH_PRIME 0x01000193
 #define HASH_INIT 0x28021967
 #define NUM_BLOCKHASHES 31
+#define NUM_SUM_LANES 32 /* NUM_BLOCKHASHES rounded up to whole vectors */
 
 struct roll_state {
   unsigned char window[ROLLING_WINDOW];
   uint32_t h1, h2, h3;
-  uint32_t n;
+  uint32_t n; /* Position of the oldest byte in window */
 };
 
 static void roll_init(/*@out@*/ struct roll_state *self) {
@@ -78,10 +83,11 @@ static void roll_hash(struct roll_state *self, unsigned char c)
   self->h2 += ROLLING_WINDOW * (uint32_t)c;
 
   self->h1 += (uint32_t)c;
-  self->h1 -= (uint32_t)self->window[self->n % ROLLING_WINDOW];
+  self->h1 -= (uint32_t)self->window[self->n];
 
-  self->window[self->n % ROLLING_WINDOW] = c;
-  self->n++;
+  self->window[self->n] = c;
+  if (++self->n == ROLLING_WINDOW)
+    self->n = 0;
 
   /* The original spamsum AND'ed this value with 0xFFFFFFFF which
    * in theory should have no effect. This AND has been removed
@@ -95,27 +101,27 @@ static uint32_t roll_sum(const struct roll_state *self)
   return self->h1 + self->h2 + self->h3;
 }
 
-/* A simple non-rolling hash, based on the FNV hash. */
-static uint32_t sum_hash(unsigned char c, uint32_t h)
-{
-  return (h * HASH_PRIME) ^ c;
-}
-
 /* A blockhash contains a signature state for a specific (implicit) blocksize.
- * The blocksize is given by SSDEEP_BS(index). The h and halfh members are the
- * FNV hashes, where halfh stops to be reset after digest is SPAMSUM_LENGTH/2
- * long. The halfh hash is needed be able to truncate digest for the second
- * output hash to stay compatible with ssdeep output. */
+ * The blocksize is given by SSDEEP_BS(index). */
 struct blockhash_context
 {
-  uint32_t h, halfh;
   char digest[SPAMSUM_LENGTH];
   unsigned int dlen;
 };
 
+/* The normal hashes are a simple non-rolling hash, based on the FNV hash.
+ * Only h % 64 is ever used, and that only depends on the previous h % 64 and
+ * on the character, so they are kept reduced to one byte each.
+ *
+ * The FNV hashes of blockhash i are h[i] and halfh[i], where halfh stops to be
+ * reset after digest is SPAMSUM_LENGTH/2 long. The halfh hash is needed be
+ * able to truncate digest for the second output hash to stay compatible with
+ * ssdeep output. They live apart from bh so fuzzy_update can update all of
+ * them at once; the values outside [bhstart, bhend) are never used. */
 struct fuzzy_state
 {
   unsigned int bhstart, bhend;
+  unsigned char h[NUM_SUM_LANES], halfh[NUM_SUM_LANES];
   struct blockhash_context bh[NUM_BLOCKHASHES];
   size_t total_size;
   struct roll_state roll;
@@ -131,8 +137,8 @@ struct fuzzy_state
     return NULL;
   self->bhstart = 0;
   self->bhend = 1;
-  self->bh[0].h = HASH_INIT;
-  self->bh[0].halfh = HASH_INIT;
+  memset(self->h, HASH_INIT % 64, sizeof(self->h));
+  memset(self->halfh, HASH_INIT % 64, sizeof(self->halfh));
   self->bh[0].dlen = 0;
   self->total_size = 0;
   roll_init(&self->roll);
@@ -141,15 +147,12 @@ struct fuzzy_state
 
 static void fuzzy_try_fork_blockhash(struct fuzzy_state *self)
 {
-  struct blockhash_context *obh, *nbh;
   if (self->bhend >= NUM_BLOCKHASHES)
     return;
   assert(self->bhend > 0);
-  obh = self->bh + (self->bhend - 1);
-  nbh = obh + 1;
-  nbh->h = obh->h;
-  nbh->halfh = obh->halfh;
-  nbh->dlen = 0;
+  self->h[self->bhend] = self->h[self->bhend - 1];
+  self->halfh[self->bhend] = self->halfh[self->bhend - 1];
+  self->bh[self->bhend].dlen = 0;
   ++self->bhend;
 }
 
@@ -175,22 +178,11 @@ static void fuzzy_try_reduce_blockhash(struct fuzzy_state *self)
 static const char *b64 =
   "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
 
-static void fuzzy_engine_step(struct fuzzy_state *self, unsigned char c)
+/* Emits a piece of the signature for each blockhash whose reset point the
+ * rolling hash value h hits. */
+static void fuzzy_engine_reset(struct fuzzy_state *self, uint32_t h)
 {
-  size_t h;
   unsigned int i;
-  /* At each character we update the rolling hash and the normal hashes.
-   * When the rolling hash hits a reset value then we emit a normal hash
-   * as a element of the signature and reset the normal hash. */
-  roll_hash(&self->roll, c);
-  h = roll_sum(&self->roll);
-
-  for (i = self->bhstart; i < self->bhend; ++i)
-  {
-    self->bh[i].h = sum_hash(c, self->bh[i].h);
-    self->bh[i].halfh = sum_hash(c, self->bh[i].halfh);
-  }
-
   for (i = self->bhstart; i < self->bhend; ++i)
   {
     /* With growing blocksize almost no runs fail the next test. */
@@ -215,21 +207,151 @@ static void fuzzy_engine_step(struct fuzzy_state *self, unsigned char c)
        * last few pieces of the message into a single piece
        * */
       self->bh[i].digest[self->bh[i].dlen++] =
-	b64[self->bh[i].h % 64];
-      self->bh[i].h = HASH_INIT;
+	b64[self->h[i]];
+      self->h[i] = HASH_INIT % 64;
       if (self->bh[i].dlen < SPAMSUM_LENGTH / 2)
-	self->bh[i].halfh = HASH_INIT;
+	self->halfh[i] = HASH_INIT % 64;
     } else
       fuzzy_try_reduce_blockhash(self);
   }
 }
 
+/* The FNV hashes of all blockhashes, held in registers while fuzzy_update
+ * runs. With SSE2 every lane is stepped with a few vector instructions, using
+ * h * HASH_PRIME === h * 19 === h + 2 * h + 16 * h (mod 64). */
+#if defined(__SSE2__)
+struct sum_lanes {
+  __m128i h[NUM_SUM_LANES / 16], halfh[NUM_SUM_LANES / 16];
+};
+
+static void sum_lanes_load(struct sum_lanes *lanes,
+			   const struct fuzzy_state *self)
+{
+  unsigned int i;
+  for (i = 0; i < NUM_SUM_LANES / 16; ++i)
+  {
+    lanes->h[i] = _mm_loadu_si128((const __m128i *)(self->h + 16 * i));
+    lanes->halfh[i] = _mm_loadu_si128((const __m128i *)(self->halfh + 16 * i));
+  }
+}
+
+static void sum_lanes_store(const struct sum_lanes *lanes,
+			    struct fuzzy_state *self)
+{
+  unsigned int i;
+  for (i = 0; i < NUM_SUM_LANES / 16; ++i)
+  {
+    _mm_storeu_si128((__m128i *)(self->h + 16 * i), lanes->h[i]);
+    _mm_storeu_si128((__m128i *)(self->halfh + 16 * i), lanes->halfh[i]);
+  }
+}
+
+static __m128i sum_hash_x16(__m128i c, __m128i h)
+{
+  const __m128i h2 = _mm_add_epi8(h, h);
+  __m128i h16 = _mm_add_epi8(h2, h2);
+  h16 = _mm_add_epi8(h16, h16);
+  h16 = _mm_add_epi8(h16, h16);
+  h = _mm_add_epi8(_mm_add_epi8(h, h2), h16);
+  return _mm_and_si128(_mm_xor_si128(h, c), _mm_set1_epi8(63));
+}
+
+static void sum_lanes_step(struct sum_lanes *lanes, unsigned char c)
+{
+  const __m128i cv = _mm_set1_epi8((char)c);
+  unsigned int i;
+  for (i = 0; i < NUM_SUM_LANES / 16; ++i)
+  {
+    lanes->h[i] = sum_hash_x16(cv, lanes->h[i]);
+    lanes->halfh[i] = sum_hash_x16(cv, lanes->halfh[i]);
+  }
+}
+#else
+struct sum_lanes {
+  unsigned char h[NUM_SUM_LANES], halfh[NUM_SUM_LANES];
+};
+
+static unsigned char sum_hash(unsigned char c, unsigned char h)
+{
+  return (unsigned char)((((uint32_t)h * HASH_PRIME) ^ c) % 64);
+}
+
+static void sum_lanes_load(struct sum_lanes *lanes,
+			   const struct fuzzy_state *self)
+{
+  memcpy(lanes->h, self->h, sizeof(lanes->h));
+  memcpy(lanes->halfh, self->halfh, sizeof(lanes->halfh));
+}
+
+static void sum_lanes_store(const struct sum_lanes *lanes,
+			    struct fuzzy_state *self)
+{
+  memcpy(self->h, lanes->h, sizeof(self->h));
+  memcpy(self->halfh, lanes->halfh, sizeof(self->halfh));
+}
+
+static void sum_lanes_step(struct sum_lanes *lanes, unsigned char c)
+{
+  unsigned int i;
+  for (i = 0; i < NUM_SUM_LANES; ++i)
+  {
+    lanes->h[i] = sum_hash(c, lanes->h[i]);
+    lanes->halfh[i] = sum_hash(c, lanes->halfh[i]);
+  }
+}
+#endif
+
+/* At each character we update the rolling hash and the normal hashes.
+ * When the rolling hash hits a reset value then we emit a normal hash
+ * as a element of the signature and reset the normal hash.
+ *
+ * The whole buffer goes through one loop with the rolling hash in locals.
+ * h is a reset point of blocksize 3 * 2^i when h + 1 is a multiple of both
+ * 3 and 2^i, which is much cheaper to test than h % SSDEEP_BS(i). Almost no
+ * byte is a reset point of the smallest active blocksize, and those that
+ * are not cannot be one of a larger blocksize either. */
 int fuzzy_update(struct fuzzy_state *self,
 		 const unsigned char *buffer,
 		 size_t buffer_size) {
+  struct roll_state *roll = &self->roll;
+  uint32_t h1 = roll->h1, h2 = roll->h2, h3 = roll->h3;
+  uint32_t n = roll->n;
+  uint64_t mask = (UINT64_C(1) << self->bhstart) - 1;
+  struct sum_lanes lanes;
+
+  sum_lanes_load(&lanes, self);
   self->total_size += buffer_size;
   for ( ;buffer_size > 0; ++buffer, --buffer_size)
-    fuzzy_engine_step(self, *buffer);
+  {
+    const unsigned char c = *buffer;
+    uint64_t h_next;
+
+    h2 -= h1;
+    h2 += ROLLING_WINDOW * (uint32_t)c;
+    h1 += (uint32_t)c;
+    h1 -= (uint32_t)roll->window[n];
+    roll->window[n] = c;
+    if (++n == ROLLING_WINDOW)
+      n = 0;
+    h3 <<= 5;
+    h3 ^= c;
+
+    sum_lanes_step(&lanes, c);
+
+    h_next = (uint64_t)(h1 + h2 + h3) + 1;
+    if (likely((h_next & mask) != 0 || h_next % 3 != 0))
+      continue;
+    sum_lanes_store(&lanes, self);
+    fuzzy_engine_reset(self, (uint32_t)(h_next - 1));
+    sum_lanes_load(&lanes, self);
+    mask = (UINT64_C(1) << self->bhstart) - 1;
+  }
+
+  sum_lanes_store(&lanes, self);
+  roll->h1 = h1;
+  roll->h2 = h2;
+  roll->h3 = h3;
+  roll->n = n;
   return 0;
 }
 
@@ -308,7 +430,7 @@ int fuzzy_digest(const struct fuzzy_state *self,
   if (h != 0)
   {
     assert(remain > 0);
-    *result = b64[self->bh[bi].h % 64];
+    *result = b64[self->h[bi]];
     if((flags & FUZZY_FLAG_ELIMSEQ) == 0 || i < 3 ||
        *result != result[-1] ||
        *result != result[-2] ||
@@ -337,8 +459,8 @@ int fuzzy_digest(const struct fuzzy_state *self,
     remain -= i;
     if (h != 0) {
       assert(remain > 0);
-      h = (flags & FUZZY_FLAG_NOTRUNC) != 0 ? self->bh[bi].h :
-	self->bh[bi].halfh;
+      h = (flags & FUZZY_FLAG_NOTRUNC) != 0 ? self->h[bi] :
+	self->halfh[bi];
       *result = b64[h % 64];
       if ((flags & FUZZY_FLAG_ELIMSEQ) == 0 || i < 3 ||
 	  *result != result[-1] ||
@@ -353,7 +475,7 @@ int fuzzy_digest(const struct fuzzy_state *self,
     {
       assert(self->bh[bi].dlen == 0);
       assert(remain > 0);
-      *result++ = b64[self->bh[bi].h % 64];
+      *result++ = b64[self->h[bi]];
       /* No need to bother with FUZZY_FLAG_ELIMSEQ, because this
        * digest has length 1. */
       --remain;
@@ -453,29 +575,31 @@ int fuzzy_hash_filename(const char *filename, /*@out@*/ char *result)
 //
 // return 1 if the two strings do have a common substring, 0 otherwise
 //
-static int has_common_substring(const char *s1, const char *s2)
+static int has_common_substring(const struct fuzzy_prepared_part *s1,
+				const struct fuzzy_prepared_part *s2)
 {
-  int i, j;
-  int num_hashes;
+  unsigned int i, j;
   uint32_t hashes[SPAMSUM_LENGTH];
 
   // there are many possible algorithms for common substring
   // detection. In this case I am re-using the rolling hash code
   // to act as a filter for possible substring matches
 
-  memset(hashes, 0, sizeof(hashes));
+  // a common substring has the same rolling hash in both strings,
+  // so it sets the same bit in both ngrams
+  if ((s1->ngrams & s2->ngrams) == 0)
+    return 0;
 
   // first compute the windowed rolling hash at each offset in
   // the first string
   struct roll_state state;
   roll_init (&state);
 
-  for (i=0;s1[i];i++)
+  for (i=0;i<s1->len;i++)
   {
-    roll_hash(&state, (unsigned char)s1[i]);
+    roll_hash(&state, (unsigned char)s1->digest[i]);
     hashes[i] = roll_sum(&state);
   }
-  num_hashes = i;
 
   roll_init(&state);
 
@@ -484,20 +608,19 @@ static int has_common_substring(const char *s1, const char *s2)
   // for the first string. If one matches then we have a
   // candidate substring match. We then confirm that match with
   // a direct string comparison */
-  for (i=0;s2[i];i++)
+  for (i=0;i<s2->len;i++)
   {
-    roll_hash(&state, (unsigned char)s2[i]);
+    roll_hash(&state, (unsigned char)s2->digest[i]);
     uint32_t h = roll_sum(&state);
     if (i < ROLLING_WINDOW-1) continue;
-    for (j=ROLLING_WINDOW-1;j<num_hashes;j++)
+    for (j=ROLLING_WINDOW-1;j<s1->len;j++)
     {
       if (hashes[j] != 0 && hashes[j] == h)
       {
 	// we have a potential match - confirm it
-	if (strlen(s2+i-(ROLLING_WINDOW-1)) >= ROLLING_WINDOW &&
-	    strncmp(s2+i-(ROLLING_WINDOW-1),
-		    s1+j-(ROLLING_WINDOW-1),
-		    ROLLING_WINDOW) == 0)
+	if (memcmp(s2->digest+i-(ROLLING_WINDOW-1),
+		   s1->digest+j-(ROLLING_WINDOW-1),
+		   ROLLING_WINDOW) == 0)
 	{
 	  return 1;
 	}
@@ -508,36 +631,46 @@ static int has_common_substring(const char *s1, const char *s2)
   return 0;
 }
 
-
-// eliminate sequences of longer than 3 identical characters. These
-// sequences contain very little information so they tend to just bias
-// the result unfairly
-static char *eliminate_sequences(const char *str)
+// Stores the rolling hash of each ROLLING_WINDOW long substring of the
+// part, in order, and returns how many there are. Digests too long to be
+// compared have none. Also used by the index in fuzzy_index.c.
+unsigned int fuzzy_window_hashes(const struct fuzzy_prepared_part *part,
+				 /*@out@*/ uint32_t hashes[SPAMSUM_LENGTH])
 {
-  char *ret;
-  size_t i, j, len;
-
-  ret = strdup(str);
-  if (!ret)
-    return NULL;
+  struct roll_state state;
+  unsigned int i, count = 0;
 
-  len = strlen(str);
-  if (len < 3)
-    return ret;
+  if (part->len > SPAMSUM_LENGTH)
+    return 0;
 
-  for (i=j=3 ; i<len ; i++)
+  roll_init(&state);
+  for (i=0;i<part->len;i++)
   {
-    if (str[i] != str[i-1] ||
-	str[i] != str[i-2] ||
-	str[i] != str[i-3])
-    {
-      ret[j++] = str[i];
-    }
+    roll_hash(&state, (unsigned char)part->digest[i]);
+    if (i >= ROLLING_WINDOW-1)
+      hashes[count++] = roll_sum(&state);
   }
 
-  ret[j] = 0;
+  return count;
+}
+
+// The bits has_common_substring() checks first, one per rolling hash of
+// a ROLLING_WINDOW long substring. Substrings hashing to 0 are never
+// considered a match, so they are left out.
+static uint64_t ngram_bits(const struct fuzzy_prepared_part *part)
+{
+  uint32_t hashes[SPAMSUM_LENGTH];
+  unsigned int i, count;
+  uint64_t bits = 0;
 
-  return ret;
+  count = fuzzy_window_hashes(part, hashes);
+  for (i=0;i<count;i++)
+  {
+    if (hashes[i] != 0)
+      bits |= UINT64_C(1) << (hashes[i] % 64);
+  }
+
+  return bits;
 }
 
 //
@@ -546,16 +679,16 @@ static char *eliminate_sequences(const char *str)
 // 100 is a great match. The block_size is used to cope with very small
 // messages.
 //
-static uint32_t score_strings(const char *s1,
-			      const char *s2,
+static uint32_t score_strings(const struct fuzzy_prepared_part *s1,
+			      const struct fuzzy_prepared_part *s2,
 			      unsigned int block_size)
 {
   uint32_t score;
   size_t len1, len2;
-  int edit_distn(const char *from, int from_len, const char *to, int to_len);
+  int edit_distn_short(const char *from, int from_len, const char *to, int to_len);
 
-  len1 = strlen(s1);
-  len2 = strlen(s2);
+  len1 = s1->len;
+  len2 = s2->len;
 
   if (len1 > SPAMSUM_LENGTH || len2 > SPAMSUM_LENGTH) {
     // not a real spamsum signature?
@@ -570,7 +703,7 @@ static uint32_t score_strings(const char *s1,
 
   // compute the edit distance between the two strings. The edit distance gives
   // us a pretty good idea of how closely related the two strings are
-  score = edit_distn(s1, len1, s2, len2);
+  score = edit_distn_short(s1->digest, len1, s2->digest, len2);
 
   // scale the edit distance by the lengths of the two
   // strings. This changes the score to be a measure of the
@@ -605,92 +738,90 @@ static uint32_t score_strings(const char *s1,
   return score;
 }
 
-//
-// Given two spamsum strings return a value indicating the degree
-// to which they match.
-//
-int fuzzy_compare(const char *str1, const char *str2)
+int fuzzy_prepare(const char *sig, /*@out@*/ struct fuzzy_prepared *prepared)
 {
-  unsigned int block_size1, block_size2;
-  uint32_t score = 0;
-  char *s1, *s2;
-  char *s1_1, *s1_2, *s1_3;
-  char *s2_1, *s2_2, *s2_3;
+  unsigned int block_size, part = 0;
+  size_t i;
 
-  if (NULL == str1 || NULL == str2)
+  if (NULL == sig)
     return -1;
 
   // each spamsum is prefixed by its block size
-  if (sscanf(str1, "%u:", &block_size1) != 1 ||
-      sscanf(str2, "%u:", &block_size2) != 1) {
+  if (sscanf(sig, "%u:", &block_size) != 1)
     return -1;
-  }
 
-  // if the blocksizes don't match then we are comparing
-  // apples to oranges. This isn't an 'error' per se. We could
-  // have two valid signatures, but they can't be compared.
-  if (block_size1 != block_size2 &&
-      block_size1 != block_size2*2 &&
-      block_size2 != block_size1*2) {
-    return 0;
-  }
+  memset(prepared, 0, sizeof(*prepared));
+  prepared->block_size = block_size;
 
   // move past the prefix
-  str1 = strchr(str1, ':');
-  str2 = strchr(str2, ':');
-
-  if (!str1 || !str2) {
+  sig = strchr(sig, ':');
+  if (!sig) {
     // badly formed ...
-    return -1;
+    prepared->malformed = 1;
+    return 0;
   }
+  ++sig;
 
   // there is very little information content is sequences of
   // the same character like 'LLLLL'. Eliminate any sequences
   // longer than 3. This is especially important when combined
   // with the has_common_substring() test below.
-  // NOTE: This function duplciates str1 and str2
-  s1 = eliminate_sequences(str1+1);
-  if (!s1)
-    return 0;
-  s2 = eliminate_sequences(str2+1);
-  if (!s2)
+  //
+  // What is left is broken into the two pieces at the first colon.
+  // The second one ends at the comma just before the filename, if
+  // the signature has one.
+  for (i=0 ; sig[i] ; i++)
   {
-    free(s1);
+    struct fuzzy_prepared_part *p = &prepared->part[part];
+
+    if (i >= 3 &&
+	sig[i] == sig[i-1] &&
+	sig[i] == sig[i-2] &&
+	sig[i] == sig[i-3])
+      continue;
+    if (part == 0 && sig[i] == ':') {
+      part = 1;
+      continue;
+    }
+    if (part == 1 && sig[i] == ',')
+      break;
+
+    // Longer digests are not compared, so their length is enough.
+    if (p->len < SPAMSUM_LENGTH)
+      p->digest[p->len] = sig[i];
+    if (p->len <= SPAMSUM_LENGTH)
+      p->len++;
+  }
+
+  if (part == 0) {
+    // a signature is malformed - it doesn't have 2 parts
+    prepared->malformed = 1;
     return 0;
   }
 
-  // now break them into the two pieces
-  s1_1 = s1;
-  s2_1 = s2;
+  prepared->part[0].ngrams = ngram_bits(&prepared->part[0]);
+  prepared->part[1].ngrams = ngram_bits(&prepared->part[1]);
+  return 0;
+}
 
-  s1_2 = strchr(s1, ':');
-  s2_2 = strchr(s2, ':');
+int fuzzy_compare_prepared(const struct fuzzy_prepared *sig1,
+			   const struct fuzzy_prepared *sig2)
+{
+  const unsigned int block_size1 = sig1->block_size;
+  const unsigned int block_size2 = sig2->block_size;
+  uint32_t score = 0;
 
-  if (!s1_2 || !s2_2) {
-    // a signature is malformed - it doesn't have 2 parts
-    free(s1); free(s2);
-    return -1;
+  // if the blocksizes don't match then we are comparing
+  // apples to oranges. This isn't an 'error' per se. We could
+  // have two valid signatures, but they can't be compared.
+  if (block_size1 != block_size2 &&
+      block_size1 != block_size2*2 &&
+      block_size2 != block_size1*2) {
+    return 0;
   }
 
-  // Chop the first substring. We terminate the first substring
-  // and then advance the pointer to the start of the second substring.
-  *s1_2 = 0;
-  s1_2++;
-  *s2_2 = 0;
-  s2_2++;
-
-  // Chop the second string at the comma--just before the filename.
-  // If the strings don't have a comma (i.e. don't have a filename)
-  // that's ok. It's not an error. This function can be called on
-  // signatures which don't have filenames attached.
-  // We also don't have to advance past the comma however. We don't care
-  // about the filename
-  s1_3 = strchr(s1_2, ',');
-  s2_3 = strchr(s2_2, ',');
-  if (s1_3 != NULL)
-    *s1_3 = 0;
-  if (s2_3 != NULL)
-    *s2_3 = 0;
+  if (sig1->malformed || sig2->malformed)
+    return -1;
 
   // each signature has a string for two block sizes. We now
   // choose how to combine the two block sizes. We checked above
@@ -698,21 +829,33 @@ int fuzzy_compare(const char *str1, const char *str2)
   if (block_size1 == block_size2)
   {
     uint32_t score1, score2;
-    score1 = score_strings(s1_1, s2_1, block_size1);
-    score2 = score_strings(s1_2, s2_2, block_size1*2);
+    score1 = score_strings(&sig1->part[0], &sig2->part[0], block_size1);
+    score2 = score_strings(&sig1->part[1], &sig2->part[1], block_size1*2);
     score = MAX(score1, score2);
   }
   else if (block_size1 == block_size2*2)
   {
-    score = score_strings(s1_1, s2_2, block_size1);
+    score = score_strings(&sig1->part[0], &sig2->part[1], block_size1);
   }
   else
   {
-    score = score_strings(s1_2, s2_1, block_size2);
+    score = score_strings(&sig1->part[1], &sig2->part[0], block_size2);
   }
 
-  free(s1);
-  free(s2);
-
   return (int)score;
 }
+
+//
+// Given two spamsum strings return a value indicating the degree
+// to which they match.
+//
+int fuzzy_compare(const char *str1, const char *str2)
+{
+  struct fuzzy_prepared sig1, sig2;
+
+  if (fuzzy_prepare(str1, &sig1) != 0 ||
+      fuzzy_prepare(str2, &sig2) != 0)
+    return -1;
+
+  return fuzzy_compare_prepared(&sig1, &sig2);
+}
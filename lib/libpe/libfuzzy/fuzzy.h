@@ -195,6 +195,118 @@ extern int fuzzy_compare(const char *sig1, const char *sig2);
  * (without the filename) */
 #define FUZZY_MAX_RESULT (2 * SPAMSUM_LENGTH + 20)
 
+/** One of the two digests of a signature, ready for comparison. */
+struct fuzzy_prepared_part
+{
+  uint64_t ngrams;              /**< Bit (h % 64) set for the rolling hash h of each 7 character window */
+  unsigned int len;             /**< Length after eliminating sequences, may exceed SPAMSUM_LENGTH */
+  char digest[SPAMSUM_LENGTH];  /**< First SPAMSUM_LENGTH characters, not NUL terminated */
+};
+
+/** A signature parsed by fuzzy_prepare(). */
+struct fuzzy_prepared
+{
+  unsigned int block_size;
+  int malformed;                /**< Lacks the second digest; compares as -1 */
+  struct fuzzy_prepared_part part[2];
+};
+
+/// Parses a signature once, so it can be compared many times with
+/// fuzzy_compare_prepared() without parsing or allocating again.
+/// @return Returns zero on success, or -1 if sig is NULL or does not
+/// start with a block size.
+extern int fuzzy_prepare(const char *sig, /*@out@*/ struct fuzzy_prepared *prepared);
+
+/// Computes the match score between two prepared signatures. The
+/// result is the same as fuzzy_compare() on the original signatures.
+extern int fuzzy_compare_prepared(const struct fuzzy_prepared *sig1,
+				  const struct fuzzy_prepared *sig2);
+
+/** A signature found by fuzzy_index_search(). */
+struct fuzzy_index_match
+{
+  uint32_t id;                  /**< Signatures are numbered from 0 in the order they were added */
+  int score;                    /**< As fuzzy_compare() gives it */
+};
+
+/**
+ * @brief An inverted index of signatures, for searching many of them at once.
+ *
+ * Two signatures can only score above zero if their digests for a common
+ * block size share a substring of ROLLING_WINDOW (7) characters. The index
+ * maps each block size and rolling hash of such a substring to the
+ * signatures having it, so a search only compares the signatures sharing
+ * one with the signature searched. The result is the same as comparing
+ * with every signature.
+ */
+struct fuzzy_index;
+
+/**
+ * @brief Construct an empty index.
+ *
+ * It must be disposed with fuzzy_index_free.
+ * @return the constructed index or NULL on failure
+ */
+extern /*@only@*/ /*@null@*/ struct fuzzy_index *fuzzy_index_new(void);
+
+/**
+ * @brief Add a signature to the index.
+ *
+ * Signatures are added to a pending list, which is merged into the index by
+ * fuzzy_index_build(), so it is cheaper to add many at once before searching.
+ * @return zero on success, non-zero if the signature is malformed or on error
+ */
+extern int fuzzy_index_add(struct fuzzy_index *index, const char *sig);
+
+/**
+ * @brief Merge the signatures added since the last build into the index.
+ *
+ * fuzzy_index_search() and fuzzy_index_save() do it when needed. Once built,
+ * the index is only read, so it can be searched from several threads.
+ * @return zero on success, non-zero on error
+ */
+extern int fuzzy_index_build(struct fuzzy_index *index);
+
+/** @return the number of signatures added to the index */
+extern size_t fuzzy_index_count(const struct fuzzy_index *index);
+
+/**
+ * @brief Find the signatures of the index matching the given one.
+ *
+ * @param min_score The lowest score to report, at least 1
+ * @param matches Set to an array, ordered by decreasing score and then by
+ * id, that the caller must free(). NULL when nothing matches.
+ * @param count Set to the number of matches
+ * @return zero on success, non-zero if the signature is malformed or on error
+ */
+extern int fuzzy_index_search(struct fuzzy_index *index,
+			      const char *sig,
+			      int min_score,
+			      /*@out@*/ struct fuzzy_index_match **matches,
+			      /*@out@*/ size_t *count);
+
+/**
+ * @brief Write the index to an open handle.
+ *
+ * The file is only meant to be read back by fuzzy_index_load() on a
+ * machine of the same byte order.
+ * @return zero on success, non-zero on error
+ */
+extern int fuzzy_index_save(struct fuzzy_index *index, FILE *handle);
+
+/**
+ * @brief Read an index written by fuzzy_index_save() from an open handle.
+ *
+ * It must be disposed with fuzzy_index_free.
+ * @return the index or NULL if the file is not a valid index or on error
+ */
+extern /*@only@*/ /*@null@*/ struct fuzzy_index *fuzzy_index_load(FILE *handle);
+
+/**
+ * @brief Dispose an index.
+ */
+extern void fuzzy_index_free(/*@only@*/ struct fuzzy_index *index);
+
 #ifdef __cplusplus
 } 
 #endif
@@ -0,0 +1,567 @@
+/* ssdeep
+ * Copyright (C) 2010 - 2023 libpe authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "fuzzy.h"
+
+// The index maps keys to the ids of the signatures having them. A key is
+// the block size of a digest in the upper half and the rolling hash of one
+// of its ROLLING_WINDOW long substrings in the lower half. The first digest
+// of a signature has the block size of the signature, the second one twice
+// that, computed as fuzzy_compare_prepared() does so that the digests it
+// compares always have the same block size. Substrings hashing to 0 never
+// match, so they have no key.
+//
+// Built, the keys are sorted in `keys` and the ids of keys[k] are
+// postings[offsets[k]] to postings[offsets[k+1]-1], in increasing order.
+// Signatures added since are in `pending` until the next build.
+
+#define INDEX_MAGIC "ssdeepix"
+#define INDEX_VERSION 1
+#define INDEX_BYTE_ORDER 0x01020304u
+
+struct index_entry
+{
+  uint64_t key;
+  uint32_t id;
+};
+
+struct fuzzy_index
+{
+  struct fuzzy_prepared *signatures;
+  size_t num_signatures;
+  size_t signatures_capacity;
+
+  uint64_t *keys;
+  uint64_t *offsets;            // num_keys + 1 of them
+  uint32_t *postings;
+  size_t num_keys;
+  size_t num_postings;
+
+  struct index_entry *pending;
+  size_t num_pending;
+  size_t pending_capacity;
+};
+
+unsigned int fuzzy_window_hashes(const struct fuzzy_prepared_part *part,
+				 uint32_t hashes[SPAMSUM_LENGTH]);
+
+// Makes room for `needed` elements of `size` bytes, at least doubling the
+// capacity so that adding one at a time stays linear.
+static int grow(void **array, size_t *capacity, size_t needed, size_t size)
+{
+  size_t new_capacity;
+  void *new_array;
+
+  if (needed <= *capacity)
+    return 0;
+
+  new_capacity = *capacity ? *capacity : 64;
+  while (new_capacity < needed)
+  {
+    if (new_capacity > SIZE_MAX / 2)
+      return -1;
+    new_capacity *= 2;
+  }
+  if (new_capacity > SIZE_MAX / size)
+    return -1;
+
+  new_array = realloc(*array, new_capacity * size);
+  if (new_array == NULL)
+    return -1;
+
+  *array = new_array;
+  *capacity = new_capacity;
+  return 0;
+}
+
+// The keys of a signature, possibly repeated, and how many there are.
+static unsigned int signature_keys(const struct fuzzy_prepared *sig,
+				   uint64_t keys[2 * SPAMSUM_LENGTH])
+{
+  uint32_t hashes[SPAMSUM_LENGTH];
+  unsigned int part, i, count, num_keys = 0;
+
+  for (part=0;part<2;part++)
+  {
+    const unsigned int block_size = part ? sig->block_size*2 : sig->block_size;
+
+    count = fuzzy_window_hashes(&sig->part[part], hashes);
+    for (i=0;i<count;i++)
+    {
+      if (hashes[i] != 0)
+	keys[num_keys++] = ((uint64_t)block_size << 32) | hashes[i];
+    }
+  }
+
+  return num_keys;
+}
+
+struct fuzzy_index *fuzzy_index_new(void)
+{
+  return calloc(1, sizeof(struct fuzzy_index));
+}
+
+void fuzzy_index_free(/*@only@*/ struct fuzzy_index *index)
+{
+  if (index == NULL)
+    return;
+
+  free(index->signatures);
+  free(index->keys);
+  free(index->offsets);
+  free(index->postings);
+  free(index->pending);
+  free(index);
+}
+
+size_t fuzzy_index_count(const struct fuzzy_index *index)
+{
+  return index->num_signatures;
+}
+
+int fuzzy_index_add(struct fuzzy_index *index, const char *sig)
+{
+  uint64_t keys[2 * SPAMSUM_LENGTH];
+  struct fuzzy_prepared prepared;
+  unsigned int i, num_keys;
+  uint32_t id;
+
+  if (fuzzy_prepare(sig, &prepared) != 0 || prepared.malformed)
+    return -1;
+
+  // ids are 32 bits, to keep the postings small
+  if (index->num_signatures > UINT32_MAX)
+    return -1;
+  id = (uint32_t)index->num_signatures;
+
+  num_keys = signature_keys(&prepared, keys);
+  if (grow((void **)&index->signatures, &index->signatures_capacity,
+	   index->num_signatures + 1, sizeof(struct fuzzy_prepared)) != 0 ||
+      grow((void **)&index->pending, &index->pending_capacity,
+	   index->num_pending + num_keys, sizeof(struct index_entry)) != 0)
+    return -1;
+
+  index->signatures[index->num_signatures++] = prepared;
+  for (i=0;i<num_keys;i++)
+  {
+    index->pending[index->num_pending].key = keys[i];
+    index->pending[index->num_pending].id = id;
+    index->num_pending++;
+  }
+
+  return 0;
+}
+
+static int compare_entries(const void *a, const void *b)
+{
+  const struct index_entry *entry_a = a;
+  const struct index_entry *entry_b = b;
+
+  if (entry_a->key != entry_b->key)
+    return entry_a->key < entry_b->key ? -1 : 1;
+  if (entry_a->id != entry_b->id)
+    return entry_a->id < entry_b->id ? -1 : 1;
+  return 0;
+}
+
+int fuzzy_index_build(struct fuzzy_index *index)
+{
+  struct index_entry *pending = index->pending;
+  size_t num_pending = 0, num_new_keys = 0;
+  size_t i, k, p, num_keys, num_postings;
+  uint64_t *keys, *offsets;
+  uint32_t *postings;
+
+  if (index->num_pending == 0)
+    return 0;
+
+  // Sort the pending entries and drop the keys repeated by a signature.
+  qsort(pending, index->num_pending, sizeof(struct index_entry), compare_entries);
+  for (i=0;i<index->num_pending;i++)
+  {
+    if (num_pending > 0 &&
+	pending[num_pending-1].key == pending[i].key &&
+	pending[num_pending-1].id == pending[i].id)
+      continue;
+    if (num_pending == 0 || pending[num_pending-1].key != pending[i].key)
+      num_new_keys++;
+    pending[num_pending++] = pending[i];
+  }
+  index->num_pending = num_pending;
+
+  // At most, none of the pending keys is in the index yet.
+  num_keys = index->num_keys + num_new_keys;
+  num_postings = index->num_postings + num_pending;
+  if (num_keys > SIZE_MAX / sizeof(uint64_t) - 1 ||
+      num_postings > SIZE_MAX / sizeof(uint32_t))
+    return -1;
+
+  keys = malloc(num_keys * sizeof(uint64_t));
+  offsets = malloc((num_keys + 1) * sizeof(uint64_t));
+  postings = malloc(num_postings * sizeof(uint32_t));
+  if (keys == NULL || offsets == NULL || postings == NULL)
+  {
+    free(keys);
+    free(offsets);
+    free(postings);
+    return -1;
+  }
+
+  // Merge both sorted key lists. The pending ids are all greater than
+  // those already indexed, so they go after them.
+  num_keys = 0;
+  num_postings = 0;
+  k = 0;
+  p = 0;
+  while (k < index->num_keys || p < num_pending)
+  {
+    uint64_t key;
+
+    if (p == num_pending ||
+	(k < index->num_keys && index->keys[k] <= pending[p].key))
+      key = index->keys[k];
+    else
+      key = pending[p].key;
+
+    keys[num_keys] = key;
+    offsets[num_keys] = num_postings;
+    num_keys++;
+
+    if (k < index->num_keys && index->keys[k] == key)
+    {
+      const size_t count = index->offsets[k+1] - index->offsets[k];
+      memcpy(postings + num_postings, index->postings + index->offsets[k],
+	     count * sizeof(uint32_t));
+      num_postings += count;
+      k++;
+    }
+    for (;p < num_pending && pending[p].key == key;p++)
+      postings[num_postings++] = pending[p].id;
+  }
+  offsets[num_keys] = num_postings;
+
+  free(index->keys);
+  free(index->offsets);
+  free(index->postings);
+  index->keys = keys;
+  index->offsets = offsets;
+  index->postings = postings;
+  index->num_keys = num_keys;
+  index->num_postings = num_postings;
+
+  free(index->pending);
+  index->pending = NULL;
+  index->num_pending = 0;
+  index->pending_capacity = 0;
+  return 0;
+}
+
+// The position of key in the built index, or num_keys if it is not there.
+static size_t find_key(const struct fuzzy_index *index, uint64_t key)
+{
+  size_t low = 0, high = index->num_keys;
+
+  while (low < high)
+  {
+    const size_t middle = low + (high - low) / 2;
+    if (index->keys[middle] < key)
+      low = middle + 1;
+    else
+      high = middle;
+  }
+
+  return (low < index->num_keys && index->keys[low] == key) ? low : index->num_keys;
+}
+
+static int compare_ids(const void *a, const void *b)
+{
+  const uint32_t id_a = *(const uint32_t *)a;
+  const uint32_t id_b = *(const uint32_t *)b;
+
+  return id_a < id_b ? -1 : id_a > id_b;
+}
+
+static int compare_keys(const void *a, const void *b)
+{
+  const uint64_t key_a = *(const uint64_t *)a;
+  const uint64_t key_b = *(const uint64_t *)b;
+
+  return key_a < key_b ? -1 : key_a > key_b;
+}
+
+static int compare_matches(const void *a, const void *b)
+{
+  const struct fuzzy_index_match *match_a = a;
+  const struct fuzzy_index_match *match_b = b;
+
+  if (match_a->score != match_b->score)
+    return match_a->score > match_b->score ? -1 : 1;
+  return compare_ids(&match_a->id, &match_b->id);
+}
+
+int fuzzy_index_search(struct fuzzy_index *index,
+		       const char *sig,
+		       int min_score,
+		       /*@out@*/ struct fuzzy_index_match **matches,
+		       /*@out@*/ size_t *count)
+{
+  uint64_t keys[2 * SPAMSUM_LENGTH];
+  struct fuzzy_prepared prepared;
+  struct fuzzy_index_match *found = NULL;
+  uint32_t *candidates = NULL;
+  size_t num_candidates = 0, candidates_capacity = 0;
+  size_t num_found = 0, found_capacity = 0;
+  unsigned int i, num_keys;
+  size_t c;
+
+  *matches = NULL;
+  *count = 0;
+
+  if (fuzzy_prepare(sig, &prepared) != 0 || prepared.malformed)
+    return -1;
+  if (fuzzy_index_build(index) != 0)
+    return -1;
+  if (min_score < 1)
+    min_score = 1;
+
+  // The candidates are the signatures sharing a key with this one.
+  num_keys = signature_keys(&prepared, keys);
+  qsort(keys, num_keys, sizeof(uint64_t), compare_keys);
+  for (i=0;i<num_keys;i++)
+  {
+    size_t k, postings;
+
+    if (i > 0 && keys[i] == keys[i-1])
+      continue;
+    k = find_key(index, keys[i]);
+    if (k == index->num_keys)
+      continue;
+
+    postings = index->offsets[k+1] - index->offsets[k];
+    if (grow((void **)&candidates, &candidates_capacity,
+	     num_candidates + postings, sizeof(uint32_t)) != 0)
+    {
+      free(candidates);
+      return -1;
+    }
+    memcpy(candidates + num_candidates, index->postings + index->offsets[k],
+	   postings * sizeof(uint32_t));
+    num_candidates += postings;
+  }
+
+  // Score each of them once.
+  if (num_candidates > 1)
+    qsort(candidates, num_candidates, sizeof(uint32_t), compare_ids);
+  for (c=0;c<num_candidates;c++)
+  {
+    int score;
+
+    if (c > 0 && candidates[c] == candidates[c-1])
+      continue;
+
+    score = fuzzy_compare_prepared(&prepared, &index->signatures[candidates[c]]);
+    if (score < min_score)
+      continue;
+
+    if (grow((void **)&found, &found_capacity, num_found + 1,
+	     sizeof(struct fuzzy_index_match)) != 0)
+    {
+      free(found);
+      free(candidates);
+      return -1;
+    }
+    found[num_found].id = candidates[c];
+    found[num_found].score = score;
+    num_found++;
+  }
+  free(candidates);
+
+  if (num_found > 1)
+    qsort(found, num_found, sizeof(struct fuzzy_index_match), compare_matches);
+  *matches = found;
+  *count = num_found;
+  return 0;
+}
+
+//
+// The file starts with INDEX_MAGIC, then the version, INDEX_BYTE_ORDER, the
+// number of signatures, keys and postings. Then come the signatures, each
+// one its block size and the length, ngrams and digest of both parts, and
+// last the keys, offsets and postings as they are in memory.
+//
+
+static int write_all(FILE *handle, const void *data, size_t size, size_t count)
+{
+  if (count == 0)
+    return 0;
+  return fwrite(data, size, count, handle) == count ? 0 : -1;
+}
+
+static int read_all(FILE *handle, void *data, size_t size, size_t count)
+{
+  if (count == 0)
+    return 0;
+  return fread(data, size, count, handle) == count ? 0 : -1;
+}
+
+int fuzzy_index_save(struct fuzzy_index *index, FILE *handle)
+{
+  const uint32_t version = INDEX_VERSION, byte_order = INDEX_BYTE_ORDER;
+  const uint64_t no_offsets = 0; // Of an index without any key
+  uint64_t counts[3];
+  size_t i;
+  unsigned int part;
+
+  if (fuzzy_index_build(index) != 0)
+    return -1;
+
+  counts[0] = index->num_signatures;
+  counts[1] = index->num_keys;
+  counts[2] = index->num_postings;
+  if (write_all(handle, INDEX_MAGIC, 1, 8) != 0 ||
+      write_all(handle, &version, sizeof(version), 1) != 0 ||
+      write_all(handle, &byte_order, sizeof(byte_order), 1) != 0 ||
+      write_all(handle, counts, sizeof(uint64_t), 3) != 0)
+    return -1;
+
+  for (i=0;i<index->num_signatures;i++)
+  {
+    const struct fuzzy_prepared *sig = &index->signatures[i];
+    const uint32_t block_size = sig->block_size;
+
+    if (write_all(handle, &block_size, sizeof(block_size), 1) != 0)
+      return -1;
+    for (part=0;part<2;part++)
+    {
+      const uint32_t len = sig->part[part].len;
+
+      if (write_all(handle, &len, sizeof(len), 1) != 0 ||
+	  write_all(handle, &sig->part[part].ngrams, sizeof(uint64_t), 1) != 0 ||
+	  write_all(handle, sig->part[part].digest, 1, SPAMSUM_LENGTH) != 0)
+	return -1;
+    }
+  }
+
+  if (write_all(handle, index->keys, sizeof(uint64_t), index->num_keys) != 0 ||
+      write_all(handle, index->offsets ? index->offsets : &no_offsets,
+		sizeof(uint64_t), index->num_keys + 1) != 0 ||
+      write_all(handle, index->postings, sizeof(uint32_t), index->num_postings) != 0)
+    return -1;
+
+  return fflush(handle) == 0 ? 0 : -1;
+}
+
+// Checks what fuzzy_index_search() relies on: the keys are sorted, the
+// offsets are within the postings and the postings are valid ids.
+static int check_loaded(const struct fuzzy_index *index)
+{
+  size_t i;
+
+  if (index->offsets[0] != 0 || index->offsets[index->num_keys] != index->num_postings)
+    return -1;
+  for (i=0;i<index->num_keys;i++)
+  {
+    if ((i > 0 && index->keys[i-1] >= index->keys[i]) ||
+	index->offsets[i] > index->offsets[i+1])
+      return -1;
+  }
+  for (i=0;i<index->num_postings;i++)
+  {
+    if (index->postings[i] >= index->num_signatures)
+      return -1;
+  }
+
+  return 0;
+}
+
+struct fuzzy_index *fuzzy_index_load(FILE *handle)
+{
+  struct fuzzy_index *index;
+  char magic[8];
+  uint32_t version, byte_order;
+  uint64_t counts[3];
+  size_t i;
+  unsigned int part;
+
+  if (read_all(handle, magic, 1, 8) != 0 ||
+      memcmp(magic, INDEX_MAGIC, 8) != 0 ||
+      read_all(handle, &version, sizeof(version), 1) != 0 ||
+      read_all(handle, &byte_order, sizeof(byte_order), 1) != 0 ||
+      version != INDEX_VERSION ||
+      byte_order != INDEX_BYTE_ORDER ||
+      read_all(handle, counts, sizeof(uint64_t), 3) != 0)
+    return NULL;
+
+  if (counts[0] > (uint64_t)UINT32_MAX + 1 ||
+      counts[0] > SIZE_MAX / sizeof(struct fuzzy_prepared) ||
+      counts[1] > SIZE_MAX / sizeof(uint64_t) - 1 ||
+      counts[2] > SIZE_MAX / sizeof(uint32_t))
+    return NULL;
+
+  index = fuzzy_index_new();
+  if (index == NULL)
+    return NULL;
+
+  index->num_signatures = index->signatures_capacity = (size_t)counts[0];
+  index->num_keys = (size_t)counts[1];
+  index->num_postings = (size_t)counts[2];
+  index->signatures = calloc(index->num_signatures + 1, sizeof(struct fuzzy_prepared));
+  index->keys = malloc((index->num_keys + 1) * sizeof(uint64_t));
+  index->offsets = malloc((index->num_keys + 1) * sizeof(uint64_t));
+  index->postings = malloc((index->num_postings + 1) * sizeof(uint32_t));
+  if (index->signatures == NULL || index->keys == NULL ||
+      index->offsets == NULL || index->postings == NULL)
+    goto error;
+
+  for (i=0;i<index->num_signatures;i++)
+  {
+    struct fuzzy_prepared *sig = &index->signatures[i];
+    uint32_t block_size;
+
+    if (read_all(handle, &block_size, sizeof(block_size), 1) != 0)
+      goto error;
+    sig->block_size = block_size;
+    for (part=0;part<2;part++)
+    {
+      uint32_t len;
+
+      if (read_all(handle, &len, sizeof(len), 1) != 0 ||
+	  read_all(handle, &sig->part[part].ngrams, sizeof(uint64_t), 1) != 0 ||
+	  read_all(handle, sig->part[part].digest, 1, SPAMSUM_LENGTH) != 0 ||
+	  len > SPAMSUM_LENGTH + 1)
+	goto error;
+      sig->part[part].len = len;
+    }
+  }
+
+  if (read_all(handle, index->keys, sizeof(uint64_t), index->num_keys) != 0 ||
+      read_all(handle, index->offsets, sizeof(uint64_t), index->num_keys + 1) != 0 ||
+      read_all(handle, index->postings, sizeof(uint32_t), index->num_postings) != 0 ||
+      check_loaded(index) != 0)
+    goto error;
+
+  return index;
+
+error:
+  fuzzy_index_free(index);
+  return NULL;
+}
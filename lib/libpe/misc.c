@@ -25,12 +25,127 @@
 #endif
 
 #include "libpe/pe.h"
+#include <pthread.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <math.h>
 #include <string.h>
 
-static double calculate_entropy(const unsigned int counted_bytes[256], const size_t total_length) {
+//
+// Byte histogram
+//
+// Counting bytes one at a time into a single table stalls whenever a value
+// repeats, as each increment waits for the store of the previous one. The
+// kernels below spread consecutive bytes over HISTOGRAM_LANES tables and
+// add them up at the end. The SSE2 and AVX2 ones also compare each 16 or
+// 32 byte block with its first byte, so the runs of padding PE files are
+// full of are counted with a single add.
+//
+
+#define HISTOGRAM_LANES 8
+
+// Lanes count in 32 bits, so the kernels are fed blocks they cannot overflow.
+#define HISTOGRAM_BLOCK_SIZE (1u << 30)
+
+// Below this, clearing and adding up the lanes costs more than it saves.
+#define HISTOGRAM_MIN_LANES_SIZE 1024
+
+typedef uint32_t histogram_lanes_t[HISTOGRAM_LANES][256];
+
+typedef void (*histogram_fn)(histogram_lanes_t lanes, const uint8_t *data, size_t size);
+
+// Counts 8 bytes at a time, each in its own lane; `size` is a multiple of 8.
+static inline void histogram_words(histogram_lanes_t lanes, const uint8_t *data, size_t size) {
+	for (size_t i=0; i < size; i += 8) {
+		uint64_t word;
+		memcpy(&word, data + i, sizeof(word));
+		lanes[0][word & 0xff]++;
+		lanes[1][(word >> 8) & 0xff]++;
+		lanes[2][(word >> 16) & 0xff]++;
+		lanes[3][(word >> 24) & 0xff]++;
+		lanes[4][(word >> 32) & 0xff]++;
+		lanes[5][(word >> 40) & 0xff]++;
+		lanes[6][(word >> 48) & 0xff]++;
+		lanes[7][word >> 56]++;
+	}
+}
+
+static void histogram_scalar(histogram_lanes_t lanes, const uint8_t *data, size_t size) {
+	const size_t words_size = size & ~(size_t)7;
+	histogram_words(lanes, data, words_size);
+	for (size_t i=words_size; i < size; i++)
+		lanes[0][data[i]]++;
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define HISTOGRAM_SIMD
+
+// SSE2 is part of x86-64, so this needs no run-time check.
+static void histogram_sse2(histogram_lanes_t lanes, const uint8_t *data, size_t size) {
+	size_t i = 0;
+	for (; i + 16 <= size; i += 16) {
+		const __m128i block = _mm_loadu_si128((const __m128i *)(data + i));
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(block, _mm_set1_epi8((char)data[i]))) == 0xffff)
+			lanes[0][data[i]] += 16;
+		else
+			histogram_words(lanes, data + i, 16);
+	}
+	histogram_scalar(lanes, data + i, size - i);
+}
+
+__attribute__((target("avx2")))
+static void histogram_avx2(histogram_lanes_t lanes, const uint8_t *data, size_t size) {
+	size_t i = 0;
+	for (; i + 32 <= size; i += 32) {
+		const __m256i block = _mm256_loadu_si256((const __m256i *)(data + i));
+		if ((uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, _mm256_set1_epi8((char)data[i]))) == 0xffffffffu)
+			lanes[0][data[i]] += 32;
+		else
+			histogram_words(lanes, data + i, 32);
+	}
+	histogram_scalar(lanes, data + i, size - i);
+}
+#endif
+
+static histogram_fn histogram_kernel = histogram_scalar;
+static pthread_once_t histogram_once = PTHREAD_ONCE_INIT;
+
+static void histogram_setup(void) {
+#ifdef HISTOGRAM_SIMD
+	__builtin_cpu_init();
+	histogram_kernel = __builtin_cpu_supports("avx2") ? histogram_avx2 : histogram_sse2;
+#endif
+}
+
+void pe_byte_histogram(uint64_t counts[256], const void *data, size_t size) {
+	const uint8_t *bytes = data;
+
+	if (size < HISTOGRAM_MIN_LANES_SIZE) {
+		for (size_t i=0; i < size; i++)
+			counts[bytes[i]]++;
+		return;
+	}
+
+	pthread_once(&histogram_once, histogram_setup);
+
+	histogram_lanes_t lanes;
+	while (size > 0) {
+		const size_t block_size = pe_utils_min(size, HISTOGRAM_BLOCK_SIZE);
+		memset(lanes, 0, sizeof(lanes));
+		histogram_kernel(lanes, bytes, block_size);
+		for (size_t i=0; i < 256; i++) {
+			uint64_t count = 0;
+			for (size_t lane=0; lane < HISTOGRAM_LANES; lane++)
+				count += lanes[lane][i];
+			counts[i] += count;
+		}
+		bytes += block_size;
+		size -= block_size;
+	}
+}
+
+static double calculate_entropy(const uint64_t counted_bytes[256], const uint64_t total_length) {
 	double entropy = 0.;
 
 	for (size_t i = 0; i < 256; i++) {
@@ -42,22 +157,54 @@ static double calculate_entropy(const unsigned int counted_bytes[256], const siz
 	return entropy;
 }
 
+double pe_calculate_entropy_histogram(const uint64_t counts[256]) {
+	uint64_t total = 0;
+	for (size_t i=0; i < 256; i++)
+		total += counts[i];
+
+	return total > 0 ? calculate_entropy(counts, total) : 0.;
+}
+
 double pe_calculate_entropy_file(pe_ctx_t *ctx) {
-	unsigned int counted_bytes[256] = { 0 };
+	uint64_t counted_bytes[256] = { 0 };
 
-	const uint8_t *file_bytes = LIBPE_PTR_ADD(ctx->map_addr, 0);
 	const uint64_t filesize = pe_filesize(ctx);
-	for (uint64_t ofs=0; ofs < filesize; ofs++) {
-		const uint8_t byte = file_bytes[ofs];
-		counted_bytes[byte]++;
-	}
-
-	return calculate_entropy(counted_bytes, (size_t)filesize);
+	pe_chunk_iter_t iter;
+	pe_chunks_begin(ctx, &iter, 0, filesize, 0);
+	const uint8_t *file_bytes;
+	size_t size;
+	while ((file_bytes = pe_chunks_next(&iter, &size)) != NULL)
+		pe_byte_histogram(counted_bytes, file_bytes, size);
+	pe_chunks_end(&iter);
+
+	return calculate_entropy(counted_bytes, filesize);
 }
 
+// pe_fpu_trick walks the file through windows of this size, so
+// LIBPE_OPT_WINDOWED contexts never map all of it at once.
+#define FILE_WINDOW_SIZE (64 * 1024 * 1024)
+
 bool pe_fpu_trick(pe_ctx_t *ctx) {
-  // NOTE: What 0xdf has to do with fpu?
-	return !! memmem( ctx->map_addr, ctx->map_size, "\xdf\xdf\xdf\xdf", 4 );
+	static const char pattern[] = "\xdf\xdf\xdf\xdf";
+	const size_t pattern_size = sizeof(pattern) - 1;
+	bool found = false;
+
+	// Windows overlap by pattern_size - 1 bytes so no match is split between two of them.
+	const uint64_t filesize = pe_filesize(ctx);
+	for (uint64_t start=0; !found && start < filesize; start += FILE_WINDOW_SIZE - (pattern_size - 1)) {
+		const uint64_t size = pe_utils_min(filesize - start, FILE_WINDOW_SIZE);
+		pe_window_t window;
+		const void *data = pe_window_map(ctx, &window, start, size);
+		if (data == NULL)
+			break;
+		// NOTE: What 0xdf has to do with fpu?
+		found = memmem(data, size, pattern, pattern_size) != NULL;
+		pe_window_unmap(&window);
+		if (start + size == filesize)
+			break;
+	}
+
+	return found;
 
 //	const char *opcode_ptr = ctx->map_addr;
 //
@@ -265,6 +412,8 @@ static int count_tls_callbacks(pe_ctx_t *ctx) {
 }
 
 int pe_get_tls_callback(pe_ctx_t *ctx) {
+	pe_map_file(ctx);
+
 	const int callbacks = count_tls_callbacks(ctx);
 	int ret = 0;
 
@@ -30,6 +30,7 @@
 #include <string.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
+#include <pthread.h>
 #include <openssl/evp.h>
 #include <openssl/md5.h>
 #include <assert.h>
@@ -37,76 +38,530 @@
 bool pe_can_read(const pe_ctx_t *ctx, const void *ptr, size_t size) {
 	const uintptr_t start = (uintptr_t)ptr;
 	const uintptr_t end = start + size;
-	return start >= (uintptr_t)ctx->map_addr && end <= (uintptr_t)ctx->map_end;
+	// pe_map_file may move the end while other threads read, see map_file.
+	const uintptr_t map_end = __atomic_load_n(&ctx->map_end, __ATOMIC_ACQUIRE);
+	return start >= (uintptr_t)ctx->map_addr && end <= map_end;
+}
+
+//
+// Library-wide state
+//
+// OpenSSL's digest table is process-wide, so it is set up once instead of
+// on every load. Contexts can then be loaded, parsed and unloaded from
+// several threads at the same time. A shutdown clears `library_ready`, so the
+// next load sets everything up again.
+//
+
+static pthread_mutex_t library_lock = PTHREAD_MUTEX_INITIALIZER;
+static bool library_ready;
+
+void pe_library_init(void) {
+	if (__atomic_load_n(&library_ready, __ATOMIC_ACQUIRE))
+		return;
+
+	pthread_mutex_lock(&library_lock);
+	if (!library_ready) {
+		OpenSSL_add_all_digests();
+		__atomic_store_n(&library_ready, true, __ATOMIC_RELEASE);
+	}
+	pthread_mutex_unlock(&library_lock);
+}
+
+// NOTE: Only call this after every context has been unloaded, while no other
+//       thread uses libpe.
+void pe_library_shutdown(void) {
+	pthread_mutex_lock(&library_lock);
+	pe_hash_library_cleanup();
+	CRYPTO_cleanup_all_ex_data();
+	EVP_cleanup(); // Clean OpenSSL_add_all_digests.
+	__atomic_store_n(&library_ready, false, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&library_lock);
 }
 
 pe_err_e pe_load_file(pe_ctx_t *ctx, const char *path) {
 	return pe_load_file_ext(ctx, path, 0);
 }
 
-pe_err_e pe_load_file_ext(pe_ctx_t *ctx, const char *path, pe_options_e options) {
-	// Cleanup the whole struct.
+// Zeroes `ctx` and gets the locks guarding `cached_data` ready.
+static void reset_ctx(pe_ctx_t *ctx) {
 	memset(ctx, 0, sizeof(pe_ctx_t));
 
-	ctx->path = strdup(path);
-	if (ctx->path == NULL) {
-		//perror("strdup");
-		return LIBPE_E_ALLOCATION_FAILURE;
+	pthread_mutex_init(&ctx->cached_locks.imports, NULL);
+	pthread_mutex_init(&ctx->cached_locks.exports, NULL);
+	pthread_mutex_init(&ctx->cached_locks.hash_headers, NULL);
+	pthread_mutex_init(&ctx->cached_locks.hash_sections, NULL);
+	pthread_mutex_init(&ctx->cached_locks.hash_file, NULL);
+	pthread_mutex_init(&ctx->cached_locks.resources, NULL);
+	pthread_mutex_init(&ctx->cached_locks.mapping, NULL);
+
+	pe_arena_init(&ctx->own_arena);
+	ctx->arena = &ctx->own_arena;
+
+	ctx->io.fd = -1;
+	ctx->io.direct_fd = -1;
+}
+
+static void destroy_cached_locks(pe_ctx_t *ctx) {
+	pthread_mutex_destroy(&ctx->cached_locks.imports);
+	pthread_mutex_destroy(&ctx->cached_locks.exports);
+	pthread_mutex_destroy(&ctx->cached_locks.hash_headers);
+	pthread_mutex_destroy(&ctx->cached_locks.hash_sections);
+	pthread_mutex_destroy(&ctx->cached_locks.hash_file);
+	pthread_mutex_destroy(&ctx->cached_locks.resources);
+	pthread_mutex_destroy(&ctx->cached_locks.mapping);
+}
+
+//
+// Header-only loads
+//
+// LIBPE_OPT_HEADERS_ONLY reads the DOS/NT headers and the section table with
+// pread() instead of mapping the whole file, which is what first-pass triage
+// over large or remote files needs. The file is mapped by pe_map_file only
+// when something reads past the headers.
+//
+// LIBPE_OPT_WINDOWED bounds the address space used by very large files, whose
+// size is mostly overlay. pe_map_file maps only up to the end of the section
+// data, which is all the directory parsers can reach. Anything else, such as
+// the data of the section being hashed, is mapped on demand by pe_window_map
+// and unmapped by pe_window_unmap.
+//
+// The address range of the full mapping is reserved at load time and the
+// header pages are mapped at its start, so pe_map_file only maps the rest
+// behind them. Nothing pe_parse pointed to ever moves, and the upgrade
+// publishes nothing but a larger `map_end`, which pe_can_read loads
+// atomically. Threads sharing the context read it while another upgrades.
+//
+
+#define HEADERS_WINDOW_SIZE 4096
+
+// Reads up to `size` bytes at `offset`, retrying short reads. Returns the number of bytes read, or -1.
+static ssize_t pread_full(int fd, void *buf, size_t size, off_t offset) {
+	size_t done = 0;
+	while (done < size) {
+		const ssize_t ret = pread(fd, (uint8_t *)buf + done, size - done, offset + done);
+		if (ret == -1) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		if (ret == 0)
+			break; // EOF
+		done += ret;
 	}
+	return done;
+}
 
-	// Open the file.
-	int oflag = options & LIBPE_OPT_OPEN_RW ? O_RDWR : O_RDONLY;
-	const int fd = open(ctx->path, oflag);
-	if (fd == -1) {
-		//perror("open");
-		return LIBPE_E_OPEN_FAILED;
+// Returns how many bytes from the start of the file cover the headers and the
+// section table, as far as the first `size` bytes of `buf` tell. A result
+// larger than `size` means the window must grow before asking again.
+static uint64_t headers_end(const void *buf, size_t size) {
+	const IMAGE_DOS_HEADER *dos_hdr = buf;
+	if (size < sizeof(IMAGE_DOS_HEADER))
+		return sizeof(IMAGE_DOS_HEADER);
+	if (dos_hdr->e_magic != MAGIC_MZ)
+		return size; // pe_parse rejects it anyway
+
+	const uint64_t coff_ofs = (uint64_t)dos_hdr->e_lfanew + LIBPE_SIZEOF_MEMBER(pe_file_t, signature);
+	const uint64_t opt_ofs = coff_ofs + sizeof(IMAGE_COFF_HEADER);
+	if (size < opt_ofs)
+		return opt_ofs;
+
+	const IMAGE_COFF_HEADER *coff_hdr = LIBPE_PTR_ADD(buf, coff_ofs);
+	// The optional header is read by its actual size, which may exceed SizeOfOptionalHeader.
+	const uint64_t opt_end = opt_ofs + sizeof(IMAGE_OPTIONAL_HEADER_64)
+		+ MAX_DIRECTORIES * sizeof(IMAGE_DATA_DIRECTORY);
+	const uint64_t sections_end = opt_ofs + coff_hdr->SizeOfOptionalHeader
+		+ (uint64_t)coff_hdr->NumberOfSections * sizeof(IMAGE_SECTION_HEADER);
+	return opt_end > sections_end ? opt_end : sections_end;
+}
+
+// Returns how much of the file the headers and the section data span, going
+// by the section table among the first `size` bytes of `buf`, as pe_parse
+// will find it.
+static uint64_t sections_end(const void *buf, size_t size) {
+	uint64_t end = size;
+	const IMAGE_DOS_HEADER *dos_hdr = buf;
+	if (size < sizeof(IMAGE_DOS_HEADER) || dos_hdr->e_magic != MAGIC_MZ)
+		return end;
+
+	const uint64_t coff_ofs = (uint64_t)dos_hdr->e_lfanew + LIBPE_SIZEOF_MEMBER(pe_file_t, signature);
+	if (coff_ofs + sizeof(IMAGE_COFF_HEADER) > size)
+		return end;
+
+	const IMAGE_COFF_HEADER *coff_hdr = LIBPE_PTR_ADD(buf, coff_ofs);
+	const uint64_t sections_ofs = coff_ofs + sizeof(IMAGE_COFF_HEADER) + coff_hdr->SizeOfOptionalHeader;
+	const uint32_t num_sections = pe_utils_min(coff_hdr->NumberOfSections, MAX_SECTIONS);
+	for (uint32_t i = 0; i < num_sections; i++) {
+		const uint64_t section_ofs = sections_ofs + (uint64_t)i * sizeof(IMAGE_SECTION_HEADER);
+		if (section_ofs + sizeof(IMAGE_SECTION_HEADER) > size)
+			break;
+		const IMAGE_SECTION_HEADER *section = LIBPE_PTR_ADD(buf, section_ofs);
+		const uint64_t section_end = (uint64_t)section->PointerToRawData + section->SizeOfRawData;
+		if (section_end > end)
+			end = section_end;
 	}
+	return end;
+}
+
+static uint64_t page_align(uint64_t size) {
+	const uint64_t page_size = sysconf(_SC_PAGESIZE);
+	return size + (page_size - size % page_size) % page_size;
+}
+
+// Maps `length` bytes of the file behind `fd` at `offset`, at `addr` if it is not NULL.
+static void *map_region(const pe_ctx_t *ctx, int fd, void *addr, off_t offset, size_t length) {
+	const pe_options_e options = ctx->io.options;
+	int mprot = options & LIBPE_OPT_OPEN_RW ? PROT_READ|PROT_WRITE : PROT_READ;
+	int mflags = options & LIBPE_OPT_OPEN_RW ? MAP_SHARED : MAP_PRIVATE;
+	if (addr != NULL)
+		mflags |= MAP_FIXED;
+	addr = mmap(addr, length, mprot, mflags, fd, offset);
+	if (addr == MAP_FAILED) {
+		//perror("mmap");
+		return NULL;
+	}
+
+	int ret = madvise(addr, length, MADV_SEQUENTIAL);
+	if (ret < 0) {
+		//perror("madvise");
+		// NOTE: This is a recoverable error. Do not abort.
+	}
+
+	return addr;
+}
+
+// Reads the header window of the file behind `fd` into `ctx`.
+static pe_err_e read_headers(pe_ctx_t *ctx, int fd, uint64_t file_size) {
+	uint64_t size = file_size < HEADERS_WINDOW_SIZE ? file_size : HEADERS_WINDOW_SIZE;
+	void *window = NULL;
+
+	for (;;) {
+		void *grown = pe_malloc(size > 0 ? size : 1);
+		if (grown == NULL) {
+			pe_free(window);
+			return LIBPE_E_ALLOCATION_FAILURE;
+		}
+		pe_free(window);
+		window = grown;
+
+		const ssize_t ret = pread_full(fd, window, size, 0);
+		if (ret == -1) {
+			pe_free(window);
+			return LIBPE_E_READ_FAILED;
+		}
+		size = ret; // The file may have shrunk meanwhile.
+
+		uint64_t needed = headers_end(window, size);
+		if (needed > file_size)
+			needed = file_size;
+		if (needed <= size)
+			break;
+		size = needed;
+	}
+
+	// Everything pe_map_file will map, at most.
+	uint64_t reserved = ctx->io.options & LIBPE_OPT_WINDOWED ? sections_end(window, size) : file_size;
+	pe_free(window);
+	if (size == 0)
+		return LIBPE_E_MMAP_FAILED; // As mapping an empty file does
+	if (reserved > file_size)
+		reserved = file_size;
+	if (reserved < size)
+		reserved = size;
+	if (reserved > SIZE_MAX)
+		return LIBPE_E_MMAP_FAILED;
+
+	// Only the address range is taken; none of it can be read yet.
+	void *map_addr = mmap(NULL, reserved, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (map_addr == MAP_FAILED)
+		return LIBPE_E_MMAP_FAILED;
+
+	const size_t headers_length = pe_utils_min(page_align(size), reserved);
+	if (map_region(ctx, fd, map_addr, 0, headers_length) == NULL) {
+		munmap(map_addr, reserved);
+		return LIBPE_E_MMAP_FAILED;
+	}
+	// pread already brought these pages in; don't read around them on the first fault.
+	madvise(map_addr, headers_length, MADV_RANDOM);
+
+	ctx->map_kind = LIBPE_MAP_HEADERS;
+	ctx->map_addr = map_addr;
+	ctx->map_size = size;
+	ctx->map_end = (uintptr_t)LIBPE_PTR_ADD(map_addr, size);
+	ctx->io.reserved = reserved;
+	return LIBPE_E_OK;
+}
+
+static pe_err_e map_file(pe_ctx_t *ctx) {
+	if (ctx->map_kind != LIBPE_MAP_HEADERS)
+		return LIBPE_E_OK;
+
+	pe_file_io_t *io = &ctx->io;
+	const bool windowed = io->options & LIBPE_OPT_WINDOWED;
+	const uint64_t map_size = io->reserved;
+	if (map_size <= (uint64_t)ctx->map_size)
+		return LIBPE_E_OK; // The window already holds everything.
+
+	// The header pages are mapped already, the rest of the range is mapped behind them.
+	const uint64_t headers_length = page_align(ctx->map_size);
+	if (map_size > headers_length) {
+		void *tail = LIBPE_PTR_ADD(ctx->map_addr, headers_length);
+		if (map_region(ctx, io->fd, tail, headers_length, map_size - headers_length) == NULL)
+			return LIBPE_E_MMAP_FAILED;
+	}
+
+	ctx->map_kind = LIBPE_MAP_MMAP;
+	ctx->map_size = map_size;
+	// Pairs with the load in pe_can_read: whoever sees the new end sees the pages behind it.
+	__atomic_store_n(&ctx->map_end, (uintptr_t)LIBPE_PTR_ADD(ctx->map_addr, map_size), __ATOMIC_RELEASE);
+
+	if (windowed || io->options & (LIBPE_OPT_IO_PREAD | LIBPE_OPT_IO_DIRECT))
+		return LIBPE_E_OK; // pe_window_map and the chunk iterator need the fd until pe_unload.
+
+	if (io->owns_fd) {
+		int ret = close(io->fd);
+		if (ret == -1) {
+			//perror("close");
+			// NOTE: The mapping is usable anyway.
+		}
+	}
+	io->fd = -1;
+	io->owns_fd = false;
+
+	return LIBPE_E_OK;
+}
+
+pe_err_e pe_map_file(pe_ctx_t *ctx) {
+	pthread_mutex_lock(&ctx->cached_locks.mapping);
+	const pe_err_e ret = map_file(ctx);
+	pthread_mutex_unlock(&ctx->cached_locks.mapping);
+	return ret;
+}
+
+const void *pe_window_map(pe_ctx_t *ctx, pe_window_t *window, uint64_t offset, uint64_t size) {
+	window->addr = NULL;
+	window->length = 0;
+
+	const uint64_t file_size = pe_filesize(ctx);
+	if (offset > file_size || size > file_size - offset)
+		return NULL;
+
+	pthread_mutex_lock(&ctx->cached_locks.mapping);
+	if (!(ctx->io.options & LIBPE_OPT_WINDOWED))
+		map_file(ctx); // No-op unless loaded with LIBPE_OPT_HEADERS_ONLY
+	const void *ptr = LIBPE_PTR_ADD(ctx->map_addr, offset);
+	const bool mapped = pe_can_read(ctx, ptr, size);
+	const int fd = ctx->io.fd;
+	pthread_mutex_unlock(&ctx->cached_locks.mapping);
+
+	if (mapped)
+		return ptr;
+	if (!(ctx->io.options & LIBPE_OPT_WINDOWED) || fd == -1)
+		return NULL;
+
+	// mmap() wants a page-aligned offset.
+	const uint64_t page_size = sysconf(_SC_PAGESIZE);
+	const uint64_t start = offset - offset % page_size;
+	const uint64_t length = offset - start + size;
+	if (length > SIZE_MAX)
+		return NULL;
+
+	void *addr = map_region(ctx, fd, NULL, start, length > 0 ? length : 1);
+	if (addr == NULL)
+		return NULL;
+
+	window->addr = addr;
+	window->length = length > 0 ? length : 1;
+	return LIBPE_PTR_ADD(addr, offset - start);
+}
+
+void pe_window_unmap(pe_window_t *window) {
+	if (window->addr != NULL)
+		munmap(window->addr, window->length);
+	window->addr = NULL;
+	window->length = 0;
+}
+
+//
+// Chunk iterator
+//
+// Whole-file passes (hashing, entropy, string scans) read the file once, in
+// order. The backend is picked at load time: the memory mapping by default,
+// LIBPE_OPT_IO_PREAD for large sequential reads with kernel readahead, which
+// beat page faults on some storage, and LIBPE_OPT_IO_DIRECT to keep cold data
+// out of the page cache.
+//
+
+#define DIRECT_IO_ALIGNMENT 4096
+
+pe_err_e pe_chunks_begin(pe_ctx_t *ctx, pe_chunk_iter_t *iter, uint64_t offset, uint64_t size, size_t chunk_size) {
+	memset(iter, 0, sizeof(pe_chunk_iter_t));
+	iter->ctx = ctx;
+	iter->fd = -1;
+	iter->align = 1;
+	iter->chunk_size = chunk_size > 0 ? chunk_size : PE_CHUNK_SIZE_DEFAULT;
+
+	const uint64_t file_size = pe_filesize(ctx);
+	if (offset > file_size || size > file_size - offset) {
+		iter->err = LIBPE_E_READ_FAILED;
+		return iter->err;
+	}
+	iter->offset = offset;
+	iter->end = offset + size;
+
+	const pe_options_e options = ctx->io.options;
+	if (options & LIBPE_OPT_IO_DIRECT && ctx->io.direct_fd != -1) {
+		iter->fd = ctx->io.direct_fd;
+		iter->align = DIRECT_IO_ALIGNMENT;
+	} else if (options & (LIBPE_OPT_IO_PREAD | LIBPE_OPT_IO_DIRECT)) {
+		iter->fd = ctx->io.fd;
+	}
+
+	if (iter->fd == -1)
+		return LIBPE_E_OK; // Walk the mapping.
+
+	// O_DIRECT wants the buffer, offset and length aligned, so the buffer has
+	// room for one extra block on each side of a chunk.
+	iter->chunk_size += (iter->align - iter->chunk_size % iter->align) % iter->align;
+	iter->buffer_base = pe_malloc(iter->chunk_size + 2 * iter->align);
+	if (iter->buffer_base == NULL) {
+		iter->err = LIBPE_E_ALLOCATION_FAILURE;
+		return iter->err;
+	}
+	const uintptr_t base = (uintptr_t)iter->buffer_base;
+	iter->buffer = (void *)(base + (iter->align - base % iter->align) % iter->align);
+
+#ifdef POSIX_FADV_SEQUENTIAL
+	posix_fadvise(iter->fd, offset, size, POSIX_FADV_SEQUENTIAL);
+#endif
+
+	return LIBPE_E_OK;
+}
+
+const void *pe_chunks_next(pe_chunk_iter_t *iter, size_t *size) {
+	pe_window_unmap(&iter->window);
+	*size = 0;
+
+	if (iter->err != LIBPE_E_OK || iter->offset >= iter->end)
+		return NULL;
+
+	const uint64_t offset = iter->offset;
+	const size_t length = pe_utils_min(iter->end - offset, (uint64_t)iter->chunk_size);
+
+	if (iter->fd == -1) {
+		const void *data = pe_window_map(iter->ctx, &iter->window, offset, length);
+		if (data == NULL) {
+			iter->err = LIBPE_E_MMAP_FAILED;
+			return NULL;
+		}
+		iter->offset += length;
+		*size = length;
+		return data;
+	}
+
+	const uint64_t start = offset - offset % iter->align;
+	const size_t lead = offset - start;
+	size_t read_size = lead + length;
+	read_size += (iter->align - read_size % iter->align) % iter->align;
+	const ssize_t ret = pread_full(iter->fd, iter->buffer, read_size, start);
+	if (ret == -1 || (size_t)ret < lead + length) {
+		// A short read means the file shrank under us.
+		iter->err = LIBPE_E_READ_FAILED;
+		return NULL;
+	}
+
+	iter->offset += length;
+	*size = length;
+	return (const uint8_t *)iter->buffer + lead;
+}
 
+void pe_chunks_end(pe_chunk_iter_t *iter) {
+	pe_window_unmap(&iter->window);
+	pe_free(iter->buffer_base);
+	iter->buffer = NULL;
+	iter->buffer_base = NULL;
+}
+
+// Maps the regular file behind `fd` into `ctx`. If `owns_fd` is set the
+// descriptor was opened by libpe and is closed here (or kept as `stream`).
+// Otherwise it belongs to the caller and is left untouched.
+static pe_err_e load_fd(pe_ctx_t *ctx, int fd, pe_options_e options, bool owns_fd) {
 	int ret = 0;
-	
+
 	// Stat the fd to retrieve the file informations.
 	// If file is a symlink, fstat will stat the pointed file, not the link.
 	struct stat stat;
 	ret = fstat(fd, &stat);
 	if (ret == -1) {
-		close(fd);
+		if (owns_fd)
+			close(fd);
 		//perror("fstat");
 		return LIBPE_E_FSTAT_FAILED;
 	}
 
 	// Check if we're dealing with a regular file.
 	if (!S_ISREG(stat.st_mode)) {
-		close(fd);
+		if (owns_fd)
+			close(fd);
 		//fprintf(stderr, "%s is not a file\n", ctx->path);
 		return LIBPE_E_NOT_A_FILE;
 	}
 
-	// Grab the file size.
-	ctx->map_size = stat.st_size;
+	ctx->io.options = options;
+	ctx->io.file_size = stat.st_size;
+
+	const bool headers_only = options & (LIBPE_OPT_HEADERS_ONLY | LIBPE_OPT_WINDOWED);
+	const bool keep_fd = headers_only || options & (LIBPE_OPT_IO_PREAD | LIBPE_OPT_IO_DIRECT);
+	if (headers_only) {
+		// Read just the headers; pe_map_file maps the rest later, from the same fd.
+		const pe_err_e err = read_headers(ctx, fd, stat.st_size);
+		if (err != LIBPE_E_OK) {
+			if (owns_fd)
+				close(fd);
+			return err;
+		}
+	} else {
+		// Grab the file size.
+		ctx->map_size = stat.st_size;
+
+		// Create the virtual memory mapping.
+		int mprot = options & LIBPE_OPT_OPEN_RW ? PROT_READ|PROT_WRITE /* Pages may be written */ : PROT_READ;
+		// MAP_SHARED makes updates to the mapping visible to other processes that map this file.
+		// The file may not actually be updated until msync(2) or munmap() is called.
+		int mflags = options & LIBPE_OPT_OPEN_RW ? MAP_SHARED : MAP_PRIVATE;
+		ctx->map_addr = mmap(NULL, ctx->map_size, mprot, mflags, fd, 0);
+		if (ctx->map_addr == MAP_FAILED) {
+			if (owns_fd)
+				close(fd);
+			//perror("mmap");
+			return LIBPE_E_MMAP_FAILED;
+		}
 
-	// Create the virtual memory mapping.
-	int mprot = options & LIBPE_OPT_OPEN_RW ? PROT_READ|PROT_WRITE /* Pages may be written */ : PROT_READ;
-	// MAP_SHARED makes updates to the mapping visible to other processes that map this file.
-	// The file may not actually be updated until msync(2) or munmap() is called.
-	int mflags = options & LIBPE_OPT_OPEN_RW ? MAP_SHARED : MAP_PRIVATE;
-	ctx->map_addr = mmap(NULL, ctx->map_size, mprot, mflags, fd, 0);
-	if (ctx->map_addr == MAP_FAILED) {
-		close(fd);
-		//perror("mmap");
-		return LIBPE_E_MMAP_FAILED;
+		ctx->map_end = (uintptr_t)LIBPE_PTR_ADD(ctx->map_addr, ctx->map_size);
 	}
 
-	ctx->map_end = (uintptr_t)LIBPE_PTR_ADD(ctx->map_addr, ctx->map_size);
-
 	if (options & LIBPE_OPT_NOCLOSE_FD) {
-		// The file descriptor is not dup'ed, and will be closed when the stream created by fdopen() is closed.
-		FILE *fp = fdopen(fd,  options & LIBPE_OPT_OPEN_RW ? "r+b" : "rb"); // NOTE: 'b' is ignored on all POSIX conforming systems.
+		// The stream created by fdopen() closes its descriptor on pe_unload, so
+		// it gets its own copy when the original belongs to the caller.
+		const int stream_fd = owns_fd ? fd : dup(fd);
+		if (stream_fd == -1) {
+			//perror("dup");
+			return LIBPE_E_FDOPEN_FAILED;
+		}
+		FILE *fp = fdopen(stream_fd,  options & LIBPE_OPT_OPEN_RW ? "r+b" : "rb"); // NOTE: 'b' is ignored on all POSIX conforming systems.
 		if (fp == NULL) {
+			close(stream_fd);
 			//perror("fdopen");
 			return LIBPE_E_FDOPEN_FAILED;
 		}
 		ctx->stream = fp;
-	} else {
+		if (keep_fd)
+			ctx->io.fd = stream_fd;
+	} else if (keep_fd) {
+		// Keep the fd for pe_map_file or the chunk iterator. The caller's fd must stay open until then.
+		ctx->io.fd = fd;
+		ctx->io.owns_fd = owns_fd;
+	} else if (owns_fd) {
 		// We can now close the fd.
 		ret = close(fd);
 		if (ret == -1) {
@@ -115,61 +570,299 @@ pe_err_e pe_load_file_ext(pe_ctx_t *ctx, const char *path, pe_options_e options)
 		}
 	}
 
-	// Give advice about how we'll use our memory mapping.
-	ret = madvise(ctx->map_addr, ctx->map_size, MADV_SEQUENTIAL);
-	if (ret < 0) {
-		//perror("madvise");
-		// NOTE: This is a recoverable error. Do not abort.
+	if (!headers_only) {
+		// Give advice about how we'll use our memory mapping.
+		ret = madvise(ctx->map_addr, ctx->map_size, MADV_SEQUENTIAL);
+		if (ret < 0) {
+			//perror("madvise");
+			// NOTE: This is a recoverable error. Do not abort.
+		}
 	}
 
-	OpenSSL_add_all_digests();
+	pe_library_init();
+
+	return LIBPE_E_OK;
+}
+
+// Opens the file again with O_DIRECT for LIBPE_OPT_IO_DIRECT. Filesystems
+// without O_DIRECT support (tmpfs, for one) refuse it, as do systems without
+// /proc/self/fd for pe_load_fd. The chunk iterator then reads through `io.fd`
+// instead.
+static int open_direct(int dirfd, const char *path) {
+#ifdef O_DIRECT
+	return openat(dirfd, path, O_RDONLY | O_DIRECT);
+#else
+	(void)dirfd;
+	(void)path;
+	return -1;
+#endif
+}
+
+pe_err_e pe_load_file_ext(pe_ctx_t *ctx, const char *path, pe_options_e options) {
+	return pe_load_fileat(ctx, AT_FDCWD, path, options);
+}
+
+pe_err_e pe_load_fileat(pe_ctx_t *ctx, int dirfd, const char *path, pe_options_e options) {
+	// Cleanup the whole struct.
+	reset_ctx(ctx);
+
+	ctx->path = pe_strdup(path);
+	if (ctx->path == NULL) {
+		//perror("strdup");
+		return LIBPE_E_ALLOCATION_FAILURE;
+	}
+
+	// Open the file.
+	int oflag = options & LIBPE_OPT_OPEN_RW ? O_RDWR : O_RDONLY;
+	const int fd = openat(dirfd, ctx->path, oflag);
+	if (fd == -1) {
+		//perror("openat");
+		return LIBPE_E_OPEN_FAILED;
+	}
+
+	const pe_err_e err = load_fd(ctx, fd, options, true);
+	if (err == LIBPE_E_OK && options & LIBPE_OPT_IO_DIRECT)
+		ctx->io.direct_fd = open_direct(dirfd, ctx->path);
+	return err;
+}
+
+pe_err_e pe_load_fd(pe_ctx_t *ctx, int fd, pe_options_e options) {
+	// Cleanup the whole struct.
+	reset_ctx(ctx);
+
+	const pe_err_e err = load_fd(ctx, fd, options, false);
+	if (err == LIBPE_E_OK && options & LIBPE_OPT_IO_DIRECT) {
+		// The caller's descriptor keeps its flags; the file is opened again through procfs.
+		char path[32];
+		snprintf(path, sizeof(path), "/proc/self/fd/%d", fd);
+		ctx->io.direct_fd = open_direct(AT_FDCWD, path);
+	}
+	return err;
+}
+
+pe_err_e pe_load_buffer(pe_ctx_t *ctx, const void *buffer, size_t size, pe_options_e options) {
+	// Cleanup the whole struct.
+	reset_ctx(ctx);
+
+	if (buffer == NULL || size == 0) {
+		// An owned buffer is never handed back, so the caller can't leak it.
+		if (options & LIBPE_OPT_BUFFER_OWNED)
+			pe_free((void *)buffer);
+		return LIBPE_E_INVALID_BUFFER;
+	}
+
+	ctx->map_kind = options & LIBPE_OPT_BUFFER_OWNED ? LIBPE_MAP_OWNED : LIBPE_MAP_BORROWED;
+	ctx->map_addr = (void *)buffer;
+	ctx->map_size = size;
+	ctx->map_end = (uintptr_t)LIBPE_PTR_ADD(ctx->map_addr, ctx->map_size);
+
+	pe_library_init();
 
 	return LIBPE_E_OK;
 }
 
 static void cleanup_cached_data(pe_ctx_t *ctx) {
-	pe_imports_dealloc(ctx->cached_data.imports);
-	pe_exports_dealloc(ctx->cached_data.exports);
-	pe_hash_headers_dealloc(ctx->cached_data.hash_headers);
-	pe_hash_sections_dealloc(ctx->cached_data.hash_sections);
-	pe_hash_dealloc(ctx->cached_data.hash_file);
-	pe_resources_dealloc(ctx->cached_data.resources);
+	// Everything in cached_data lives in the arena, so it's released at once.
+	// An arena provided by the caller keeps its memory for the next file.
+	if (ctx->arena == &ctx->own_arena)
+		pe_arena_destroy(&ctx->own_arena);
+	else if (ctx->arena != NULL)
+		pe_arena_reset(ctx->arena);
+	ctx->arena = NULL;
+
 	memset(&ctx->cached_data, 0, sizeof(pe_cached_data_t));
 }
 
+void pe_use_arena(pe_ctx_t *ctx, pe_arena_t *arena) {
+	ctx->arena = arena != NULL ? arena : &ctx->own_arena;
+}
+
 pe_err_e pe_unload(pe_ctx_t *ctx) {
 	if (ctx->stream != NULL) {
 		fclose(ctx->stream);
 	}
 
-	free(ctx->path);
+	pe_free(ctx->path);
 
 	// Dealloc internal pointers.
-	free(ctx->pe.directories);
-	free(ctx->pe.sections);
+	pe_free(ctx->pe.directories);
+	pe_free(ctx->pe.sections);
+	pe_free(ctx->pe.section_index.storage);
+	if (ctx->io.owns_fd)
+		close(ctx->io.fd);
+	if (ctx->io.direct_fd != -1)
+		close(ctx->io.direct_fd);
 
 	cleanup_cached_data(ctx);
+	destroy_cached_locks(ctx);
 
-	// Dealloc the virtual mapping.
+	// Dealloc the virtual mapping, unless it belongs to the caller.
 	if (ctx->map_addr != NULL) {
-		int ret = munmap(ctx->map_addr, ctx->map_size);
-		if (ret != 0) {
-			//perror("munmap");
-			return LIBPE_E_MUNMAP_FAILED;
+		switch (ctx->map_kind) {
+			case LIBPE_MAP_MMAP:
+			case LIBPE_MAP_HEADERS: {
+				// A header-only load reserved the range of the full mapping.
+				const size_t length = ctx->io.reserved ? ctx->io.reserved : (size_t)ctx->map_size;
+				int ret = munmap(ctx->map_addr, length);
+				if (ret != 0) {
+					//perror("munmap");
+					return LIBPE_E_MUNMAP_FAILED;
+				}
+				break;
+			}
+			case LIBPE_MAP_OWNED:
+				pe_free(ctx->map_addr);
+				break;
+			case LIBPE_MAP_BORROWED:
+				break;
 		}
 	}
 
-	CRYPTO_cleanup_all_ex_data();
-	EVP_cleanup(); // Clean OpenSSL_add_all_digests.
-
 	// Cleanup the whole struct.
 	memset(ctx, 0, sizeof(pe_ctx_t));
 
 	return LIBPE_E_OK;
 }
 
+//
+// Section index
+//
+// The RVA/offset translation functions used to walk the whole section table
+// on every call. Since they're called once per thunk, name and resource entry,
+// pe_parse builds a sorted interval index for each address space instead, so
+// every lookup is a binary search. Each elementary interval remembers the
+// first section (in header order) covering it, so overlapping or otherwise
+// malformed section tables resolve exactly as the linear scans did.
+//
+
+static int compare_uint64(const void *a, const void *b) {
+	const uint64_t x = *(const uint64_t *)a;
+	const uint64_t y = *(const uint64_t *)b;
+	return x < y ? -1 : x > y;
+}
+
+// Fill `map` from the half-open intervals [start[i], end[i]). Empty intervals never match.
+static void section_map_build(pe_section_map_t *map, const uint64_t *start, const uint64_t *end, uint32_t count) {
+	uint32_t num_bounds = 0;
+	for (uint32_t i=0; i < count; i++) {
+		if (end[i] <= start[i])
+			continue;
+		map->bounds[num_bounds++] = start[i];
+		map->bounds[num_bounds++] = end[i];
+	}
+
+	map->count = 0;
+	if (num_bounds == 0)
+		return;
+
+	qsort(map->bounds, num_bounds, sizeof(uint64_t), compare_uint64);
+
+	uint32_t unique = 1;
+	for (uint32_t i=1; i < num_bounds; i++) {
+		if (map->bounds[i] != map->bounds[unique - 1])
+			map->bounds[unique++] = map->bounds[i];
+	}
+	map->count = unique - 1;
+
+	for (uint32_t j=0; j < map->count; j++) {
+		map->owner[j] = -1;
+		for (uint32_t i=0; i < count; i++) {
+			if (start[i] <= map->bounds[j] && map->bounds[j] < end[i]) {
+				map->owner[j] = (int32_t)i;
+				break;
+			}
+		}
+	}
+}
+
+// Returns the index of the section owning `key`, or -1.
+static int32_t section_map_lookup(const pe_section_map_t *map, uint64_t key) {
+	if (map->count == 0 || key < map->bounds[0] || key >= map->bounds[map->count])
+		return -1;
+
+	// Invariant: bounds[lo] <= key < bounds[hi]
+	uint32_t lo = 0, hi = map->count;
+	while (hi - lo > 1) {
+		const uint32_t mid = lo + (hi - lo) / 2;
+		if (map->bounds[mid] <= key)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	return map->owner[lo];
+}
+
+static bool build_section_index(pe_ctx_t *ctx) {
+	pe_section_index_t *index = &ctx->pe.section_index;
+	pe_section_map_t * const maps[] = { &index->rva, &index->rva2ofs, &index->ofs2rva, &index->ofs };
+	const size_t num_maps = LIBPE_SIZEOF_ARRAY(maps);
+	const uint32_t num_sections = ctx->pe.num_sections;
+	const size_t max_bounds = 2 * (size_t)num_sections;
+
+	index->storage = pe_malloc(num_maps * max_bounds * (sizeof(uint64_t) + sizeof(int32_t)));
+	if (index->storage == NULL)
+		return false;
+
+	uint64_t *bounds = index->storage;
+	int32_t *owners = (int32_t *)(bounds + num_maps * max_bounds);
+	for (size_t m=0; m < num_maps; m++) {
+		maps[m]->bounds = bounds + m * max_bounds;
+		maps[m]->owner = owners + m * max_bounds;
+	}
+
+	uint64_t start[MAX_SECTIONS] = { 0 };
+	uint64_t end[MAX_SECTIONS] = { 0 };
+
+	// NOTE: The 32-bit sums below wrap around exactly like they did in the
+	//       linear scans, so corrupted headers keep producing the same results.
+	//       Section headers outside of the mapping are left out of the index.
+
+	// pe_rva2section: VirtualAddress <= rva <= VirtualAddress + VirtualSize
+	for (uint32_t i=0; i < num_sections; i++) {
+		const IMAGE_SECTION_HEADER *s = ctx->pe.sections[i];
+		const bool ok = pe_can_read(ctx, s, sizeof(IMAGE_SECTION_HEADER));
+		start[i] = ok ? s->VirtualAddress : 0;
+		end[i] = ok ? (uint64_t)(uint32_t)(s->VirtualAddress + s->Misc.VirtualSize) + 1 : 0;
+	}
+	section_map_build(&index->rva, start, end, num_sections);
+
+	// pe_rva2ofs: VirtualAddress <= rva < VirtualAddress + size, where size is
+	// VirtualSize, or SizeOfRawData if VirtualSize == 0.
+	for (uint32_t i=0; i < num_sections; i++) {
+		const IMAGE_SECTION_HEADER *s = ctx->pe.sections[i];
+		const bool ok = pe_can_read(ctx, s, sizeof(IMAGE_SECTION_HEADER));
+		const uint64_t size = !ok ? 0 : s->Misc.VirtualSize ? s->Misc.VirtualSize : s->SizeOfRawData;
+		start[i] = ok ? s->VirtualAddress : 0;
+		end[i] = ok ? s->VirtualAddress + size : 0;
+	}
+	section_map_build(&index->rva2ofs, start, end, num_sections);
+
+	// pe_ofs2rva: PointerToRawData <= ofs < PointerToRawData + SizeOfRawData
+	for (uint32_t i=0; i < num_sections; i++) {
+		const IMAGE_SECTION_HEADER *s = ctx->pe.sections[i];
+		const bool ok = pe_can_read(ctx, s, sizeof(IMAGE_SECTION_HEADER));
+		start[i] = ok ? s->PointerToRawData : 0;
+		end[i] = ok ? (uint64_t)(uint32_t)(s->PointerToRawData + s->SizeOfRawData) : 0;
+	}
+	section_map_build(&index->ofs2rva, start, end, num_sections);
+
+	// pe_ofs2section: PointerToRawData <= ofs <= PointerToRawData + SizeOfRawData
+	for (uint32_t i=0; i < num_sections; i++) {
+		const IMAGE_SECTION_HEADER *s = ctx->pe.sections[i];
+		const bool ok = pe_can_read(ctx, s, sizeof(IMAGE_SECTION_HEADER));
+		start[i] = ok ? s->PointerToRawData : 0;
+		end[i] = ok ? (uint64_t)(uint32_t)(s->PointerToRawData + s->SizeOfRawData) + 1 : 0;
+	}
+	section_map_build(&index->ofs, start, end, num_sections);
+
+	return true;
+}
+
 pe_err_e pe_parse(pe_ctx_t *ctx) {
 	ctx->pe.dos_hdr = ctx->map_addr;
+	// A buffer from pe_load_buffer may be shorter than a page, unlike a mapping.
+	if (!pe_can_read(ctx, ctx->pe.dos_hdr, sizeof(IMAGE_DOS_HEADER)))
+		return LIBPE_E_NOT_A_PE_FILE;
 	if (ctx->pe.dos_hdr->e_magic != MAGIC_MZ)
 		return LIBPE_E_NOT_A_PE_FILE;
 
@@ -258,7 +951,7 @@ pe_err_e pe_parse(pe_ctx_t *ctx) {
 	ctx->pe.sections_ptr = LIBPE_PTR_ADD(signature_ptr, sections_offset);
 
 	if (ctx->pe.num_directories > 0) {
-		ctx->pe.directories = malloc(ctx->pe.num_directories
+		ctx->pe.directories = pe_malloc(ctx->pe.num_directories
 			* sizeof(IMAGE_DATA_DIRECTORY *));
 		if (ctx->pe.directories == NULL)
 			return LIBPE_E_ALLOCATION_FAILURE;
@@ -271,7 +964,7 @@ pe_err_e pe_parse(pe_ctx_t *ctx) {
 	}
 
 	if (ctx->pe.num_sections > 0) {
-		ctx->pe.sections = malloc(ctx->pe.num_sections
+		ctx->pe.sections = pe_malloc(ctx->pe.num_sections
 			* sizeof(IMAGE_SECTION_HEADER *));
 		if (ctx->pe.sections == NULL)
 			return LIBPE_E_ALLOCATION_FAILURE;
@@ -279,6 +972,8 @@ pe_err_e pe_parse(pe_ctx_t *ctx) {
 			ctx->pe.sections[i] = LIBPE_PTR_ADD(ctx->pe.sections_ptr,
 				i * sizeof(IMAGE_SECTION_HEADER));
 		}
+		if (!build_section_index(ctx))
+			return LIBPE_E_ALLOCATION_FAILURE;
 	} else {
 		ctx->pe.sections_ptr = NULL;
 	}
@@ -309,7 +1004,9 @@ bool pe_is_dll(const pe_ctx_t *ctx) {
 }
 
 uint64_t pe_filesize(const pe_ctx_t *ctx) {
-	return ctx->map_size;
+	if (ctx->map_kind == LIBPE_MAP_BORROWED || ctx->map_kind == LIBPE_MAP_OWNED)
+		return ctx->map_size;
+	return ctx->io.file_size;
 }
 
 // return the section of given rva
@@ -317,13 +1014,17 @@ IMAGE_SECTION_HEADER *pe_rva2section(pe_ctx_t *ctx, uint64_t rva) {
 	if (rva == 0 || ctx->pe.sections == NULL)
 		return NULL;
 
-	for (uint32_t i=0; i < ctx->pe.num_sections; i++) {
-		const uint64_t start = ctx->pe.sections[i]->VirtualAddress;
-		const uint64_t end = ctx->pe.sections[i]->VirtualAddress + ctx->pe.sections[i]->Misc.VirtualSize;
-		if (rva >= start && rva <= end)
-			return ctx->pe.sections[i];
-	}
-	return NULL;
+	const int32_t i = section_map_lookup(&ctx->pe.section_index.rva, rva);
+	return i < 0 ? NULL : ctx->pe.sections[i];
+}
+
+// return the section of given raw file offset
+IMAGE_SECTION_HEADER *pe_ofs2section(const pe_ctx_t *ctx, uint64_t ofs) {
+	if (ctx->pe.sections == NULL)
+		return NULL;
+
+	const int32_t i = section_map_lookup(&ctx->pe.section_index.ofs, ofs);
+	return i < 0 ? NULL : ctx->pe.sections[i];
 }
 
 // Converts a RVA (Relative Virtual Address) to a raw file offset
@@ -335,22 +1036,12 @@ uint64_t pe_rva2ofs(const pe_ctx_t *ctx, uint64_t rva) {
 		return rva;
 
 	// Find out which section the given RVA belongs
-	for (uint32_t i=0; i < ctx->pe.num_sections; i++) {
-		if (ctx->pe.sections[i] == NULL)
-			return 0;
-
-		// Use SizeOfRawData if VirtualSize == 0
-		size_t section_size = ctx->pe.sections[i]->Misc.VirtualSize;
-		if (section_size == 0)
-			section_size = ctx->pe.sections[i]->SizeOfRawData;
-
-		if (ctx->pe.sections[i]->VirtualAddress <= rva) {
-			if ((ctx->pe.sections[i]->VirtualAddress + section_size) > rva) {
-			 	rva -= ctx->pe.sections[i]->VirtualAddress;
-				rva += ctx->pe.sections[i]->PointerToRawData;
-				return rva;
-			}
-		}
+	// Uses SizeOfRawData if VirtualSize == 0
+	const int32_t i = section_map_lookup(&ctx->pe.section_index.rva2ofs, rva);
+	if (i >= 0) {
+		rva -= ctx->pe.sections[i]->VirtualAddress;
+		rva += ctx->pe.sections[i]->PointerToRawData;
+		return rva;
 	}
 
 	// Handle PE with a single section
@@ -368,20 +1059,13 @@ uint64_t pe_ofs2rva(const pe_ctx_t *ctx, uint64_t ofs) {
 	if (ofs == 0 || ctx->pe.sections == NULL)
 		return 0;
 
-	for (uint32_t i=0; i < ctx->pe.num_sections; i++) {
-		if (ctx->pe.sections[i] == NULL)
-			return 0;
-
-		if (ctx->pe.sections[i]->PointerToRawData <= ofs) {
-			if ((ctx->pe.sections[i]->PointerToRawData +
-			 ctx->pe.sections[i]->SizeOfRawData) > ofs) {
-			 	ofs -= ctx->pe.sections[i]->PointerToRawData;
-				ofs += ctx->pe.sections[i]->VirtualAddress;
-				return ofs;
-			}
-		}
-	}
-	return 0;
+	const int32_t i = section_map_lookup(&ctx->pe.section_index.ofs2rva, ofs);
+	if (i < 0)
+		return 0;
+
+	ofs -= ctx->pe.sections[i]->PointerToRawData;
+	ofs += ctx->pe.sections[i]->VirtualAddress;
+	return ofs;
 }
 
 IMAGE_DOS_HEADER *pe_dos(pe_ctx_t *ctx) {
@@ -84,7 +84,7 @@ void pe_resources_dealloc_node_search_result(pe_resource_node_search_result_t *r
 	pe_resource_node_search_result_item_t *item = result->items;
 	while (item != NULL) {
 		pe_resource_node_search_result_item_t *next = item->next;
-		free(item);
+		pe_free(item);
 		item = next;
 	}
 }
@@ -97,7 +97,7 @@ void pe_resource_search_nodes(pe_resource_node_search_result_t *result, const pe
 
 	if (predicate(node)) {
 		// Found the matching node. Return it.
-		pe_resource_node_search_result_item_t *item = calloc(1, sizeof(*item));
+		pe_resource_node_search_result_item_t *item = pe_calloc(1, sizeof(*item));
 		if (item == NULL) {
 			// TODO: Handle allocation failure.
 			abort();
@@ -397,11 +397,11 @@ static void pe_resource_debug_nodes(pe_ctx_t *ctx, const pe_resource_node_t *nod
 }
 #endif
 
-static pe_resource_node_t *pe_resource_create_node(uint8_t depth, pe_resource_node_type_e type, void *raw_ptr, pe_resource_node_t *parent_node) {
-	pe_resource_node_t *node = calloc(1, sizeof(pe_resource_node_t));
+static pe_resource_node_t *pe_resource_create_node(pe_ctx_t *ctx, uint8_t depth, pe_resource_node_type_e type, void *raw_ptr, pe_resource_node_t *parent_node) {
+	pe_resource_node_t *node = pe_arena_calloc(ctx->arena, 1, sizeof(pe_resource_node_t));
 	if (node == NULL) {
-		// TODO: Handle allocation failure.
-		abort();
+		ctx->cached_data.resources->err = LIBPE_E_ALLOCATION_FAILURE;
+		return NULL;
 	}
 	node->depth = depth;
 	node->type = type;
@@ -456,18 +456,10 @@ static pe_resource_node_t *pe_resource_create_node(uint8_t depth, pe_resource_no
 	return node;
 }
 
-static void pe_resource_free_nodes(pe_resource_node_t *node) {
+static bool pe_resource_parse_nodes(pe_ctx_t *ctx, pe_resource_node_t *node) {
 	if (node == NULL)
-		return;
-
-	pe_resource_free_nodes(node->childNode);
-	pe_resource_free_nodes(node->nextNode);
-
-	free(node->name);
-	free(node);
-}
+		return false;
 
-static bool pe_resource_parse_nodes(pe_ctx_t *ctx, pe_resource_node_t *node) {
 	switch (node->type) {
 		default:
 			LIBPE_WARNING("Invalid node type");
@@ -485,7 +477,7 @@ static bool pe_resource_parse_nodes(pe_ctx_t *ctx, pe_resource_node_t *node) {
 					break;
 				}
 
-				pe_resource_node_t *new_node = pe_resource_create_node(node->depth + 1, LIBPE_RDT_DIRECTORY_ENTRY, entry, node);
+				pe_resource_node_t *new_node = pe_resource_create_node(ctx, node->depth + 1, LIBPE_RDT_DIRECTORY_ENTRY, entry, node);
 				pe_resource_parse_nodes(ctx, new_node);
 			}
 			break;
@@ -506,9 +498,15 @@ static bool pe_resource_parse_nodes(pe_ctx_t *ctx, pe_resource_node_t *node) {
 					return NULL;
 				}
 
-				node->name = pe_resource_parse_string_u(ctx, NULL, 0, data_string_ptr);
+				const size_t name_size = (size_t)data_string_ptr->Length + 1;
+				node->name = pe_arena_alloc(ctx->arena, name_size);
+				if (node->name == NULL) {
+					ctx->cached_data.resources->err = LIBPE_E_ALLOCATION_FAILURE;
+					return false;
+				}
+				node->name = pe_resource_parse_string_u(ctx, node->name, name_size, data_string_ptr);
 
-				new_node = pe_resource_create_node(node->depth + 1, LIBPE_RDT_DATA_STRING, data_string_ptr, node);
+				new_node = pe_resource_create_node(ctx, node->depth + 1, LIBPE_RDT_DATA_STRING, data_string_ptr, node);
 				pe_resource_parse_nodes(ctx, new_node);
 			}
 
@@ -519,14 +517,14 @@ static bool pe_resource_parse_nodes(pe_ctx_t *ctx, pe_resource_node_t *node) {
 					LIBPE_WARNING("Cannot read IMAGE_RESOURCE_DIRECTORY");
 					break;
 				}
-				new_node = pe_resource_create_node(node->depth + 1, LIBPE_RDT_RESOURCE_DIRECTORY, child_resdir_ptr, node);
+				new_node = pe_resource_create_node(ctx, node->depth + 1, LIBPE_RDT_RESOURCE_DIRECTORY, child_resdir_ptr, node);
 			} else { // Not a directory
 				IMAGE_RESOURCE_DATA_ENTRY *data_entry_ptr = LIBPE_PTR_ADD(ctx->cached_data.resources->resource_base_ptr, entry_ptr->u1.data.OffsetToDirectory);
 				if (!pe_can_read(ctx, data_entry_ptr, sizeof(IMAGE_RESOURCE_DATA_ENTRY))) {
 					LIBPE_WARNING("Cannot read IMAGE_RESOURCE_DATA_ENTRY");
 					break;
 				}
-				new_node = pe_resource_create_node(node->depth + 1, LIBPE_RDT_DATA_ENTRY, data_entry_ptr, node);
+				new_node = pe_resource_create_node(ctx, node->depth + 1, LIBPE_RDT_DATA_ENTRY, data_entry_ptr, node);
 			}
 
 			pe_resource_parse_nodes(ctx, new_node);
@@ -572,7 +570,7 @@ static bool pe_resource_parse_nodes(pe_ctx_t *ctx, pe_resource_node_t *node) {
 }
 
 static pe_resource_node_t *pe_resource_parse(pe_ctx_t *ctx, void *resource_base_ptr) {
-	pe_resource_node_t *root_node = pe_resource_create_node(0, LIBPE_RDT_RESOURCE_DIRECTORY, resource_base_ptr, NULL);
+	pe_resource_node_t *root_node = pe_resource_create_node(ctx, 0, LIBPE_RDT_RESOURCE_DIRECTORY, resource_base_ptr, NULL);
 	pe_resource_parse_nodes(ctx, root_node);
 	//pe_resource_debug_nodes(ctx, root_node);
 	return root_node;
@@ -604,14 +602,16 @@ static void *pe_resource_base_ptr(pe_ctx_t *ctx) {
 	return ptr;
 }
 
-pe_resources_t *pe_resources(pe_ctx_t *ctx) {
+static pe_resources_t *load_resources(pe_ctx_t *ctx) {
 	if (ctx->cached_data.resources != NULL)
 		return ctx->cached_data.resources;
 
-	pe_resources_t *res_ptr = calloc(1, sizeof(pe_resources_t));
+	pe_map_file(ctx);
+
+	pe_resources_t *res_ptr = pe_arena_calloc(ctx->arena, 1, sizeof(pe_resources_t));
 	if (res_ptr == NULL) {
-		// TODO: Handle allocation failure.
-		abort();
+		// TODO(jweyrich): Should we report an error? If yes, we need a redesign.
+		return NULL;
 	}
 
 	ctx->cached_data.resources = res_ptr;
@@ -624,9 +624,14 @@ pe_resources_t *pe_resources(pe_ctx_t *ctx) {
 	return ctx->cached_data.resources;
 }
 
+pe_resources_t *pe_resources(pe_ctx_t *ctx) {
+	pthread_mutex_lock(&ctx->cached_locks.resources);
+	pe_resources_t *result = load_resources(ctx);
+	pthread_mutex_unlock(&ctx->cached_locks.resources);
+	return result;
+}
+
 void pe_resources_dealloc(pe_resources_t *obj) {
-	if (obj == NULL)
-		return;
-	pe_resource_free_nodes(obj->root_node);
-	free(obj);
+	// Nothing to do. It lives in the context arena and is released by pe_unload.
+	(void)obj;
 }
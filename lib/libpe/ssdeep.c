@@ -0,0 +1,278 @@
+/*
+    libpe - the PE library
+
+    Copyright (C) 2010 - 2023 libpe authors
+
+    This file is part of libpe.
+
+    libpe is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libpe is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with libpe.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "libpe/hashes.h"
+
+#include "libpe/pe.h"
+#include "libfuzzy/fuzzy.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Rows a thread claims at once: entries of the set for pe_ssdeep_compare_set,
+// and first entries of a pair for pe_ssdeep_compare_pairs, whose rows hold
+// up to set->count comparisons each.
+#define SSDEEP_SET_BATCH   4096
+#define SSDEEP_PAIRS_BATCH 16
+
+pe_err_e pe_ssdeep_set_add(pe_ssdeep_set_t *set, const char *signature) {
+	struct fuzzy_prepared prepared;
+	if (fuzzy_prepare(signature, &prepared) != 0 || prepared.malformed)
+		return LIBPE_E_INVALID_SSDEEP;
+
+	if (set->count == set->capacity) {
+		const size_t capacity = set->capacity ? 2 * set->capacity : 64;
+		if (capacity > SIZE_MAX / sizeof(struct fuzzy_prepared))
+			return LIBPE_E_ALLOCATION_FAILURE;
+
+		struct fuzzy_prepared *signatures = pe_malloc(capacity * sizeof(struct fuzzy_prepared));
+		if (signatures == NULL)
+			return LIBPE_E_ALLOCATION_FAILURE;
+		if (set->count > 0)
+			memcpy(signatures, set->signatures, set->count * sizeof(struct fuzzy_prepared));
+
+		pe_free(set->signatures);
+		set->signatures = signatures;
+		set->capacity = capacity;
+	}
+
+	set->signatures[set->count++] = prepared;
+	return LIBPE_E_OK;
+}
+
+void pe_ssdeep_set_dealloc(pe_ssdeep_set_t *set) {
+	if (set == NULL)
+		return;
+
+	pe_free(set->signatures);
+	memset(set, 0, sizeof(*set)); // Ready to be filled again
+}
+
+void pe_ssdeep_matches_dealloc(pe_ssdeep_matches_t *obj) {
+	if (obj == NULL)
+		return;
+
+	pe_free(obj->matches);
+	pe_free(obj);
+}
+
+// Work shared by the threads of a comparison. Each thread claims the next
+// `batch` unclaimed rows until none is left.
+typedef struct {
+	const pe_ssdeep_set_t *set;
+	size_t rows;
+	size_t batch;
+	size_t next;
+	pthread_mutex_t lock;
+	const struct fuzzy_prepared *signature; // pe_ssdeep_compare_set
+	int *scores;
+	int min_score;                          // pe_ssdeep_compare_pairs
+} ssdeep_work_t;
+
+typedef struct {
+	ssdeep_work_t *work;
+	pe_ssdeep_match_t *matches; // Found by this thread
+	size_t count;
+	size_t capacity;
+	pe_err_e err;
+} ssdeep_worker_t;
+
+static bool claim_rows(ssdeep_work_t *work, size_t *begin, size_t *end) {
+	pthread_mutex_lock(&work->lock);
+	const size_t left = work->rows - work->next;
+	*begin = work->next;
+	*end = *begin + (left < work->batch ? left : work->batch);
+	work->next = *end;
+	pthread_mutex_unlock(&work->lock);
+	return *begin < *end;
+}
+
+static bool add_match(ssdeep_worker_t *worker, size_t first, size_t second, int score) {
+	if (worker->count == worker->capacity) {
+		const size_t capacity = worker->capacity ? 2 * worker->capacity : 256;
+		if (capacity > SIZE_MAX / sizeof(pe_ssdeep_match_t))
+			return false;
+
+		pe_ssdeep_match_t *matches = pe_malloc(capacity * sizeof(pe_ssdeep_match_t));
+		if (matches == NULL)
+			return false;
+		if (worker->count > 0)
+			memcpy(matches, worker->matches, worker->count * sizeof(pe_ssdeep_match_t));
+
+		pe_free(worker->matches);
+		worker->matches = matches;
+		worker->capacity = capacity;
+	}
+
+	pe_ssdeep_match_t *match = &worker->matches[worker->count++];
+	match->first = first;
+	match->second = second;
+	match->score = score;
+	return true;
+}
+
+static void *compare_set_worker(void *arg) {
+	ssdeep_worker_t *worker = arg;
+	ssdeep_work_t *work = worker->work;
+	const struct fuzzy_prepared *signatures = work->set->signatures;
+
+	size_t begin, end;
+	while (claim_rows(work, &begin, &end)) {
+		for (size_t i=begin; i < end; i++)
+			work->scores[i] = fuzzy_compare_prepared(work->signature, &signatures[i]);
+	}
+
+	return NULL;
+}
+
+static void *compare_pairs_worker(void *arg) {
+	ssdeep_worker_t *worker = arg;
+	ssdeep_work_t *work = worker->work;
+	const struct fuzzy_prepared *signatures = work->set->signatures;
+
+	size_t begin, end;
+	while (worker->err == LIBPE_E_OK && claim_rows(work, &begin, &end)) {
+		for (size_t i=begin; i < end && worker->err == LIBPE_E_OK; i++) {
+			for (size_t j=i + 1; j < work->rows; j++) {
+				const int score = fuzzy_compare_prepared(&signatures[i], &signatures[j]);
+				if (score >= work->min_score && !add_match(worker, i, j, score)) {
+					worker->err = LIBPE_E_ALLOCATION_FAILURE;
+					break;
+				}
+			}
+		}
+	}
+
+	return NULL;
+}
+
+// Runs `fn` on up to `jobs` workers, the calling thread being the first one.
+// Returns how many ran.
+static unsigned int run_workers(ssdeep_work_t *work, ssdeep_worker_t *workers, unsigned int jobs, void *(*fn)(void *)) {
+	if (jobs == 0) {
+		const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		jobs = cpus > 0 ? (unsigned int)cpus : 1;
+	}
+	if (jobs > LIBPE_HASH_MAX_JOBS)
+		jobs = LIBPE_HASH_MAX_JOBS;
+	const size_t batches = (work->rows + work->batch - 1) / work->batch;
+	if (jobs > batches)
+		jobs = batches > 0 ? (unsigned int)batches : 1;
+
+	for (unsigned int i=0; i < jobs; i++) {
+		memset(&workers[i], 0, sizeof(workers[i]));
+		workers[i].work = work;
+		workers[i].err = LIBPE_E_OK;
+	}
+
+	pthread_mutex_init(&work->lock, NULL);
+
+	pthread_t threads[LIBPE_HASH_MAX_JOBS];
+	unsigned int started = 0;
+	while (started + 1 < jobs) {
+		if (pthread_create(&threads[started], NULL, fn, &workers[started + 1]) != 0)
+			break; // The remaining rows are picked up by the threads already running.
+		started++;
+	}
+
+	fn(&workers[0]);
+
+	for (unsigned int i=0; i < started; i++)
+		pthread_join(threads[i], NULL);
+
+	pthread_mutex_destroy(&work->lock);
+	return started + 1;
+}
+
+pe_err_e pe_ssdeep_compare_set(const pe_ssdeep_set_t *set, const char *signature, int *scores, unsigned int jobs) {
+	struct fuzzy_prepared prepared;
+	if (fuzzy_prepare(signature, &prepared) != 0 || prepared.malformed)
+		return LIBPE_E_INVALID_SSDEEP;
+
+	ssdeep_work_t work = {
+		.set = set,
+		.rows = set->count,
+		.batch = SSDEEP_SET_BATCH,
+		.signature = &prepared,
+		.scores = scores
+	};
+	ssdeep_worker_t workers[LIBPE_HASH_MAX_JOBS];
+	run_workers(&work, workers, jobs, compare_set_worker);
+
+	return LIBPE_E_OK;
+}
+
+static int compare_matches(const void *a, const void *b) {
+	const pe_ssdeep_match_t *match_a = a;
+	const pe_ssdeep_match_t *match_b = b;
+	if (match_a->first != match_b->first)
+		return match_a->first < match_b->first ? -1 : 1;
+	if (match_a->second != match_b->second)
+		return match_a->second < match_b->second ? -1 : 1;
+	return 0;
+}
+
+pe_ssdeep_matches_t *pe_ssdeep_compare_pairs(const pe_ssdeep_set_t *set, int min_score, unsigned int jobs) {
+	pe_ssdeep_matches_t *result = pe_calloc(1, sizeof(pe_ssdeep_matches_t));
+	if (result == NULL)
+		return NULL;
+
+	result->err = LIBPE_E_OK;
+
+	ssdeep_work_t work = {
+		.set = set,
+		.rows = set->count,
+		.batch = SSDEEP_PAIRS_BATCH,
+		.min_score = min_score
+	};
+	ssdeep_worker_t workers[LIBPE_HASH_MAX_JOBS];
+	const unsigned int ran = run_workers(&work, workers, jobs, compare_pairs_worker);
+
+	// Each worker holds the matches of the rows it claimed, so they are
+	// gathered and put back in row order.
+	size_t total = 0;
+	for (unsigned int i=0; i < ran; i++) {
+		if (workers[i].err != LIBPE_E_OK)
+			result->err = workers[i].err;
+		total += workers[i].count;
+	}
+
+	if (result->err == LIBPE_E_OK && total > 0) {
+		result->matches = pe_malloc(total * sizeof(pe_ssdeep_match_t));
+		if (result->matches == NULL) {
+			result->err = LIBPE_E_ALLOCATION_FAILURE;
+		} else {
+			for (unsigned int i=0; i < ran; i++) {
+				if (workers[i].count > 0)
+					memcpy(result->matches + result->count, workers[i].matches, workers[i].count * sizeof(pe_ssdeep_match_t));
+				result->count += workers[i].count;
+			}
+			qsort(result->matches, result->count, sizeof(pe_ssdeep_match_t), compare_matches);
+		}
+	}
+
+	for (unsigned int i=0; i < ran; i++)
+		pe_free(workers[i].matches);
+
+	return result;
+}
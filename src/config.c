@@ -37,6 +37,7 @@
 #include "config.h"
 #include <libpe/utils.h>
 #include <libpe/error.h>
+#include <libpe/pe.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdarg.h>
@@ -65,6 +66,18 @@ static bool _load_config_cb(pev_config_t * const config, const char *name, const
 		return true;
 	}
 
+	if (!strcmp("io_backend", name)) {
+		if (!strcmp("mmap", value))
+			config->load_options = 0;
+		else if (!strcmp("pread", value))
+			config->load_options = LIBPE_OPT_IO_PREAD;
+		else if (!strcmp("direct", value))
+			config->load_options = LIBPE_OPT_IO_DIRECT;
+		else
+			fprintf(stderr, "WARNING: unknown io_backend '%s', using mmap\n", value);
+		return true;
+	}
+
 	return false;
 }
 
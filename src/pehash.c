@@ -54,8 +54,20 @@ typedef struct {
 		char *name;
 		uint16_t index;
 	} sections;
+	unsigned int algorithms; // pe_hash_alg_e bitmask
+	unsigned int symbol_hashes; // pe_symbol_hash_e bitmask
+	unsigned int jobs; // Threads hashing sections with --all; 0 means one per CPU
+	pe_page_hash_alg_e page_hashes; // 0 unless --page-hashes
+	uint32_t page_size;
+	char *compare_against; // File of ssdeep signatures, see load_ssdeep_list
 } options_t;
 
+// Signatures of --compare-against and the name each one is reported with.
+typedef struct {
+	pe_ssdeep_set_t set;
+	char **names; // set.count names
+} ssdeep_list_t;
+
 static void usage(void)
 {
 	static char formats[255];
@@ -70,6 +82,14 @@ static void usage(void)
 		" -h, --header <dos|coff|optional>		Hash only the header with the specified name.\n"
 		" -s, --section <section_name>			Hash only the section with the specified name.\n"
 		" --section-index <section_index>		Hash only the section at the specified index (1..n).\n"
+		" --algorithms <md5,sha1,sha256,ssdeep,imphash,...>	Compute only the listed hashes (default: md5,sha1,sha256,ssdeep,imphash).\n"
+		"										Also available: imphash_mandiant, exphash, xxh64, xxh3, xxh128, crc32c,\n"
+		"										and checksum (the optional header CheckSum, for the file content only).\n"
+		" --page-hashes <fnv1a64|sha256>			Also hash every page of the file with the given algorithm.\n"
+		" --page-size <bytes>					Page size for --page-hashes (default: 4096).\n"
+		" --compare-against <file>				Compare the file ssdeep with each signature in <file>, as written by ssdeep.\n"
+		" -j, --jobs <N>							Hash up to N sections at once with --all, or compare on N threads\n"
+		"										with --compare-against (default: 1, 0: one per CPU).\n"
 		" -V, --version							Show version.\n"
 		" --help								Show this help.\n",
 		PROGRAM, PROGRAM, formats);
@@ -87,10 +107,69 @@ static void parse_header_name(options_t *options, const char *optarg)
 		EXIT_ERROR("invalid header name option");
 }
 
+static void parse_algorithms(options_t *options, const char *optarg)
+{
+	char *list = strdup(optarg);
+	if (list == NULL)
+		EXIT_ERROR("memory allocation failed");
+
+	options->algorithms = 0;
+	options->symbol_hashes = 0;
+
+	char *saveptr = NULL;
+	for (char *name = strtok_r(list, ",", &saveptr); name != NULL; name = strtok_r(NULL, ",", &saveptr)) {
+		if (strcmp(name, "md5") == 0)
+			options->algorithms |= LIBPE_HASH_MD5;
+		else if (strcmp(name, "sha1") == 0)
+			options->algorithms |= LIBPE_HASH_SHA1;
+		else if (strcmp(name, "sha256") == 0)
+			options->algorithms |= LIBPE_HASH_SHA256;
+		else if (strcmp(name, "ssdeep") == 0)
+			options->algorithms |= LIBPE_HASH_SSDEEP;
+		else if (strcmp(name, "xxh64") == 0)
+			options->algorithms |= LIBPE_HASH_XXH64;
+		else if (strcmp(name, "xxh3") == 0)
+			options->algorithms |= LIBPE_HASH_XXH3;
+		else if (strcmp(name, "xxh128") == 0)
+			options->algorithms |= LIBPE_HASH_XXH128;
+		else if (strcmp(name, "crc32c") == 0)
+			options->algorithms |= LIBPE_HASH_CRC32C;
+		else if (strcmp(name, "checksum") == 0)
+			options->algorithms |= LIBPE_HASH_PE_CHECKSUM;
+		else if (strcmp(name, "imphash") == 0)
+			options->symbol_hashes |= LIBPE_SYMHASH_IMPHASH_PEFILE;
+		else if (strcmp(name, "imphash_mandiant") == 0)
+			options->symbol_hashes |= LIBPE_SYMHASH_IMPHASH_MANDIANT;
+		else if (strcmp(name, "exphash") == 0)
+			options->symbol_hashes |= LIBPE_SYMHASH_EXPHASH;
+		else {
+			free(list);
+			EXIT_ERROR("invalid algorithm name");
+		}
+	}
+
+	free(list);
+
+	if (options->algorithms == 0 && options->symbol_hashes == 0)
+		EXIT_ERROR("no algorithm specified");
+}
+
+static void parse_page_hash_algorithm(options_t *options, const char *optarg)
+{
+	if (strcmp(optarg, "fnv1a64") == 0)
+		options->page_hashes = LIBPE_PAGE_HASH_FNV1A64;
+	else if (strcmp(optarg, "sha256") == 0)
+		options->page_hashes = LIBPE_PAGE_HASH_SHA256;
+	else
+		EXIT_ERROR("invalid page hash algorithm");
+}
+
 static void free_options(options_t *options)
 {
-	if (options)
+	if (options) {
 		free(options->sections.name);
+		free(options->compare_against);
+	}
 
 	free(options);
 }
@@ -100,7 +179,7 @@ static options_t *parse_options(int argc, char *argv[])
 	options_t *options = calloc_s(1, sizeof(options_t));
 
 	// parameters for getopt_long() function
-	static const char short_options[] = "f:a:c:h:s:V";
+	static const char short_options[] = "f:a:c:h:s:j:V";
 
 	static const struct option long_options[] = {
 		{ "help",		   no_argument,			NULL,  1  },
@@ -110,12 +189,20 @@ static options_t *parse_options(int argc, char *argv[])
 		{ "header",		   required_argument,	NULL, 'h' },
 		{ "section-name",  required_argument,	NULL, 's' },
 		{ "section-index", required_argument,	NULL,  2  },
+		{ "algorithms",    required_argument,	NULL,  3  },
+		{ "jobs",          required_argument,	NULL, 'j' },
+		{ "page-hashes",   required_argument,	NULL,  4  },
+		{ "page-size",     required_argument,	NULL,  5  },
+		{ "compare-against", required_argument,	NULL,  6  },
 		{ "version",	   no_argument,			NULL, 'V' },
 		{  NULL,		   0,					NULL,  0  }
 	};
 
 	// Setting the default option
 	options->content = true;
+	options->algorithms = LIBPE_HASH_ALL;
+	options->symbol_hashes = LIBPE_SYMHASH_IMPHASH_PEFILE;
+	options->jobs = 1;
 
 	int c, ind;
 	while ((c = getopt_long(argc, argv, short_options, long_options, &ind)))
@@ -153,6 +240,34 @@ static options_t *parse_options(int argc, char *argv[])
 					EXIT_ERROR("Bad argument for section-index,");
 				}
 				break;
+			case 3:
+				parse_algorithms(options, optarg);
+				break;
+			case 4:
+				parse_page_hash_algorithm(options, optarg);
+				break;
+			case 5:
+			{
+				char *end;
+				const unsigned long page_size = strtoul(optarg, &end, 10);
+				if (*optarg == '\0' || *end != '\0' || page_size == 0 || page_size > UINT32_MAX)
+					EXIT_ERROR("Bad argument for page-size");
+				options->page_size = page_size;
+				break;
+			}
+			case 6:
+				free(options->compare_against);
+				options->compare_against = strdup(optarg);
+				break;
+			case 'j':
+			{
+				char *end;
+				const long jobs = strtol(optarg, &end, 10);
+				if (*optarg == '\0' || *end != '\0' || jobs < 0 || jobs > LIBPE_HASH_MAX_JOBS)
+					EXIT_ERROR("Bad argument for jobs");
+				options->jobs = jobs;
+				break;
+			}
 			case 'V':
 				printf("%s %s\n%s\n", PROGRAM, TOOLKIT, COPY);
 				exit(EXIT_SUCCESS);
@@ -172,21 +287,246 @@ static options_t *parse_options(int argc, char *argv[])
 	return options;
 }
 
-static void print_basic_hash(const unsigned char *data, size_t data_size)
+static void print_digests(const pe_hash_digests_t *digests, unsigned int algorithms)
+{
+	if (algorithms & LIBPE_HASH_MD5)
+		output("md5", digests->md5);
+	if (algorithms & LIBPE_HASH_SHA1)
+		output("sha1", digests->sha1);
+	if (algorithms & LIBPE_HASH_SHA256)
+		output("sha256", digests->sha256);
+	if (algorithms & LIBPE_HASH_SSDEEP)
+		output("ssdeep", digests->ssdeep);
+	if (algorithms & LIBPE_HASH_XXH64)
+		output("xxh64", digests->xxh64);
+	if (algorithms & LIBPE_HASH_XXH3)
+		output("xxh3", digests->xxh3);
+	if (algorithms & LIBPE_HASH_XXH128)
+		output("xxh128", digests->xxh128);
+	if (algorithms & LIBPE_HASH_CRC32C)
+		output("crc32c", digests->crc32c);
+}
+
+static void print_basic_hash(const unsigned char *data, size_t data_size, unsigned int algorithms)
 {
-	if (!data || !data_size)
+	algorithms &= ~LIBPE_HASH_PE_CHECKSUM; // Only meaningful for the whole file
+	if (!data || !data_size || !algorithms)
+		return;
+
+	// All requested digests are computed in a single pass over the data.
+	pe_hash_multi_t multi;
+	if (pe_hash_multi_init(&multi, algorithms) != LIBPE_E_OK)
+		return;
+	if (pe_hash_multi_update(&multi, data, data_size) != LIBPE_E_OK) {
+		pe_hash_multi_cleanup(&multi);
 		return;
+	}
+
+	pe_hash_digests_t digests;
+	if (pe_hash_multi_final(&multi, &digests) == LIBPE_E_OK)
+		print_digests(&digests, algorithms);
+}
+
+static void print_hash(const pe_hash_t *hash, unsigned int algorithms)
+{
+	if ((algorithms & LIBPE_HASH_MD5) && hash->md5)
+		output("md5", hash->md5);
+	if ((algorithms & LIBPE_HASH_SHA1) && hash->sha1)
+		output("sha1", hash->sha1);
+	if ((algorithms & LIBPE_HASH_SHA256) && hash->sha256)
+		output("sha256", hash->sha256);
+	if ((algorithms & LIBPE_HASH_SSDEEP) && hash->ssdeep)
+		output("ssdeep", hash->ssdeep);
+	if ((algorithms & LIBPE_HASH_XXH64) && hash->xxh64)
+		output("xxh64", hash->xxh64);
+	if ((algorithms & LIBPE_HASH_XXH3) && hash->xxh3)
+		output("xxh3", hash->xxh3);
+	if ((algorithms & LIBPE_HASH_XXH128) && hash->xxh128)
+		output("xxh128", hash->xxh128);
+	if ((algorithms & LIBPE_HASH_CRC32C) && hash->crc32c)
+		output("crc32c", hash->crc32c);
+}
 
-	const char *basic_hashes[] = { "md5", "sha1", "sha256", "ssdeep" };
-	const size_t hash_value_size = pe_hash_recommended_size();
-	char *hash_value = malloc_s(hash_value_size);
+static void print_page_hashes(pe_ctx_t *ctx, pe_page_hash_alg_e algorithm, uint32_t page_size)
+{
+	pe_page_hashes_t *pages = pe_get_page_hashes(ctx, algorithm, page_size);
+	if (pages == NULL)
+		EXIT_ERROR("unable to hash pages");
+	if (pages->err != LIBPE_E_OK)
+		pe_error_print(stderr, pages->err);
+
+	output_open_scope("pages", OUTPUT_SCOPE_TYPE_ARRAY);
+	char offset[32];
+	char hash[2 * 32 + 1];
+	for (uint64_t i=0; i < pages->count; i++) {
+		const uint8_t *digest = pages->digests + i * pages->digest_size;
+		for (size_t j=0; j < pages->digest_size; j++)
+			sprintf(&hash[j * 2], "%02x", digest[j]);
+
+		snprintf(offset, sizeof(offset), "%#"PRIx64, i * pages->page_size);
+		output_open_scope("page", OUTPUT_SCOPE_TYPE_OBJECT);
+		output("offset", offset);
+		output(algorithm == LIBPE_PAGE_HASH_SHA256 ? "sha256" : "fnv1a64", hash);
+		output_close_scope(); // page
+	}
+	output_close_scope(); // pages
+
+	pe_page_hashes_dealloc(pages);
+}
+
+// Like print_basic_hash, but streams the range through the configured I/O backend.
+// The `extra_algorithms` are computed in the same pass, into `digests`, without
+// being printed.
+static bool print_file_range_hash(pe_ctx_t *ctx, uint64_t offset, uint64_t size, unsigned int algorithms,
+	unsigned int extra_algorithms, pe_hash_digests_t *digests)
+{
+	if (!size || !(algorithms | extra_algorithms))
+		return false;
 
-	for (size_t i=0; i < sizeof(basic_hashes) / sizeof(char *); i++) {
-		pe_hash_raw_data(hash_value, hash_value_size, basic_hashes[i], data, data_size);
-		output(basic_hashes[i], hash_value);
+	const pe_err_e err = pe_hash_file_range(ctx, algorithms | extra_algorithms, offset, size, digests);
+	if (err != LIBPE_E_OK) {
+		pe_error_print(stderr, err);
+		return false;
 	}
+	print_digests(digests, algorithms);
 
-	free(hash_value);
+	// Computed in the same pass as the digests.
+	if (algorithms & LIBPE_HASH_PE_CHECKSUM) {
+		char checksum[16];
+		snprintf(checksum, sizeof(checksum), "%#"PRIx32, digests->pe_checksum);
+		output("checksum", checksum);
+	}
+
+	return true;
+}
+
+// The name after the signature on a line of an ssdeep file, unquoted, or the
+// signature itself when there is none.
+static char *ssdeep_line_name(const char *line)
+{
+	const char *name = strchr(line, ':');
+	if (name != NULL)
+		name = strchr(name + 1, ':');
+	if (name != NULL)
+		name = strchr(name + 1, ',');
+	if (name == NULL)
+		return strdup(line);
+
+	name++;
+	size_t len = strlen(name);
+	if (len >= 2 && name[0] == '"' && name[len - 1] == '"') {
+		name++;
+		len -= 2;
+	}
+	return strndup(name, len);
+}
+
+// Reads the signatures of an ssdeep file, one per line, each optionally
+// followed by a comma and a name. The "ssdeep," header line, empty lines and
+// lines starting with '#' are skipped.
+static void load_ssdeep_list(ssdeep_list_t *list, const char *path)
+{
+	FILE *fp = fopen(path, "r");
+	if (fp == NULL)
+		EXIT_ERROR("unable to open the --compare-against file");
+
+	char *line = NULL;
+	size_t line_size = 0;
+	size_t names_capacity = 0;
+	unsigned long line_number = 0;
+	ssize_t len;
+
+	while ((len = getline(&line, &line_size, fp)) != -1) {
+		line_number++;
+		while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+			line[--len] = '\0';
+		if (len == 0 || line[0] == '#' || strncmp(line, "ssdeep,", 7) == 0)
+			continue;
+
+		const pe_err_e err = pe_ssdeep_set_add(&list->set, line);
+		if (err == LIBPE_E_INVALID_SSDEEP) {
+			fprintf(stderr, "%s: %s:%lu: invalid ssdeep signature\n", PROGRAM, path, line_number);
+			exit(EXIT_FAILURE);
+		} else if (err != LIBPE_E_OK) {
+			EXIT_ERROR("memory allocation failed");
+		}
+
+		if (list->set.count > names_capacity) {
+			names_capacity = names_capacity ? 2 * names_capacity : 64;
+			char **names = realloc(list->names, names_capacity * sizeof(char *));
+			if (names == NULL)
+				EXIT_ERROR("memory allocation failed");
+			list->names = names;
+		}
+		list->names[list->set.count - 1] = ssdeep_line_name(line);
+		if (list->names[list->set.count - 1] == NULL)
+			EXIT_ERROR("memory allocation failed");
+	}
+
+	free(line);
+	fclose(fp);
+}
+
+static void free_ssdeep_list(ssdeep_list_t *list)
+{
+	for (size_t i=0; i < list->set.count; i++)
+		free(list->names[i]);
+	free(list->names);
+	pe_ssdeep_set_dealloc(&list->set);
+}
+
+typedef struct {
+	size_t index;
+	int score;
+} ssdeep_match_t;
+
+static int compare_ssdeep_matches(const void *a, const void *b)
+{
+	const ssdeep_match_t *match_a = a;
+	const ssdeep_match_t *match_b = b;
+	if (match_a->score != match_b->score)
+		return match_a->score > match_b->score ? -1 : 1;
+	return match_a->index < match_b->index ? -1 : match_a->index > match_b->index;
+}
+
+// Prints the signatures of the list matching `ssdeep`, best first.
+static void print_ssdeep_matches(const char *ssdeep, const ssdeep_list_t *list, unsigned int jobs)
+{
+	const size_t count = list->set.count;
+	int *scores = malloc_s((count + 1) * sizeof(int));
+	ssdeep_match_t *matches = malloc_s((count + 1) * sizeof(ssdeep_match_t));
+
+	const pe_err_e err = pe_ssdeep_compare_set(&list->set, ssdeep, scores, jobs);
+	if (err != LIBPE_E_OK) {
+		pe_error_print(stderr, err);
+		free(matches);
+		free(scores);
+		return;
+	}
+
+	size_t num_matches = 0;
+	for (size_t i=0; i < count; i++) {
+		if (scores[i] > 0) {
+			matches[num_matches].index = i;
+			matches[num_matches].score = scores[i];
+			num_matches++;
+		}
+	}
+	qsort(matches, num_matches, sizeof(ssdeep_match_t), compare_ssdeep_matches);
+
+	output_open_scope("matches", OUTPUT_SCOPE_TYPE_ARRAY);
+	char score[16];
+	for (size_t i=0; i < num_matches; i++) {
+		snprintf(score, sizeof(score), "%d", matches[i].score);
+		output_open_scope("match", OUTPUT_SCOPE_TYPE_OBJECT);
+		output("name", list->names[matches[i].index]);
+		output("score", score);
+		output_close_scope(); // match
+	}
+	output_close_scope(); // matches
+
+	free(matches);
+	free(scores);
 }
 
 int main(int argc, char *argv[])
@@ -203,9 +543,13 @@ int main(int argc, char *argv[])
 
 	options_t *options = parse_options(argc, argv);
 
+	ssdeep_list_t ssdeep_list = { 0 };
+	if (options->compare_against)
+		load_ssdeep_list(&ssdeep_list, options->compare_against);
+
 	pe_ctx_t ctx;
 
-	pe_err_e err = pe_load_file(&ctx, argv[argc-1]);
+	pe_err_e err = pe_load_file_ext(&ctx, argv[argc-1], config.load_options);
 	if (err != LIBPE_E_OK) {
 		pe_error_print(stderr, err);
 		return EXIT_FAILURE;
@@ -227,9 +571,6 @@ int main(int argc, char *argv[])
 	unsigned c = pe_sections_count(&ctx);
 	IMAGE_SECTION_HEADER ** const sections = pe_sections(&ctx);
 
-	data = ctx.map_addr;
-	data_size = pe_filesize(&ctx);
-
 	output_open_document();
 
 	if (options->headers.all || options->headers.dos || options->headers.coff || options->headers.optional ||
@@ -246,22 +587,31 @@ int main(int argc, char *argv[])
 	if (options->content) {
 		output_open_scope("file", OUTPUT_SCOPE_TYPE_OBJECT);
 		output("filepath", ctx.path);
-		print_basic_hash(data, data_size);
+		pe_hash_digests_t digests;
+		const bool hashed = print_file_range_hash(&ctx, 0, pe_filesize(&ctx), options->algorithms,
+			options->compare_against ? LIBPE_HASH_SSDEEP : 0, &digests);
+
+		// All requested import/export hashes come from a single walk of each table.
+		pe_symbol_hashes_t symbol_hashes;
+		err = pe_get_symbol_hashes(&ctx, options->symbol_hashes, &symbol_hashes);
+		if (err != LIBPE_E_OK)
+			pe_error_print(stderr, err);
+
+		if (symbol_hashes.imphash_pefile[0] != '\0')
+			output("imphash", symbol_hashes.imphash_pefile);
+		if (symbol_hashes.imphash_mandiant[0] != '\0')
+			output("imphash_mandiant", symbol_hashes.imphash_mandiant);
+		if (symbol_hashes.exphash[0] != '\0')
+			output("exphash", symbol_hashes.exphash);
+		
+		output_close_scope(); // file
 
-		char *imphash = NULL;
+		if (options->compare_against && hashed)
+			print_ssdeep_matches(digests.ssdeep, &ssdeep_list, options->jobs);
 
-		// imphash = pe_imphash(&ctx, LIBPE_IMPHASH_FLAVOR_MANDIANT);
-		// output("imphash (Mandiant)", imphash);
-		// free(imphash);
+		if (options->page_hashes)
+			print_page_hashes(&ctx, options->page_hashes, options->page_size);
 
-		imphash = pe_imphash(&ctx, LIBPE_IMPHASH_FLAVOR_PEFILE);
-		
-		if (imphash) {
-			output("imphash", imphash);
-			free(imphash);
-		}
-		
-		output_close_scope(); // file
 		if (!options->all) // whole file content only
 			goto BYE;
 	}
@@ -282,7 +632,7 @@ int main(int argc, char *argv[])
 
 		output_open_scope("header", OUTPUT_SCOPE_TYPE_OBJECT);
 		output("header_name", "IMAGE_DOS_HEADER");
-		print_basic_hash(data, data_size);
+		print_basic_hash(data, data_size, options->algorithms);
 		output_close_scope(); // header
 	}
 
@@ -293,7 +643,7 @@ int main(int argc, char *argv[])
 
 		output_open_scope("header", OUTPUT_SCOPE_TYPE_OBJECT);
 		output("header_name", "IMAGE_COFF_HEADER");
-		print_basic_hash(data, data_size);
+		print_basic_hash(data, data_size, options->algorithms);
 		output_close_scope(); // header
 	}
 
@@ -324,7 +674,7 @@ int main(int argc, char *argv[])
 
 		output_open_scope("header", OUTPUT_SCOPE_TYPE_OBJECT);
 		output("header_name", "IMAGE_OPTIONAL_HEADER");
-		print_basic_hash(data, data_size);
+		print_basic_hash(data, data_size, options->algorithms);
 		output_close_scope(); // header
 	}
 
@@ -335,18 +685,32 @@ int main(int argc, char *argv[])
 		output_open_scope("sections", OUTPUT_SCOPE_TYPE_ARRAY);
 
 	if (options->all) {
+		// Sections are hashed concurrently by libpe, which keeps them in section order
+		// and, like the loop below, skips unreadable and empty ones. File-level digests
+		// such as the PE checksum don't apply to sections, so without any other the
+		// section data isn't read at all.
+		const pe_hash_sections_t *hashes = NULL;
+		if (options->algorithms & (LIBPE_HASH_ALL | LIBPE_HASH_FAST)) {
+			hashes = pe_get_sections_hash_parallel(&ctx, options->algorithms, options->jobs);
+			if (hashes == NULL)
+				EXIT_ERROR("unable to hash sections");
+			if (hashes->err != LIBPE_E_OK)
+				pe_error_print(stderr, hashes->err);
+		}
+
+		const uint64_t file_size = pe_filesize(&ctx);
+		uint32_t next_hash = 0;
 		for (unsigned int i=0; i<c; i++) {
-			data_size = sections[i]->SizeOfRawData;
-			data = LIBPE_PTR_ADD(ctx.map_addr, sections[i]->PointerToRawData);
+			const uint64_t section_offset = sections[i]->PointerToRawData;
+			const uint64_t section_size = sections[i]->SizeOfRawData;
 
-			if (!pe_can_read(&ctx, data, data_size)) {
+			if (section_offset > file_size || section_size > file_size - section_offset) {
 				LIBPE_WARNING("Unable to read section data");
 			} else {
 				output_open_scope("section", OUTPUT_SCOPE_TYPE_OBJECT);
 				output("section_name", (char *)sections[i]->Name);
-				if (data_size) {
-					print_basic_hash(data, data_size);
-				}
+				if (section_size && hashes != NULL && next_hash < hashes->count)
+					print_hash(hashes->sections[next_hash++], options->algorithms);
 				output_close_scope(); // section
 			}
 		}
@@ -387,7 +751,7 @@ int main(int argc, char *argv[])
 	if (!options->all && data != NULL) {
 		output_open_scope("section", OUTPUT_SCOPE_TYPE_OBJECT);
 		output("section_name", options->sections.name);
-		print_basic_hash(data, data_size);
+		print_basic_hash(data, data_size, options->algorithms);
 		output_close_scope();
 	}
 
@@ -398,6 +762,7 @@ BYE:
 	output_close_document();
 
 	// free
+	free_ssdeep_list(&ssdeep_list);
 	free_options(options);
 
 	err = pe_unload(&ctx);
@@ -409,6 +409,23 @@ static void print_timestamp(const options_t *options, const IMAGE_COFF_HEADER *h
 	output("timestamp", value);
 }
 
+static bool read_checksums(pe_ctx_t *ctx, const IMAGE_OPTIONAL_HEADER *optional, uint32_t *stored, uint32_t *computed)
+{
+	if (optional->_32)
+		*stored = optional->_32->CheckSum;
+	else if (optional->_64)
+		*stored = optional->_64->CheckSum;
+	else
+		return false;
+
+	const pe_err_e err = pe_compute_checksum(ctx, computed);
+	if (err != LIBPE_E_OK) {
+		pe_error_print(stderr, err);
+		return false;
+	}
+	return true;
+}
+
 static int8_t cpl_analysis(pe_ctx_t *ctx)
 {
 	const IMAGE_COFF_HEADER *hdr_coff_ptr = pe_coff(ctx);
@@ -470,7 +487,7 @@ int main(int argc, char *argv[])
 	const char *path = argv[argc-1];
 	pe_ctx_t ctx;
 
-	pe_err_e err = pe_load_file(&ctx, path);
+	pe_err_e err = pe_load_file_ext(&ctx, path, config.load_options);
 	if (err != LIBPE_E_OK) {
 		pe_error_print(stderr, err);
 		return EXIT_FAILURE;
@@ -563,6 +580,25 @@ int main(int argc, char *argv[])
 
 	output("DOS stub", value);
 
+	// checksum, which is 0 unless the linker was asked for one
+	uint32_t stored_checksum, computed_checksum;
+	if (optional != NULL && read_checksums(&ctx, optional, &stored_checksum, &computed_checksum)) {
+		if (stored_checksum == 0)
+			snprintf(value, MAX_MSG, "not set");
+		else if (stored_checksum != computed_checksum) {
+			if (options->verbose)
+				snprintf(value, MAX_MSG, "suspicious - stored: %#x - computed: %#x", stored_checksum, computed_checksum);
+			else
+				snprintf(value, MAX_MSG, "suspicious");
+		} else {
+			if (options->verbose)
+				snprintf(value, MAX_MSG, "normal - %#x", computed_checksum);
+			else
+				snprintf(value, MAX_MSG, "normal");
+		}
+		output("checksum", value);
+	}
+
 	// tls callbacks
 	int callbacks = pe_get_tls_callbacks(&ctx, options);
 
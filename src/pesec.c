@@ -228,7 +228,116 @@ static unsigned int roundBy8( unsigned int n )
   return t;
 }
 
-static int parse_pkcs7_data(const options_t *options, const CRYPT_DATA_BLOB *blob)
+#define SPC_INDIRECT_DATA_OBJID "1.3.6.1.4.1.311.2.1.4"
+
+// Reads the next DER element of `*data`, which must have the tag `tag`, and
+// advances past it.
+static bool der_next(const unsigned char **data, long *remaining, int tag,
+	const unsigned char **content, long *content_size)
+{
+	const unsigned char *p = *data;
+	long length;
+	int element_tag, element_class;
+
+	const int ret = ASN1_get_object(&p, &length, &element_tag, &element_class, *remaining);
+	if ((ret & 0x80) || (ret & 0x01) || element_tag != tag) // Error or indefinite length
+		return false;
+
+	*content = p;
+	*content_size = length;
+	*remaining -= (p + length) - *data;
+	*data = p + length;
+	return true;
+}
+
+// Extracts the image digest that was signed from the SpcIndirectDataContent of `p7`.
+static bool get_signed_digest(PKCS7 *p7, int *md_nid, const unsigned char **digest, long *digest_size)
+{
+	if (!PKCS7_type_is_signed(p7) || p7->d.sign->contents == NULL)
+		return false;
+
+	const PKCS7 *contents = p7->d.sign->contents;
+	char oid[64];
+	if (OBJ_obj2txt(oid, sizeof(oid), contents->type, 1) <= 0 || strcmp(oid, SPC_INDIRECT_DATA_OBJID) != 0)
+		return false;
+
+	const ASN1_TYPE *value = contents->d.other;
+	if (value == NULL || value->type != V_ASN1_SEQUENCE)
+		return false;
+
+	const unsigned char *data = value->value.sequence->data;
+	long remaining = value->value.sequence->length;
+	const unsigned char *indirect_data, *digest_info, *algorithm, *unused;
+	long indirect_data_size, digest_info_size, algorithm_size, unused_size;
+
+	// SpcIndirectDataContent ::= SEQUENCE { data SpcAttributeTypeAndOptionalValue, messageDigest DigestInfo }
+	if (!der_next(&data, &remaining, V_ASN1_SEQUENCE, &indirect_data, &indirect_data_size)
+		|| !der_next(&indirect_data, &indirect_data_size, V_ASN1_SEQUENCE, &unused, &unused_size)
+		|| !der_next(&indirect_data, &indirect_data_size, V_ASN1_SEQUENCE, &digest_info, &digest_info_size))
+		return false;
+
+	// DigestInfo ::= SEQUENCE { digestAlgorithm AlgorithmIdentifier, digest OCTET STRING }
+	if (!der_next(&digest_info, &digest_info_size, V_ASN1_SEQUENCE, &algorithm, &algorithm_size)
+		|| !der_next(&digest_info, &digest_info_size, V_ASN1_OCTET_STRING, digest, digest_size))
+		return false;
+
+	// AlgorithmIdentifier ::= SEQUENCE { algorithm OBJECT IDENTIFIER, parameters ANY OPTIONAL }
+	const unsigned char *oid_der = algorithm;
+	if (!der_next(&algorithm, &algorithm_size, V_ASN1_OBJECT, &unused, &unused_size))
+		return false;
+
+	ASN1_OBJECT *obj = d2i_ASN1_OBJECT(NULL, &oid_der, algorithm - oid_der);
+	if (obj == NULL)
+		return false;
+	*md_nid = OBJ_obj2nid(obj);
+	ASN1_OBJECT_free(obj);
+	return true;
+}
+
+// Prints whether the digest signed in `p7` matches the Authenticode digest of the image.
+static void print_image_digest(pe_ctx_t *ctx, PKCS7 *p7)
+{
+	int md_nid;
+	const unsigned char *signed_digest;
+	long signed_digest_size;
+
+	if (!get_signed_digest(p7, &md_nid, &signed_digest, &signed_digest_size)) {
+		LIBPE_WARNING("no SpcIndirectDataContent found in the signed data");
+		return;
+	}
+
+	unsigned int algorithm;
+	switch (md_nid) {
+		default:
+			LIBPE_WARNING("unsupported Authenticode digest algorithm");
+			return;
+		case NID_md5: algorithm = LIBPE_HASH_MD5; break;
+		case NID_sha1: algorithm = LIBPE_HASH_SHA1; break;
+		case NID_sha256: algorithm = LIBPE_HASH_SHA256; break;
+	}
+
+	pe_hash_digests_t digests;
+	const pe_err_e err = pe_authenticode_digest(ctx, algorithm, &digests);
+	if (err != LIBPE_E_OK) {
+		pe_error_print(stderr, err);
+		return;
+	}
+
+	const char *image_digest = algorithm == LIBPE_HASH_MD5 ? digests.md5
+		: algorithm == LIBPE_HASH_SHA1 ? digests.sha1
+		: digests.sha256;
+
+	char signed_digest_str[2 * EVP_MAX_MD_SIZE + 1] = "";
+	for (long i = 0; i < signed_digest_size && i < EVP_MAX_MD_SIZE; i++)
+		sprintf(&signed_digest_str[i * 2], "%02x", signed_digest[i]);
+
+	output("Digest algorithm", OBJ_nid2sn(md_nid));
+	output("Signed digest", signed_digest_str);
+	output("Image digest", image_digest);
+	output("Image digest matches", strcmp(signed_digest_str, image_digest) == 0 ? "yes" : "no");
+}
+
+static int parse_pkcs7_data(const options_t *options, pe_ctx_t *ctx, const CRYPT_DATA_BLOB *blob)
 {
 	int result = 0;
 	const cert_format_e input_fmt = CERT_FORMAT_DER;
@@ -296,6 +405,9 @@ static int parse_pkcs7_data(const options_t *options, const CRYPT_DATA_BLOB *blo
 		output("Signature", valid_sig == 1 ? "valid" : "invalid");
 	}
 
+	// Print whether the signature covers the actual content of the image
+	print_image_digest(ctx, p7);
+
 	// Print signers
 	if (numcerts > 0) {
 		output_open_scope("signers", OUTPUT_SCOPE_TYPE_ARRAY);
@@ -414,7 +526,7 @@ static void parse_certificates(const options_t *options, pe_ctx_t *ctx)
 				CRYPT_DATA_BLOB p7data;
 				p7data.cbData = cert->dwLength - offsetof(WIN_CERTIFICATE, bCertificate);
 				p7data.pbData = cert->bCertificate;
-				parse_pkcs7_data(options, &p7data);
+				parse_pkcs7_data(options, ctx, &p7data);
 				break;
 			}
 			case WIN_CERT_TYPE_TS_STACK_SIGNED:
@@ -449,7 +561,7 @@ int main(int argc, char *argv[])
 	const char *path = argv[argc-1];
 	pe_ctx_t ctx;
 
-	pe_err_e err = pe_load_file(&ctx, path);
+	pe_err_e err = pe_load_file_ext(&ctx, path, config.load_options);
 	if (err != LIBPE_E_OK) {
 		pe_error_print(stderr, err);
 		return EXIT_FAILURE;
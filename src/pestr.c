@@ -129,35 +129,25 @@ static options_t *parse_options(int argc, char *argv[])
 	return options;
 }
 
-// TODO Move it to libpe
-static unsigned char *ofs2section(pe_ctx_t *ctx, uint64_t offset)
-{
-	IMAGE_SECTION_HEADER **sections = pe_sections(ctx);
-
-	for (uint16_t i=0; i < ctx->pe.num_sections; i++) {
-		uint32_t sect_offset = sections[i]->PointerToRawData;
-		uint32_t sect_size = sections[i]->SizeOfRawData;
-
-		if (offset >= sect_offset && offset <= (sect_offset + sect_size)) {
-			return (unsigned char *)sections[i]->Name;
-		}
-	}
-
-	return NULL;
-}
-
 static void printb(	pe_ctx_t *ctx,
 					const options_t *options,
-					const uint8_t *bytes,
 					size_t pos,
 					size_t end,
 					bool is_wide) {
+	// Wide strings are read in pairs, so the byte at `end` may be needed too.
+	// It always exists, since `end` is the offset of the byte that closed the string.
+	pe_window_t window;
+	const uint8_t *bytes = pe_window_map(ctx, &window, pos, end - pos + is_wide);
+	if (bytes == NULL)
+		return;
+	bytes -= pos; // Index by file offset below.
+
 	if (options->offset)
 		printf("%#lx\t", (unsigned long) pos);
 
 	if (options->section) {
-		char *s = (char *) ofs2section(ctx, pos);
-		printf("%s\t", s ? s : "[none]");
+		const IMAGE_SECTION_HEADER *section = pe_ofs2section(ctx, pos);
+		printf("%s\t", section ? (const char *)section->Name : "[none]");
 	}
 
 	// printf("%s\t", is_wide ? "U16LE" : "U8" );
@@ -179,6 +169,92 @@ static void printb(	pe_ctx_t *ctx,
 	}
 
 	putchar('\n');
+
+	pe_window_unmap(&window);
+}
+
+// Where the strings being scanned started, or 0 if none is open.
+typedef struct {
+	size_t buff_start;
+	size_t odd_wbuff_start;
+	size_t even_wbuff_start;
+} scan_state_t;
+
+// `chunk` is the byte at `pe_raw_offset` followed by the next one, or 0 for the last byte.
+static void scan_byte(	pe_ctx_t *ctx,
+						const options_t *options,
+						scan_state_t *state,
+						size_t pe_raw_offset,
+						uint8_t byte,
+						uint16_t chunk) {
+	if (isprint(byte)) {
+		if ( state->buff_start == 0 ) {
+			state->buff_start = pe_raw_offset;
+		}
+	} else {
+		if ( state->buff_start != 0 ) {
+			if ((pe_raw_offset - state->buff_start) >= (options->strsize ? options->strsize : 4))
+				printb(ctx, options, state->buff_start, pe_raw_offset, false);
+			state->buff_start = 0;
+		}
+	}
+
+	if (iswprint(chunk)) {
+		if( pe_raw_offset & 0x1 ) {
+			if ( state->odd_wbuff_start == 0 ) {
+				state->odd_wbuff_start = pe_raw_offset;
+			}
+		} else {
+			if ( state->even_wbuff_start == 0 ) {
+				state->even_wbuff_start = pe_raw_offset;
+			}
+		}
+	} else {
+		if( pe_raw_offset & 0x1 ) {
+			if ( state->odd_wbuff_start != 0 ) {
+				if ((pe_raw_offset - state->odd_wbuff_start)/2 >= (options->strsize ? options->strsize : 4))
+					printb(ctx, options, state->odd_wbuff_start, pe_raw_offset, true);
+				state->odd_wbuff_start = 0;
+			}
+		} else {
+			if ( state->even_wbuff_start != 0 ) {
+				if ((pe_raw_offset - state->even_wbuff_start)/2 >= (options->strsize ? options->strsize : 4))
+					printb(ctx, options, state->even_wbuff_start, pe_raw_offset, true);
+				state->even_wbuff_start = 0;
+			}
+		}
+	}
+}
+
+static void scan_file(pe_ctx_t *ctx, options_t *options)
+{
+	const uint64_t pe_size = pe_filesize(ctx);
+
+	// Stream the file once, in order. Each byte is scanned when the next one
+	// arrives, since wide strings look at both.
+	scan_state_t state = { 0 };
+	pe_chunk_iter_t iter;
+	pe_chunks_begin(ctx, &iter, 0, pe_size, 0);
+	size_t pe_raw_offset = 0;
+	uint8_t prev_byte = 0;
+	const uint8_t *pe_raw_data;
+	size_t chunk_size;
+	while ((pe_raw_data = pe_chunks_next(&iter, &chunk_size)) != NULL) {
+		for (size_t i = 0; i < chunk_size; i++, pe_raw_offset++) {
+			const uint8_t byte = pe_raw_data[i];
+			if (pe_raw_offset > 0) {
+				// Byte swap; Internal PE uses little endian while C uses big endian
+				const uint16_t chunk = prev_byte | byte<<8;
+				scan_byte(ctx, options, &state, pe_raw_offset - 1, prev_byte, chunk);
+			}
+			prev_byte = byte;
+		}
+	}
+	if (iter.err != LIBPE_E_OK)
+		pe_error_print(stderr, iter.err);
+	else if (pe_raw_offset > 0)
+		scan_byte(ctx, options, &state, pe_raw_offset - 1, prev_byte, 0);
+	pe_chunks_end(&iter);
 }
 
 int main(int argc, char *argv[])
@@ -190,78 +266,25 @@ int main(int argc, char *argv[])
 
 	options_t *options = parse_options(argc, argv); // opcoes
 
+	pev_config_t config;
+	memset(&config, 0, sizeof(config));
+	pev_load_config(&config);
+
 	const char *path = argv[argc-1];
 	pe_ctx_t ctx;
 
-	pe_err_e err = pe_load_file(&ctx, path);
-	if (err != LIBPE_E_OK) {
-		pe_error_print(stderr, err);
-		return EXIT_FAILURE;
-	}
+	pe_err_e err = pe_load_file_ext(&ctx, path, config.load_options);
+	if (err == LIBPE_E_OK)
+		err = pe_parse(&ctx);
 
-	err = pe_parse(&ctx);
+	int ret = EXIT_FAILURE;
 	if (err != LIBPE_E_OK) {
 		pe_error_print(stderr, err);
-		return EXIT_FAILURE;
-	}
-
-	if (!pe_is_pe(&ctx))
-		EXIT_ERROR("not a valid PE file");
-
-	const uint64_t pe_size = pe_filesize(&ctx);
-	const uint8_t *pe_raw_data = ctx.map_addr;
-
-	uint16_t chunk;
-	size_t buff_start = 0;
-	size_t odd_wbuff_start = 0;
-	size_t even_wbuff_start = 0;
-
-	for (size_t pe_raw_offset = 0; pe_raw_offset < pe_size; ++pe_raw_offset) {
-		const uint8_t byte = pe_raw_data[pe_raw_offset];
-
-		if (pe_raw_offset+1 < pe_size)
-			// Byte swap; Internal PE uses little endian while C uses big endian
-			chunk = byte | pe_raw_data[pe_raw_offset+1]<<8;
-		else
-			chunk = 0;
-
-		if (isprint(byte)) {
-			if ( buff_start == 0 ) {
-				buff_start = pe_raw_offset;
-			}
-		} else {
-			if ( buff_start != 0 ) {
-				if ((pe_raw_offset - buff_start) >= (options->strsize ? options->strsize : 4))
-					printb(&ctx, options, pe_raw_data, buff_start, pe_raw_offset, false);
-				buff_start = 0;
-			}
-		}
-
-		if (iswprint(chunk)) {
-			if( pe_raw_offset & 0x1 ) {
-				if ( odd_wbuff_start == 0 ) {
-					odd_wbuff_start = pe_raw_offset;
-				}
-			} else {
-				if ( even_wbuff_start == 0 ) {
-					even_wbuff_start = pe_raw_offset;
-				}
-			}
-		} else {
-			if( pe_raw_offset & 0x1 ) {
-				if ( odd_wbuff_start != 0 ) {
-					if ((pe_raw_offset - odd_wbuff_start)/2 >= (options->strsize ? options->strsize : 4))
-						printb(&ctx, options, pe_raw_data, odd_wbuff_start, pe_raw_offset, true);
-					odd_wbuff_start = 0;
-				}
-			} else {
-				if ( even_wbuff_start != 0 ) {
-					if ((pe_raw_offset - even_wbuff_start)/2 >= (options->strsize ? options->strsize : 4))
-						printb(&ctx, options, pe_raw_data, even_wbuff_start, pe_raw_offset, true);
-					even_wbuff_start = 0;
-				}
-			}
-		}
+	} else if (!pe_is_pe(&ctx)) {
+		fprintf(stderr, "ERROR: not a valid PE file\n");
+	} else {
+		scan_file(&ctx, options);
+		ret = EXIT_SUCCESS;
 	}
 
 	// libera a memoria
@@ -271,8 +294,10 @@ int main(int argc, char *argv[])
 	err = pe_unload(&ctx);
 	if (err != LIBPE_E_OK) {
 		pe_error_print(stderr, err);
-		return EXIT_FAILURE;
+		ret = EXIT_FAILURE;
 	}
 
-	return EXIT_SUCCESS;
+	pev_cleanup_config(&config);
+
+	return ret;
 }
@@ -51,6 +51,7 @@ typedef struct {
 	bool exports;
 	bool all_headers;
 	bool all_sections;
+	bool triage;
 } options_t;
 
 static void usage(void)
@@ -69,6 +70,8 @@ static void usage(void)
 		" -h, --header <dos|coff|optional>		 Show specific header. It can be used multiple times.\n"
 		" -i, --imports							 Show imported functions.\n"
 		" -e, --exports							 Show exported functions.\n"
+		" --triage								 Read only the headers and section table. Implies -H -d -S\n"
+		"										 unless -A or other sections to show are given.\n"
 		" -V, --version							 Show version.\n"
 		" --help								 Show this help.\n",
 		PROGRAM, PROGRAM, formats);
@@ -113,10 +116,12 @@ static options_t *parse_options(int argc, char *argv[])
 		{ "dirs",			  no_argument,		 NULL, 'd' },
 		{ "format",			  required_argument, NULL, 'f' },
 		{ "version",		  no_argument,		 NULL, 'V' },
+		{ "triage",			  no_argument,		 NULL,	2  },
 		{  NULL,			  0,				 NULL,	0  }
 	};
 
 	options->all = true;
+	bool picked = false; // Any of -A, -H, -d, -S, -h, -i or -e given
 
 	int c, ind;
 
@@ -130,18 +135,25 @@ static options_t *parse_options(int argc, char *argv[])
 			case 1: // --help option
 				usage();
 				exit(EXIT_SUCCESS);
+			case 2: // --triage option
+				options->triage = true;
+				break;
 			case 'A':
+				picked = true;
 				options->all = true;
 				break;
 			case 'H':
+				picked = true;
 				options->all = false;
 				options->all_headers = true;
 				break;
 			case 'd':
+				picked = true;
 				options->all = false;
 				options->dirs = true;
 				break;
 			case 'S':
+				picked = true;
 				options->all = false;
 				options->all_sections = true;
 				break;
@@ -149,14 +161,17 @@ static options_t *parse_options(int argc, char *argv[])
 				printf("%s %s\n%s\n", PROGRAM, TOOLKIT, COPY);
 				exit(EXIT_SUCCESS);
 			case 'h':
+				picked = true;
 				options->all = false;
 				parse_headers(options, optarg);
 				break;
 			case 'i':
+				picked = true;
 				options->all = false;
 				options->imports = true;
 				break;
 			case 'e':
+				picked = true;
 				options->all = false;
 				options->exports = true;
 				break;
@@ -170,6 +185,14 @@ static options_t *parse_options(int argc, char *argv[])
 		}
 	}
 
+	// Triage only shows what the header window holds, unless asked otherwise.
+	if (options->triage && !picked) {
+		options->all = false;
+		options->all_headers = true;
+		options->dirs = true;
+		options->all_sections = true;
+	}
+
 	return options;
 }
 
@@ -333,7 +356,29 @@ static void print_directories(pe_ctx_t *ctx)
 	output_close_scope(); // Data directories
 }
 
-static void print_optional_header(IMAGE_OPTIONAL_HEADER *header)
+// The CheckSum is only required of drivers and some DLLs, so 0 is common.
+static void print_computed_checksum(pe_ctx_t *ctx, uint32_t stored)
+{
+	// The checksum covers the whole file, which --triage never reads.
+	if (ctx->io.options & LIBPE_OPT_HEADERS_ONLY) {
+		output("Computed checksum", "not computed");
+		return;
+	}
+
+	uint32_t computed;
+	const pe_err_e err = pe_compute_checksum(ctx, &computed);
+	if (err != LIBPE_E_OK) {
+		pe_error_print(stderr, err);
+		return;
+	}
+
+	static char s[MAX_MSG];
+	snprintf(s, MAX_MSG, "%#x (%s)", computed,
+		stored == 0 ? "not set" : stored == computed ? "matches" : "does not match");
+	output("Computed checksum", s);
+}
+
+static void print_optional_header(pe_ctx_t *ctx, IMAGE_OPTIONAL_HEADER *header)
 {
 #ifdef LIBPE_ENABLE_OUTPUT_COMPAT_WITH_V06
 	typedef struct {
@@ -433,6 +478,7 @@ static void print_optional_header(IMAGE_OPTIONAL_HEADER *header)
 
 			snprintf(s, MAX_MSG, "%#x", header->_32->CheckSum);
 			output("Checksum", s);
+			print_computed_checksum(ctx, header->_32->CheckSum);
 
 			const uint16_t subsystem = header->_32->Subsystem;
 #ifdef LIBPE_ENABLE_OUTPUT_COMPAT_WITH_V06
@@ -544,6 +590,7 @@ static void print_optional_header(IMAGE_OPTIONAL_HEADER *header)
 
 			snprintf(s, MAX_MSG, "%#x", header->_64->CheckSum);
 			output("Checksum", s);
+			print_computed_checksum(ctx, header->_64->CheckSum);
 
 			const uint16_t subsystem = header->_64->Subsystem;
 #ifdef LIBPE_ENABLE_OUTPUT_COMPAT_WITH_V06
@@ -876,7 +923,8 @@ int main(int argc, char *argv[])
 
 	pe_ctx_t ctx;
 
-	pe_err_e err = pe_load_file(&ctx, argv[argc-1]);
+	pe_err_e err = pe_load_file_ext(&ctx, argv[argc-1],
+		options->triage ? LIBPE_OPT_HEADERS_ONLY : 0);
 	if (err != LIBPE_E_OK) {
 		pe_error_print(stderr, err);
 		return EXIT_FAILURE;
@@ -913,7 +961,7 @@ int main(int argc, char *argv[])
 	if (options->opt || options->all_headers || options->all) {
 		IMAGE_OPTIONAL_HEADER *header_ptr = pe_optional(&ctx);
 		if (header_ptr)
-			print_optional_header(header_ptr);
+			print_optional_header(&ctx, header_ptr);
 		else { LIBPE_WARNING("unable to read Optional (Image) file header"); }
 	}
 
@@ -0,0 +1,164 @@
+/*
+    libpe - the PE library
+
+    Copyright (C) 2010 - 2023 libpe authors
+
+    This file is part of libpe.
+
+    libpe is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libpe is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with libpe.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Counts the bytes of synthetic buffers and of each sample with
+// pe_byte_histogram and with the single-table loop entropy used to run,
+// whole and in random pieces. Checks the counts agree, and the entropy of
+// each sample too, and reports the throughput of each.
+
+#include <libpe/pe.h>
+#include "test_common.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NUM_ROUNDS       5
+#define SYNTHETIC_SIZE   (64 * 1024 * 1024)
+
+static double total_naive, total_kernel;
+static uint64_t total_bytes;
+
+static uint64_t random_state = 0x9e3779b97f4a7c15;
+
+static uint32_t random_next(void) {
+	random_state ^= random_state << 13;
+	random_state ^= random_state >> 7;
+	random_state ^= random_state << 17;
+	return (uint32_t)(random_state >> 32);
+}
+
+static void histogram_naive(uint64_t counts[256], const uint8_t *data, size_t size) {
+	unsigned int counted_bytes[256] = { 0 };
+	for (size_t i=0; i < size; i++)
+		counted_bytes[data[i]]++;
+	for (size_t i=0; i < 256; i++)
+		counts[i] += counted_bytes[i];
+}
+
+// The same counts, fed in pieces of random sizes, small ones included.
+static void histogram_pieces(uint64_t counts[256], const uint8_t *data, size_t size) {
+	while (size > 0) {
+		size_t piece = random_next() % 4 == 0 ? random_next() % 64 : random_next() % (1 << 20);
+		if (piece > size)
+			piece = size;
+		pe_byte_histogram(counts, data, piece);
+		data += piece;
+		size -= piece;
+	}
+}
+
+static int bench(const char *label, const uint8_t *data, size_t size) {
+	uint64_t expected[256] = { 0 };
+	uint64_t counts[256] = { 0 };
+	double naive = 0, kernel = 0;
+
+	for (int round=0; round < NUM_ROUNDS; round++) {
+		memset(expected, 0, sizeof(expected));
+		double start = now();
+		histogram_naive(expected, data, size);
+		naive += now() - start;
+
+		memset(counts, 0, sizeof(counts));
+		start = now();
+		pe_byte_histogram(counts, data, size);
+		kernel += now() - start;
+	}
+
+	int failures = memcmp(counts, expected, sizeof(counts)) != 0;
+	memset(counts, 0, sizeof(counts));
+	histogram_pieces(counts, data, size);
+	failures += memcmp(counts, expected, sizeof(counts)) != 0;
+
+	total_naive += naive;
+	total_kernel += kernel;
+	total_bytes += (uint64_t)size * NUM_ROUNDS;
+
+	printf("%s: %s naive=%.2fGB/s histogram=%.2fGB/s\n", label, failures ? "FAILED" : "ok",
+		naive > 0 ? size * NUM_ROUNDS / naive / 1e9 : 0, kernel > 0 ? size * NUM_ROUNDS / kernel / 1e9 : 0);
+	return failures;
+}
+
+static int bench_synthetic(void) {
+	uint8_t *data = malloc(SYNTHETIC_SIZE);
+	if (data == NULL)
+		return 1;
+
+	int failures = 0;
+	for (size_t i=0; i < SYNTHETIC_SIZE; i++)
+		data[i] = (uint8_t)random_next();
+	failures += bench("random", data, SYNTHETIC_SIZE);
+
+	memset(data, 0, SYNTHETIC_SIZE);
+	failures += bench("zeros", data, SYNTHETIC_SIZE);
+
+	// Pages of code-like bytes between pages of padding.
+	for (size_t i=0; i < SYNTHETIC_SIZE; i++)
+		data[i] = (i / 4096) % 3 == 0 ? (uint8_t)random_next() : 0;
+	failures += bench("mixed", data, SYNTHETIC_SIZE);
+
+	free(data);
+	return failures;
+}
+
+static int bench_sample(const char *path) {
+	pe_ctx_t ctx;
+	if (pe_load_file(&ctx, path) != LIBPE_E_OK) {
+		pe_unload(&ctx);
+		return 0; // Not something we can load, nothing to measure.
+	}
+
+	const uint64_t size = pe_filesize(&ctx);
+	int failures = bench(path, ctx.map_addr, size);
+
+	// Entropy as it was computed before, from a single table.
+	uint64_t counts[256] = { 0 };
+	histogram_naive(counts, ctx.map_addr, size);
+	double expected = 0.;
+	for (size_t i=0; i < 256; i++) {
+		const double p = (double)counts[i] / size;
+		if (p > 0.)
+			expected += p * fabs(log2(p));
+	}
+	failures += fabs(pe_calculate_entropy_file(&ctx) - expected) > 1e-9;
+	failures += size > 0 && fabs(pe_calculate_entropy_histogram(counts) - expected) > 1e-9;
+
+	pe_unload(&ctx);
+	return failures;
+}
+
+int main(int argc, char *argv[]) {
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s <sample>...\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	int failures = bench_synthetic();
+	for (int i=1; i < argc; i++)
+		failures += bench_sample(argv[i]);
+
+	printf("total: naive=%.2fGB/s histogram=%.2fGB/s\n",
+		total_naive > 0 ? total_bytes / total_naive / 1e9 : 0, total_kernel > 0 ? total_bytes / total_kernel / 1e9 : 0);
+
+	pe_library_shutdown();
+
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
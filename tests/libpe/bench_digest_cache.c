@@ -0,0 +1,128 @@
+/*
+    libpe - the PE library
+
+    Copyright (C) 2010 - 2023 libpe authors
+
+    This file is part of libpe.
+
+    libpe is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libpe is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with libpe.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Hashes the headers of each sample, which are small enough for the per-call
+// setup to dominate, with pe_hash_raw_data and with what it used to do on
+// every call: look the digest up by name and create a fresh context. Checks
+// both agree and reports the average time per call of each. The first sample
+// is measured again after pe_library_shutdown, which the next load must undo.
+
+#include <libpe/pe.h>
+#include "test_common.h"
+#include <openssl/evp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NUM_ROUNDS 2000
+
+static const char * const names[] = { "md5", "sha1", "sha256" };
+
+#define NUM_NAMES (sizeof(names) / sizeof(names[0]))
+
+static char *output; // pe_hash_recommended_size() bytes
+static double total_uncached, total_cached;
+static uint64_t total_calls;
+
+static bool hash_uncached(char *hex, const char *name, const void *data, size_t size) {
+	const EVP_MD *md = EVP_get_digestbyname(name);
+	EVP_MD_CTX *md_ctx = EVP_MD_CTX_new();
+	unsigned char md_value[EVP_MAX_MD_SIZE];
+	unsigned int md_len = 0;
+	const bool ok = md != NULL && md_ctx != NULL
+		&& EVP_DigestInit_ex(md_ctx, md, NULL)
+		&& EVP_DigestUpdate(md_ctx, data, size)
+		&& EVP_DigestFinal_ex(md_ctx, md_value, &md_len);
+	EVP_MD_CTX_free(md_ctx);
+
+	for (unsigned int i=0; i < md_len; i++)
+		sprintf(hex + 2 * i, "%02x", md_value[i]);
+	hex[2 * md_len] = '\0';
+	return ok;
+}
+
+static int bench(const char *path) {
+	int failures = 0;
+
+	pe_ctx_t ctx;
+	if (pe_load_file(&ctx, path) != LIBPE_E_OK || pe_parse(&ctx) != LIBPE_E_OK) {
+		pe_unload(&ctx);
+		return 0; // Not something we can parse, nothing to measure.
+	}
+
+	const void *data = pe_coff(&ctx);
+	const size_t size = sizeof(IMAGE_COFF_HEADER);
+
+	char expected[2 * EVP_MAX_MD_SIZE + 1];
+	double uncached = 0, cached = 0;
+
+	for (size_t i=0; i < NUM_NAMES; i++) {
+		double start = now();
+		for (int round=0; round < NUM_ROUNDS; round++)
+			failures += !hash_uncached(expected, names[i], data, size);
+		uncached += now() - start;
+
+		start = now();
+		for (int round=0; round < NUM_ROUNDS; round++)
+			failures += !pe_hash_raw_data(output, pe_hash_recommended_size(), names[i], data, size);
+		cached += now() - start;
+
+		failures += strcmp(output, expected) != 0;
+	}
+
+	const uint64_t calls = NUM_ROUNDS * NUM_NAMES;
+	total_uncached += uncached;
+	total_cached += cached;
+	total_calls += calls;
+
+	printf("%s: %s uncached=%.0fns cached=%.0fns\n", path, failures ? "FAILED" : "ok",
+		uncached * 1e9 / calls, cached * 1e9 / calls);
+
+	pe_unload(&ctx);
+	return failures;
+}
+
+int main(int argc, char *argv[]) {
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s <sample>...\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	output = malloc(pe_hash_recommended_size());
+	if (output == NULL)
+		return EXIT_FAILURE;
+
+	int failures = 0;
+	for (int i=1; i < argc; i++)
+		failures += bench(argv[i]);
+
+	pe_library_shutdown();
+	failures += bench(argv[1]);
+
+	if (total_calls > 0)
+		printf("total: uncached=%.0fns cached=%.0fns per call\n",
+			total_uncached * 1e9 / total_calls, total_cached * 1e9 / total_calls);
+
+	free(output);
+	pe_library_shutdown();
+
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,243 @@
+/*
+    libpe - the PE library
+
+    Copyright (C) 2010 - 2023 libpe authors
+
+    This file is part of libpe.
+
+    libpe is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libpe is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with libpe.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Checks the bit-parallel edit_distn_short against the dynamic program of
+// edit_distn on every pair of short strings over a small alphabet, on
+// random strings up to and past 64 characters, on a short string against a
+// much longer one, where edit_distn gives up early, and on every pair of
+// digests of the ssdeep of overlapping ranges of each sample. Reports the
+// average time per call of each on the sample digests.
+
+#include <libpe/pe.h>
+#include "test_common.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// From libfuzzy, which has no header for them.
+int edit_distn(const char *from, int from_len, const char *to, int to_len);
+int edit_distn_short(const char *from, int from_len, const char *to, int to_len);
+
+#define DIGEST_LENGTH    64    // SPAMSUM_LENGTH
+
+#define EXHAUSTIVE_LEN   5     // Every string of "abc" up to this length
+#define LONG_LEN         300   // Longest string against short ones
+#define NUM_RANDOM       200000
+#define NUM_ROUNDS       2
+
+typedef struct {
+	char chars[DIGEST_LENGTH];
+	int len;
+} digest_t;
+
+typedef struct {
+	size_t count;
+	size_t capacity;
+	digest_t *digests;
+} digests_t;
+
+static uint64_t random_state = 0x9e3779b97f4a7c15;
+
+static uint32_t random_next(void) {
+	random_state ^= random_state << 13;
+	random_state ^= random_state >> 7;
+	random_state ^= random_state << 17;
+	return (uint32_t)(random_state >> 32);
+}
+
+static int check(const char *from, int from_len, const char *to, int to_len) {
+	return edit_distn(from, from_len, to, to_len) != edit_distn_short(from, from_len, to, to_len);
+}
+
+static int check_exhaustive(void) {
+	// Strings are numbered in base 3 with a length, "" first.
+	char strings[1 + 3 + 9 + 27 + 81 + 243][EXHAUSTIVE_LEN];
+	int lens[sizeof(strings) / sizeof(strings[0])];
+	size_t count = 0;
+
+	for (int len=0; len <= EXHAUSTIVE_LEN; len++) {
+		int total = 1;
+		for (int i=0; i < len; i++)
+			total *= 3;
+		for (int n=0; n < total; n++) {
+			int value = n;
+			for (int i=0; i < len; i++) {
+				strings[count][i] = "abc"[value % 3];
+				value /= 3;
+			}
+			lens[count++] = len;
+		}
+	}
+
+	int failures = 0;
+	for (size_t i=0; i < count; i++) {
+		for (size_t j=0; j < count; j++)
+			failures += check(strings[i], lens[i], strings[j], lens[j]);
+	}
+
+	printf("exhaustive: %s pairs=%zu\n", failures ? "FAILED" : "ok", count * count);
+	return failures;
+}
+
+static int check_random(void) {
+	static const char b64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	char from[2 * DIGEST_LENGTH], to[2 * DIGEST_LENGTH];
+	int failures = 0;
+
+	for (int n=0; n < NUM_RANDOM; n++) {
+		// Few distinct characters make long common subsequences, so
+		// alphabets of 2 to 64 characters are all tried.
+		const unsigned int alphabet = 2 + random_next() % 63;
+		// Lengths past 64 on either side or both, alike or not.
+		const int max_len = n % 4 < 2 ? 2 * DIGEST_LENGTH : DIGEST_LENGTH;
+		const int from_len = random_next() % (max_len + 1);
+		int to_len = random_next() % (max_len + 1);
+
+		for (int i=0; i < from_len; i++)
+			from[i] = b64[random_next() % alphabet];
+		if (n % 2 == 0) {
+			// A copy with a few changes, like similar digests.
+			memcpy(to, from, from_len);
+			to_len = from_len;
+			for (int k=random_next() % 6; k > 0 && to_len > 0; k--)
+				to[random_next() % to_len] = b64[random_next() % alphabet];
+		} else {
+			for (int i=0; i < to_len; i++)
+				to[i] = b64[random_next() % alphabet];
+		}
+
+		failures += check(from, from_len, to, to_len);
+	}
+
+	printf("random: %s pairs=%d\n", failures ? "FAILED" : "ok", NUM_RANDOM);
+	return failures;
+}
+
+static int check_asymmetric(void) {
+	char short_str[DIGEST_LENGTH], long_str[LONG_LEN];
+	int failures = 0, pairs = 0;
+
+	for (int long_len=DIGEST_LENGTH + 1; long_len <= LONG_LEN; long_len += 7) {
+		for (int short_len=1; short_len <= DIGEST_LENGTH; short_len += 3) {
+			// Nothing in common, then the short string hidden in the long one.
+			memset(short_str, 'a', short_len);
+			memset(long_str, 'b', long_len);
+			failures += check(short_str, short_len, long_str, long_len);
+			failures += check(long_str, long_len, short_str, short_len);
+			memcpy(long_str + (long_len - short_len) / 2, short_str, short_len);
+			failures += check(short_str, short_len, long_str, long_len);
+			failures += check(long_str, long_len, short_str, short_len);
+			pairs += 4;
+		}
+	}
+
+	printf("asymmetric: %s pairs=%d\n", failures ? "FAILED" : "ok", pairs);
+	return failures;
+}
+
+static bool add_digest(digests_t *list, const char *chars, size_t len) {
+	if (len > DIGEST_LENGTH)
+		return true; // Never compared
+	if (list->count == list->capacity) {
+		list->capacity = list->capacity ? 2 * list->capacity : 256;
+		void *digests = realloc(list->digests, list->capacity * sizeof(digest_t));
+		if (digests == NULL)
+			return false;
+		list->digests = digests;
+	}
+
+	memcpy(list->digests[list->count].chars, chars, len);
+	list->digests[list->count].len = (int)len;
+	list->count++;
+	return true;
+}
+
+// Both digests of a signature, "blocksize:digest1:digest2".
+static bool add_signature(digests_t *list, const char *signature) {
+	const char *first = strchr(signature, ':');
+	const char *second = first ? strchr(first + 1, ':') : NULL;
+	if (second == NULL)
+		return false;
+
+	return add_digest(list, first + 1, second - first - 1)
+		&& add_digest(list, second + 1, strlen(second + 1));
+}
+
+static bool add_range_signature(void *list, const char *signature) {
+	return add_signature(list, signature);
+}
+
+static int bench_digests(const digests_t *list) {
+	const size_t count = list->count;
+	const digest_t *digests = list->digests;
+	int failures = 0;
+	long sum_dp = 0, sum_short = 0; // Keeps the calls from being optimized out
+
+	double start = now();
+	for (int round=0; round < NUM_ROUNDS; round++) {
+		for (size_t i=0; i < count; i++) {
+			for (size_t j=0; j < count; j++)
+				sum_dp += edit_distn(digests[i].chars, digests[i].len, digests[j].chars, digests[j].len);
+		}
+	}
+	const double dp = now() - start;
+
+	start = now();
+	for (int round=0; round < NUM_ROUNDS; round++) {
+		for (size_t i=0; i < count; i++) {
+			for (size_t j=0; j < count; j++)
+				sum_short += edit_distn_short(digests[i].chars, digests[i].len, digests[j].chars, digests[j].len);
+		}
+	}
+	const double bit_parallel = now() - start;
+
+	for (size_t i=0; i < count; i++) {
+		for (size_t j=0; j < count; j++)
+			failures += check(digests[i].chars, digests[i].len, digests[j].chars, digests[j].len);
+	}
+	failures += sum_dp != sum_short;
+
+	const double calls = (double)count * count * NUM_ROUNDS;
+	printf("digests=%zu: %s edit_distn=%.0fns edit_distn_short=%.0fns per call\n", count,
+		failures ? "FAILED" : "ok", calls > 0 ? dp * 1e9 / calls : 0, calls > 0 ? bit_parallel * 1e9 / calls : 0);
+	return failures;
+}
+
+int main(int argc, char *argv[]) {
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s <sample>...\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	int failures = check_exhaustive();
+	failures += check_random();
+	failures += check_asymmetric();
+
+	digests_t list = { 0 };
+	for (int i=1; i < argc; i++)
+		failures += hash_sample_ranges(argv[i], add_range_signature, &list);
+	failures += bench_digests(&list);
+
+	free(list.digests);
+	pe_library_shutdown();
+
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,149 @@
+/*
+    libpe - the PE library
+
+    Copyright (C) 2010 - 2023 libpe authors
+
+    This file is part of libpe.
+
+    libpe is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libpe is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with libpe.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Hashes each sample with every digest of pe_hash_multi_t on its own, checks
+// them against pe_hash_raw_data and known vectors, and reports the
+// throughput of each.
+
+#include <libpe/pe.h>
+#include "test_common.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NUM_ROUNDS 5
+
+typedef struct {
+	const char *name;
+	unsigned int algorithm;
+	size_t offset; // Of the digest in pe_hash_digests_t
+} algorithm_t;
+
+#define ALGORITHM(name, alg) { #name, alg, offsetof(pe_hash_digests_t, name) }
+
+static const algorithm_t algorithms[] = {
+	ALGORITHM(md5,    LIBPE_HASH_MD5),
+	ALGORITHM(sha1,   LIBPE_HASH_SHA1),
+	ALGORITHM(sha256, LIBPE_HASH_SHA256),
+	ALGORITHM(xxh64,  LIBPE_HASH_XXH64),
+	ALGORITHM(xxh3,   LIBPE_HASH_XXH3),
+	ALGORITHM(xxh128, LIBPE_HASH_XXH128),
+	ALGORITHM(crc32c, LIBPE_HASH_CRC32C),
+};
+
+#define NUM_ALGORITHMS (sizeof(algorithms) / sizeof(algorithms[0]))
+
+// Digests of "123456789", as published for each algorithm.
+static const char * const check_values[NUM_ALGORITHMS] = {
+	"25f9e794323b453885f5181f1b624d0b",
+	"f7c3bc1d808e04732adf679965ccc34ca7ae3441",
+	"15e2b0d3c33891ebb0f1ef609ec419420c20e320ce94c65fbc8c3312448eb225",
+	"8cb841db40e6ae83",
+	"72dcb18b67a17dff",
+	"33119477ede5dcd5e9716427681d5860",
+	"e3069283",
+};
+
+static char *output; // pe_hash_recommended_size() bytes
+static double total_elapsed[NUM_ALGORITHMS];
+static uint64_t total_bytes;
+
+static const char *digest_of(const pe_hash_digests_t *digests, size_t index) {
+	return (const char *)digests + algorithms[index].offset;
+}
+
+static int check_known_values(void) {
+	static const unsigned char data[] = "123456789";
+	int failures = 0;
+
+	for (size_t i=0; i < NUM_ALGORITHMS; i++) {
+		if (!pe_hash_raw_data(output, pe_hash_recommended_size(), algorithms[i].name, data, sizeof(data) - 1)
+			|| strcmp(output, check_values[i]) != 0) {
+			fprintf(stderr, "%s: bad check value\n", algorithms[i].name);
+			failures++;
+		}
+	}
+
+	return failures;
+}
+
+static int bench(const char *path) {
+	double elapsed[NUM_ALGORITHMS] = { 0 };
+	int failures = 0;
+
+	pe_ctx_t ctx;
+	if (pe_load_file(&ctx, path) != LIBPE_E_OK) {
+		pe_unload(&ctx);
+		return 0; // Not something we can load, nothing to measure.
+	}
+
+	const uint64_t size = pe_filesize(&ctx);
+
+	for (size_t i=0; i < NUM_ALGORITHMS; i++) {
+		pe_hash_digests_t digests;
+		pe_err_e err = LIBPE_E_OK;
+
+		const double start = now();
+		for (int round=0; round < NUM_ROUNDS && err == LIBPE_E_OK; round++)
+			err = pe_hash_file_range(&ctx, algorithms[i].algorithm, 0, size, &digests);
+		elapsed[i] = now() - start;
+		total_elapsed[i] += elapsed[i];
+
+		// Streaming through the engine must match hashing the mapping at once.
+		failures += err != LIBPE_E_OK
+			|| !pe_hash_raw_data(output, pe_hash_recommended_size(), algorithms[i].name, ctx.map_addr, size)
+			|| strcmp(output, digest_of(&digests, i)) != 0;
+	}
+	total_bytes += size * NUM_ROUNDS;
+
+	printf("%s: %s", path, failures ? "FAILED" : "ok");
+	for (size_t i=0; i < NUM_ALGORITHMS; i++)
+		printf(" %s=%.0fMB/s", algorithms[i].name, elapsed[i] > 0 ? size * NUM_ROUNDS / elapsed[i] / 1e6 : 0);
+	printf("\n");
+
+	pe_unload(&ctx);
+	return failures;
+}
+
+int main(int argc, char *argv[]) {
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s <sample>...\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	output = malloc(pe_hash_recommended_size());
+	if (output == NULL)
+		return EXIT_FAILURE;
+
+	int failures = check_known_values();
+	for (int i=1; i < argc; i++)
+		failures += bench(argv[i]);
+
+	printf("total:");
+	for (size_t i=0; i < NUM_ALGORITHMS; i++)
+		printf(" %s=%.0fMB/s", algorithms[i].name, total_elapsed[i] > 0 ? total_bytes / total_elapsed[i] / 1e6 : 0);
+	printf("\n");
+
+	free(output);
+	pe_library_shutdown();
+
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
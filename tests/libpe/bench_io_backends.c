@@ -0,0 +1,181 @@
+/*
+    libpe - the PE library
+
+    Copyright (C) 2010 - 2023 libpe authors
+    
+    This file is part of libpe.
+
+    libpe is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libpe is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with libpe.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Runs the same whole-file pass through each chunk iterator backend, checks
+// they all see the same bytes, and reports how long each one took. O_DIRECT
+// is also tried on a descriptor given to pe_load_fd, which must get its own
+// O_DIRECT descriptor whenever the file opened by path does. A file that
+// shrinks under the pread backend makes pe_get_file_hash fail, not abort.
+
+#include <libpe/pe.h>
+#include "test_common.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define NUM_ROUNDS 5
+
+typedef struct {
+	const char *name;
+	pe_options_e options;
+	bool by_fd; // Loaded with pe_load_fd
+} backend_t;
+
+static const backend_t backends[] = {
+	{ "mmap",      0,                   false },
+	{ "pread",     LIBPE_OPT_IO_PREAD,  false },
+	{ "direct",    LIBPE_OPT_IO_DIRECT, false },
+	{ "direct-fd", LIBPE_OPT_IO_DIRECT, true },
+};
+
+#define NUM_BACKENDS (sizeof(backends) / sizeof(backends[0]))
+
+// FNV-1a over [offset, offset + size), read in chunks of `chunk_size`.
+static uint64_t checksum(pe_ctx_t *ctx, uint64_t offset, uint64_t size, size_t chunk_size, pe_err_e *err) {
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	pe_chunk_iter_t iter;
+	pe_chunks_begin(ctx, &iter, offset, size, chunk_size);
+	const uint8_t *data;
+	size_t data_size;
+	while ((data = pe_chunks_next(&iter, &data_size)) != NULL) {
+		for (size_t i=0; i < data_size; i++)
+			hash = (hash ^ data[i]) * 0x100000001b3ULL;
+	}
+	*err = iter.err;
+	pe_chunks_end(&iter);
+	return hash;
+}
+
+static int bench(const char *path) {
+	uint64_t expected[2] = { 0 };
+	double elapsed[NUM_BACKENDS] = { 0 };
+	bool direct_by_path = false;
+	int failures = 0;
+
+	for (size_t b=0; b < NUM_BACKENDS; b++) {
+		pe_ctx_t ctx;
+		int fd = -1;
+		pe_err_e err;
+		if (backends[b].by_fd) {
+			fd = open(path, O_RDONLY);
+			if (fd == -1)
+				return failures + 1; // It could be opened by path a moment ago.
+			err = pe_load_fd(&ctx, fd, backends[b].options);
+		} else {
+			err = pe_load_file_ext(&ctx, path, backends[b].options);
+		}
+		if (err != LIBPE_E_OK) {
+			pe_unload(&ctx);
+			if (fd != -1)
+				close(fd);
+			return 0; // Not something we can load, nothing to compare.
+		}
+
+		if (backends[b].options & LIBPE_OPT_IO_DIRECT) {
+			if (!backends[b].by_fd)
+				direct_by_path = ctx.io.direct_fd != -1;
+			else
+				failures += direct_by_path != (ctx.io.direct_fd != -1);
+		}
+
+		const uint64_t size = pe_filesize(&ctx);
+		uint64_t results[2];
+
+		const double start = now();
+		for (int round=0; round < NUM_ROUNDS; round++)
+			results[0] = checksum(&ctx, 0, size, 0, &err);
+		elapsed[b] = now() - start;
+		failures += err != LIBPE_E_OK;
+
+		// An unaligned range in odd-sized chunks exercises the O_DIRECT bounce buffer.
+		const uint64_t offset = size > 1 ? 1 : 0;
+		results[1] = checksum(&ctx, offset, size - offset - (size > 2), 4099, &err);
+		failures += err != LIBPE_E_OK;
+
+		if (b == 0)
+			memcpy(expected, results, sizeof(expected));
+		else
+			failures += memcmp(expected, results, sizeof(expected)) != 0;
+
+		pe_unload(&ctx);
+		if (fd != -1)
+			close(fd);
+	}
+
+	printf("%s: %s", path, failures ? "FAILED" : "ok");
+	for (size_t b=0; b < NUM_BACKENDS; b++)
+		printf(" %s=%.3fms", backends[b].name, elapsed[b] * 1000 / NUM_ROUNDS);
+	printf("\n");
+
+	return failures;
+}
+
+// Hashes a copy of the sample truncated after it was loaded.
+static int check_read_error(const char *path) {
+	pe_ctx_t ctx;
+	if (pe_load_file(&ctx, path) != LIBPE_E_OK || pe_filesize(&ctx) < 2) {
+		pe_unload(&ctx);
+		return 0;
+	}
+
+	char copy_path[] = "/tmp/bench_io_backends.XXXXXX";
+	const int fd = mkstemp(copy_path);
+	const size_t size = pe_filesize(&ctx);
+	const bool copied = fd != -1 && write(fd, ctx.map_addr, size) == (ssize_t)size;
+	pe_unload(&ctx);
+	if (!copied) {
+		if (fd != -1) {
+			close(fd);
+			unlink(copy_path);
+		}
+		return 1;
+	}
+
+	int failures = 0;
+	if (pe_load_file_ext(&ctx, copy_path, LIBPE_OPT_IO_PREAD) == LIBPE_E_OK && ftruncate(fd, size / 2) == 0)
+		failures += pe_get_file_hash(&ctx) != NULL;
+	else
+		failures++;
+	pe_unload(&ctx);
+	close(fd);
+	unlink(copy_path);
+
+	printf("read error: %s\n", failures ? "FAILED" : "ok");
+	return failures;
+}
+
+int main(int argc, char *argv[]) {
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s <sample>...\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	int failures = 0;
+	for (int i=1; i < argc; i++)
+		failures += bench(argv[i]);
+	failures += check_read_error(argv[1]);
+
+	pe_library_shutdown();
+
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
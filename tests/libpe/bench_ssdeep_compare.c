@@ -0,0 +1,140 @@
+/*
+    libpe - the PE library
+
+    Copyright (C) 2010 - 2023 libpe authors
+
+    This file is part of libpe.
+
+    libpe is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libpe is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with libpe.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Builds a set from the ssdeep of overlapping ranges of each sample, so that
+// many of them match, and compares every pair with fuzzy_compare and with
+// pe_ssdeep_compare_set and pe_ssdeep_compare_pairs on one and on every CPU.
+// Checks they all agree and reports the time each took.
+
+#include <libpe/pe.h>
+#include "../../lib/libpe/libfuzzy/fuzzy.h"
+#include "test_common.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+	size_t count;
+	size_t capacity;
+	char (*signatures)[FUZZY_MAX_RESULT];
+} signatures_t;
+
+static bool add_signature(signatures_t *list, const char *signature) {
+	if (list->count == list->capacity) {
+		list->capacity = list->capacity ? 2 * list->capacity : 256;
+		void *signatures = realloc(list->signatures, list->capacity * sizeof(*list->signatures));
+		if (signatures == NULL)
+			return false;
+		list->signatures = signatures;
+	}
+
+	snprintf(list->signatures[list->count++], FUZZY_MAX_RESULT, "%s", signature);
+	return true;
+}
+
+static bool add_range_signature(void *list, const char *signature) {
+	return add_signature(list, signature);
+}
+
+int main(int argc, char *argv[]) {
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s <sample>...\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	signatures_t list = { 0 };
+	int failures = 0;
+	for (int i=1; i < argc; i++)
+		failures += hash_sample_ranges(argv[i], add_range_signature, &list);
+
+	pe_ssdeep_set_t set = { 0 };
+	for (size_t i=0; i < list.count; i++)
+		failures += pe_ssdeep_set_add(&set, list.signatures[i]) != LIBPE_E_OK;
+	failures += pe_ssdeep_set_add(&set, "3:abc") != LIBPE_E_INVALID_SSDEEP;
+	failures += set.count != list.count;
+
+	// Every pair, the way callers of fuzzy_compare do it.
+	const size_t count = list.count;
+	int *expected = malloc((count * count + 1) * sizeof(int));
+	int *scores = malloc((count + 1) * sizeof(int));
+	if (expected == NULL || scores == NULL)
+		return EXIT_FAILURE;
+
+	size_t expected_matches = 0;
+	double start = now();
+	for (size_t i=0; i < count; i++) {
+		for (size_t j=0; j < count; j++)
+			expected[i * count + j] = fuzzy_compare(list.signatures[i], list.signatures[j]);
+	}
+	const double unprepared = now() - start;
+	for (size_t i=0; i < count; i++) {
+		for (size_t j=i + 1; j < count; j++)
+			expected_matches += expected[i * count + j] > 0;
+	}
+
+	// One against the set, for each entry.
+	const unsigned int jobs[] = { 1, 0 };
+	double one_vs_set[2];
+	for (size_t k=0; k < 2; k++) {
+		start = now();
+		for (size_t i=0; i < count; i++) {
+			if (pe_ssdeep_compare_set(&set, list.signatures[i], scores, jobs[k]) != LIBPE_E_OK) {
+				failures++;
+				continue;
+			}
+			failures += memcmp(scores, &expected[i * count], count * sizeof(int)) != 0;
+		}
+		one_vs_set[k] = now() - start;
+	}
+
+	// All pairs at once.
+	double all_pairs[2];
+	for (size_t k=0; k < 2; k++) {
+		start = now();
+		pe_ssdeep_matches_t *matches = pe_ssdeep_compare_pairs(&set, 1, jobs[k]);
+		all_pairs[k] = now() - start;
+
+		if (matches == NULL || matches->err != LIBPE_E_OK || matches->count != expected_matches) {
+			failures++;
+		} else {
+			for (size_t m=0; m < matches->count; m++) {
+				const pe_ssdeep_match_t *match = &matches->matches[m];
+				failures += match->first >= match->second
+					|| match->score != expected[match->first * count + match->second]
+					|| (m > 0 && match->first == matches->matches[m - 1].first
+						&& match->second <= matches->matches[m - 1].second);
+			}
+		}
+		pe_ssdeep_matches_dealloc(matches);
+	}
+
+	printf("signatures=%zu matches=%zu: %s fuzzy_compare=%.3fs set=%.3fs set_all_cpus=%.3fs"
+		" pairs=%.3fs pairs_all_cpus=%.3fs\n", count, expected_matches, failures ? "FAILED" : "ok",
+		unprepared, one_vs_set[0], one_vs_set[1], all_pairs[0], all_pairs[1]);
+
+	free(scores);
+	free(expected);
+	free(list.signatures);
+	pe_ssdeep_set_dealloc(&set);
+	pe_library_shutdown();
+
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
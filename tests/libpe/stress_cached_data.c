@@ -0,0 +1,198 @@
+/*
+    libpe - the PE library
+
+    Copyright (C) 2010 - 2023 libpe authors
+    
+    This file is part of libpe.
+
+    libpe is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libpe is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with libpe.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Shares a single parsed context between several threads that all query the
+// lazily built views (imports, exports, resources and hashes) at once, and
+// checks every thread got the very same, fully built objects. Contexts loaded
+// with LIBPE_OPT_HEADERS_ONLY and LIBPE_OPT_WINDOWED are mapped by the first
+// view while other threads still read the headers and the section table.
+
+#include <libpe/pe.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NUM_THREADS 8
+#define NUM_ROUNDS 20
+#define NUM_QUERIES 7
+
+typedef struct {
+	pe_imports_t *imports;
+	pe_exports_t *exports;
+	pe_resources_t *resources;
+	pe_hash_headers_t *hash_headers;
+	pe_hash_sections_t *hash_sections;
+	pe_hash_t *hash_file;
+	uint32_t headers; // headers_digest() of the headers and section table
+} views_t;
+
+typedef struct {
+	pe_ctx_t *ctx;
+	unsigned int seed;
+	views_t views;
+} worker_t;
+
+static pthread_barrier_t start_barrier;
+
+// Mixes every section header with the COFF header, failing on any that can't be read.
+static uint32_t headers_digest(pe_ctx_t *ctx) {
+	const IMAGE_COFF_HEADER *coff = pe_coff(ctx);
+	if (coff == NULL || !pe_can_read(ctx, coff, sizeof(IMAGE_COFF_HEADER)))
+		return 0;
+
+	uint32_t digest = 1 + coff->NumberOfSections;
+	IMAGE_SECTION_HEADER ** const sections = pe_sections(ctx);
+	for (uint16_t i=0; i < pe_sections_count(ctx); i++) {
+		const IMAGE_SECTION_HEADER *section = sections[i];
+		if (!pe_can_read(ctx, section, sizeof(IMAGE_SECTION_HEADER)))
+			return 0;
+		const uint8_t *bytes = (const uint8_t *)section;
+		for (size_t j=0; j < sizeof(IMAGE_SECTION_HEADER); j++)
+			digest = digest * 31 + bytes[j];
+	}
+	return digest;
+}
+
+static void query(pe_ctx_t *ctx, views_t *views, int which) {
+	switch (which) {
+		case 0: views->imports = pe_imports(ctx); break;
+		case 1: views->exports = pe_exports(ctx); break;
+		case 2: views->resources = pe_resources(ctx); break;
+		case 3: views->hash_headers = pe_get_headers_hashes(ctx); break;
+		case 4: views->hash_sections = pe_get_sections_hash(ctx); break;
+		case 5: views->hash_file = pe_get_file_hash(ctx); break;
+		case 6: views->headers = headers_digest(ctx); break;
+	}
+}
+
+static void *worker_run(void *arg) {
+	worker_t *worker = arg;
+
+	pthread_barrier_wait(&start_barrier);
+
+	// Every thread asks for the views in its own order.
+	const int first = rand_r(&worker->seed) % NUM_QUERIES;
+	for (int i=0; i < NUM_QUERIES; i++)
+		query(worker->ctx, &worker->views, (first + i) % NUM_QUERIES);
+
+	return NULL;
+}
+
+static bool views_equal(const views_t *a, const views_t *b) {
+	return a->imports == b->imports
+		&& a->exports == b->exports
+		&& a->resources == b->resources
+		&& a->hash_headers == b->hash_headers
+		&& a->hash_sections == b->hash_sections
+		&& a->hash_file == b->hash_file
+		&& a->headers == b->headers;
+}
+
+static int stress(const char *path, pe_options_e options, const char *expected_sha256, uint32_t expected_dlls) {
+	pe_ctx_t ctx;
+
+	pe_err_e err = pe_load_file_ext(&ctx, path, options);
+	if (err == LIBPE_E_OK)
+		err = pe_parse(&ctx);
+	if (err != LIBPE_E_OK) {
+		pe_unload(&ctx);
+		return 0; // Not a PE file, nothing to stress.
+	}
+
+	worker_t workers[NUM_THREADS];
+	pthread_t threads[NUM_THREADS];
+
+	const uint32_t expected_headers = headers_digest(&ctx);
+
+	pthread_barrier_init(&start_barrier, NULL, NUM_THREADS);
+	for (int i=0; i < NUM_THREADS; i++) {
+		memset(&workers[i], 0, sizeof(worker_t));
+		workers[i].ctx = &ctx;
+		workers[i].seed = (unsigned int)i * 7919;
+		pthread_create(&threads[i], NULL, worker_run, &workers[i]);
+	}
+	for (int i=0; i < NUM_THREADS; i++)
+		pthread_join(threads[i], NULL);
+	pthread_barrier_destroy(&start_barrier);
+
+	int failures = 0;
+	for (int i=1; i < NUM_THREADS; i++) {
+		if (!views_equal(&workers[0].views, &workers[i].views))
+			failures++;
+	}
+
+	const views_t *views = &workers[0].views;
+	if (views->hash_file == NULL || strcmp(views->hash_file->sha256, expected_sha256) != 0)
+		failures++;
+	if (views->imports == NULL || views->imports->dll_count != expected_dlls)
+		failures++;
+	if (views->headers == 0 || views->headers != expected_headers)
+		failures++;
+
+	pe_unload(&ctx);
+	return failures;
+}
+
+int main(int argc, char *argv[]) {
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s <sample>...\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	int failures = 0;
+	for (int i=1; i < argc; i++) {
+		// Reference results from a context nobody else touches.
+		pe_ctx_t ctx;
+		pe_err_e err = pe_load_file(&ctx, argv[i]);
+		if (err == LIBPE_E_OK)
+			err = pe_parse(&ctx);
+		if (err != LIBPE_E_OK) {
+			pe_unload(&ctx);
+			continue;
+		}
+		const pe_hash_t *file_hash = pe_get_file_hash(&ctx);
+		if (file_hash == NULL) {
+			printf("%s: FAILED\n", argv[i]);
+			failures++;
+			pe_unload(&ctx);
+			continue;
+		}
+		char *expected_sha256 = strdup(file_hash->sha256);
+		const uint32_t expected_dlls = pe_imports(&ctx)->dll_count;
+		pe_unload(&ctx);
+
+		static const pe_options_e loads[] = { 0, LIBPE_OPT_HEADERS_ONLY, LIBPE_OPT_WINDOWED };
+		int sample_failures = 0;
+		for (int round=0; round < NUM_ROUNDS; round++) {
+			for (size_t j=0; j < sizeof(loads) / sizeof(loads[0]); j++)
+				sample_failures += stress(argv[i], loads[j], expected_sha256, expected_dlls);
+		}
+
+		printf("%s: %s\n", argv[i], sample_failures ? "FAILED" : "ok");
+		failures += sample_failures;
+		free(expected_sha256);
+	}
+
+	pe_library_shutdown();
+
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
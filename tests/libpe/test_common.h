@@ -0,0 +1,77 @@
+/*
+    libpe - the PE library
+
+    Copyright (C) 2010 - 2023 libpe authors
+
+    This file is part of libpe.
+
+    libpe is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libpe is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with libpe.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Helpers shared by the stress tests and benchmarks in this directory.
+
+#ifndef LIBPE_TEST_COMMON_H
+#define LIBPE_TEST_COMMON_H
+
+#include <libpe/pe.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+// Ranges [size * begin / 16, size * end / 16) of each sample.
+#define RANGE_PARTS      16
+#define RANGE_MAX_BEGIN  3
+#define RANGE_MIN_END    12
+
+// Gets the ssdeep signature of one range; returning false counts as a failure.
+typedef bool (*range_signature_fn)(void *arg, const char *signature);
+
+static inline double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Hashes the overlapping ranges of the sample at `path` with
+// LIBPE_HASH_SSDEEP and passes each signature to `fn`. Returns the number of
+// failures, or 0 if the sample can't be loaded.
+static inline int hash_sample_ranges(const char *path, range_signature_fn fn, void *arg) {
+	pe_ctx_t ctx;
+	if (pe_load_file(&ctx, path) != LIBPE_E_OK) {
+		pe_unload(&ctx);
+		return 0; // Not something we can load, nothing to hash.
+	}
+
+	const uint64_t size = pe_filesize(&ctx);
+	int failures = 0;
+
+	for (uint64_t begin=0; begin <= RANGE_MAX_BEGIN; begin++) {
+		for (uint64_t end=RANGE_MIN_END; end <= RANGE_PARTS; end++) {
+			const uint64_t offset = size * begin / RANGE_PARTS;
+			const uint64_t length = size * end / RANGE_PARTS - offset;
+			if (length == 0)
+				continue;
+
+			pe_hash_digests_t digests;
+			if (pe_hash_file_range(&ctx, LIBPE_HASH_SSDEEP, offset, length, &digests) != LIBPE_E_OK
+				|| !fn(arg, digests.ssdeep))
+				failures++;
+		}
+	}
+
+	pe_unload(&ctx);
+	return failures;
+}
+
+#endif
@@ -0,0 +1,527 @@
+/* ssdeep
+ * Copyright (C) 2002 Andrew Tridgell <tridge@samba.org>
+ * Copyright (C) 2006 ManTech International Corporation
+ * Copyright (C) 2013 Helmut Grohne <helmut@subdivi.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+// Differential test of the libfuzzy engine. Below is the engine as it was
+// before fuzzy_update got its bulk loop: one byte at a time, the trigger
+// tested with a modulo per blocksize. Every sample and a set of synthetic
+// inputs are hashed with both, whole and in random pieces, and with every
+// combination of digest flags; the digests must be identical.
+
+#include <libpe/pe.h>
+#include "../../lib/libpe/libfuzzy/fuzzy.h"
+#include "test_common.h"
+#include <assert.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Reference engine, from lib/libpe/libfuzzy/fuzzy.c.
+
+#if defined(__GNUC__) && __GNUC__ >= 3
+#define likely(x)       __builtin_expect(!!(x), 1)
+#define unlikely(x)     __builtin_expect(!!(x), 0)
+#else
+#define likely(x) x
+#define unlikely(x) x
+#endif
+
+#ifndef MIN
+#define MIN(a,b) ((a)<(b)?(a):(b))
+#endif
+
+#ifndef MAX
+#define MAX(a,b) ((a)>(b)?(a):(b))
+#endif
+
+#define ROLLING_WINDOW 7
+#define MIN_BLOCKSIZE 3
+#define HASH_PRIME 0x01000193
+#define HASH_INIT 0x28021967
+#define NUM_BLOCKHASHES 31
+
+struct roll_state {
+  unsigned char window[ROLLING_WINDOW];
+  uint32_t h1, h2, h3;
+  uint32_t n;
+};
+
+static void roll_init(/*@out@*/ struct roll_state *self) {
+	memset(self, 0, sizeof(struct roll_state));
+}
+
+/*
+ * a rolling hash, based on the Adler checksum. By using a rolling hash
+ * we can perform auto resynchronisation after inserts/deletes
+
+ * internally, h1 is the sum of the bytes in the window and h2
+ * is the sum of the bytes times the index
+
+ * h3 is a shift/xor based rolling hash, and is mostly needed to ensure that
+ * we can cope with large blocksize values
+ */
+static void roll_hash(struct roll_state *self, unsigned char c)
+{
+  self->h2 -= self->h1;
+  self->h2 += ROLLING_WINDOW * (uint32_t)c;
+
+  self->h1 += (uint32_t)c;
+  self->h1 -= (uint32_t)self->window[self->n % ROLLING_WINDOW];
+
+  self->window[self->n % ROLLING_WINDOW] = c;
+  self->n++;
+
+  /* The original spamsum AND'ed this value with 0xFFFFFFFF which
+   * in theory should have no effect. This AND has been removed
+   * for performance (jk) */
+  self->h3 <<= 5;
+  self->h3 ^= c;
+}
+
+static uint32_t roll_sum(const struct roll_state *self)
+{
+  return self->h1 + self->h2 + self->h3;
+}
+
+/* A simple non-rolling hash, based on the FNV hash. */
+static uint32_t sum_hash(unsigned char c, uint32_t h)
+{
+  return (h * HASH_PRIME) ^ c;
+}
+
+/* A blockhash contains a signature state for a specific (implicit) blocksize.
+ * The blocksize is given by SSDEEP_BS(index). The h and halfh members are the
+ * FNV hashes, where halfh stops to be reset after digest is SPAMSUM_LENGTH/2
+ * long. The halfh hash is needed be able to truncate digest for the second
+ * output hash to stay compatible with ssdeep output. */
+struct blockhash_context
+{
+  uint32_t h, halfh;
+  char digest[SPAMSUM_LENGTH];
+  unsigned int dlen;
+};
+
+struct ref_state
+{
+  unsigned int bhstart, bhend;
+  struct blockhash_context bh[NUM_BLOCKHASHES];
+  size_t total_size;
+  struct roll_state roll;
+};
+
+#define SSDEEP_BS(index) (((uint32_t)MIN_BLOCKSIZE) << (index))
+
+static struct ref_state *ref_new(void)
+{
+  struct ref_state *self;
+  if(NULL == (self = malloc(sizeof(struct ref_state))))
+    /* malloc sets ENOMEM */
+    return NULL;
+  self->bhstart = 0;
+  self->bhend = 1;
+  self->bh[0].h = HASH_INIT;
+  self->bh[0].halfh = HASH_INIT;
+  self->bh[0].dlen = 0;
+  self->total_size = 0;
+  roll_init(&self->roll);
+  return self;
+}
+
+static void fuzzy_try_fork_blockhash(struct ref_state *self)
+{
+  struct blockhash_context *obh, *nbh;
+  if (self->bhend >= NUM_BLOCKHASHES)
+    return;
+  assert(self->bhend > 0);
+  obh = self->bh + (self->bhend - 1);
+  nbh = obh + 1;
+  nbh->h = obh->h;
+  nbh->halfh = obh->halfh;
+  nbh->dlen = 0;
+  ++self->bhend;
+}
+
+static void fuzzy_try_reduce_blockhash(struct ref_state *self)
+{
+  assert(self->bhstart < self->bhend);
+  if (self->bhend - self->bhstart < 2)
+    /* Need at least two working hashes. */
+    return;
+  if ((size_t)SSDEEP_BS(self->bhstart) * SPAMSUM_LENGTH >=
+      self->total_size)
+    /* Initial blocksize estimate would select this or a smaller
+     * blocksize. */
+    return;
+  if (self->bh[self->bhstart + 1].dlen < SPAMSUM_LENGTH / 2)
+    /* Estimate adjustment would select this blocksize. */
+    return;
+  /* At this point we are clearly no longer interested in the
+   * start_blocksize. Get rid of it. */
+  ++self->bhstart;
+}
+
+static const char *b64 =
+  "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static void ref_engine_step(struct ref_state *self, unsigned char c)
+{
+  size_t h;
+  unsigned int i;
+  /* At each character we update the rolling hash and the normal hashes.
+   * When the rolling hash hits a reset value then we emit a normal hash
+   * as a element of the signature and reset the normal hash. */
+  roll_hash(&self->roll, c);
+  h = roll_sum(&self->roll);
+
+  for (i = self->bhstart; i < self->bhend; ++i)
+  {
+    self->bh[i].h = sum_hash(c, self->bh[i].h);
+    self->bh[i].halfh = sum_hash(c, self->bh[i].halfh);
+  }
+
+  for (i = self->bhstart; i < self->bhend; ++i)
+  {
+    /* With growing blocksize almost no runs fail the next test. */
+    if (likely(h % SSDEEP_BS(i) != SSDEEP_BS(i) - 1))
+      /* Once this condition is false for one bs, it is
+       * automatically false for all further bs. I.e. if
+       * h === -1 (mod 2*bs) then h === -1 (mod bs). */
+      break;
+    /* We have hit a reset point. We now emit hashes which are
+     * based on all characters in the piece of the message between
+     * the last reset point and this one */
+    if (unlikely(0 == self->bh[i].dlen)) {
+      /* Can only happen 30 times. */
+      /* First step for this blocksize. Clone next. */
+      fuzzy_try_fork_blockhash(self);
+    }
+    if (self->bh[i].dlen < SPAMSUM_LENGTH - 1) {
+      /* We can have a problem with the tail overflowing. The
+       * easiest way to cope with this is to only reset the
+       * normal hash if we have room for more characters in
+       * our signature. This has the effect of combining the
+       * last few pieces of the message into a single piece
+       * */
+      self->bh[i].digest[self->bh[i].dlen++] =
+	b64[self->bh[i].h % 64];
+      self->bh[i].h = HASH_INIT;
+      if (self->bh[i].dlen < SPAMSUM_LENGTH / 2)
+	self->bh[i].halfh = HASH_INIT;
+    } else
+      fuzzy_try_reduce_blockhash(self);
+  }
+}
+
+static int ref_update(struct ref_state *self,
+		 const unsigned char *buffer,
+		 size_t buffer_size) {
+  self->total_size += buffer_size;
+  for ( ;buffer_size > 0; ++buffer, --buffer_size)
+    ref_engine_step(self, *buffer);
+  return 0;
+}
+
+static int memcpy_eliminate_sequences(char *dst,
+				      const char *src,
+				      int n)
+{
+  const char *srcend = src + n;
+  assert(n >= 0);
+  if (src < srcend) *dst++ = *src++;
+  if (src < srcend) *dst++ = *src++;
+  if (src < srcend) *dst++ = *src++;
+  while (src < srcend)
+    if (*src == dst[-1] && *src == dst[-2] && *src == dst[-3])
+    {
+      ++src;
+      --n;
+    } else
+      *dst++ = *src++;
+  return n;
+}
+
+static int ref_digest(const struct ref_state *self,
+		 /*@out@*/ char *result,
+		 unsigned int flags)
+{
+  unsigned int bi = self->bhstart;
+  uint32_t h = roll_sum(&self->roll);
+  int i, remain = FUZZY_MAX_RESULT - 1; /* Exclude terminating '\0'. */
+  /* Verify that our elimination was not overeager. */
+  assert(bi == 0 || (size_t)SSDEEP_BS(bi) / 2 * SPAMSUM_LENGTH <
+	 self->total_size);
+
+  /* Initial blocksize guess. */
+  while ((size_t)SSDEEP_BS(bi) * SPAMSUM_LENGTH < self->total_size) {
+    ++bi;
+    if (bi >= NUM_BLOCKHASHES) {
+      /* The input exceeds data types. */
+      errno = EOVERFLOW;
+      return -1;
+    }
+  }
+  /* Adapt blocksize guess to actual digest length. */
+  while (bi >= self->bhend)
+    --bi;
+  while (bi > self->bhstart && self->bh[bi].dlen < SPAMSUM_LENGTH / 2)
+    --bi;
+  assert (!(bi > 0 && self->bh[bi].dlen < SPAMSUM_LENGTH / 2));
+
+  i = snprintf(result, (size_t)remain, "%u:", SSDEEP_BS(bi));
+  if (i <= 0)
+    /* Maybe snprintf has set errno here? */
+    return -1;
+  assert(i < remain);
+  remain -= i;
+  result += i;
+  i = (int)self->bh[bi].dlen;
+  assert(i <= remain);
+  if ((flags & FUZZY_FLAG_ELIMSEQ) != 0)
+    i = memcpy_eliminate_sequences(result, self->bh[bi].digest, i);
+  else
+    memcpy(result, self->bh[bi].digest, (size_t)i);
+  result += i;
+  remain -= i;
+  if (h != 0)
+  {
+    assert(remain > 0);
+    *result = b64[self->bh[bi].h % 64];
+    if((flags & FUZZY_FLAG_ELIMSEQ) == 0 || i < 3 ||
+       *result != result[-1] ||
+       *result != result[-2] ||
+       *result != result[-3]) {
+      ++result;
+      --remain;
+    }
+  }
+  assert(remain > 0);
+  *result++ = ':';
+  --remain;
+  if (bi < self->bhend - 1)
+  {
+    ++bi;
+    i = (int)self->bh[bi].dlen;
+    if ((flags & FUZZY_FLAG_NOTRUNC) == 0 &&
+	i > SPAMSUM_LENGTH / 2 - 1)
+      i = SPAMSUM_LENGTH / 2 - 1;
+    assert(i <= remain);
+    if ((flags & FUZZY_FLAG_ELIMSEQ) != 0)
+      i = memcpy_eliminate_sequences(result,
+				     self->bh[bi].digest, i);
+    else
+      memcpy(result, self->bh[bi].digest, (size_t)i);
+    result += i;
+    remain -= i;
+    if (h != 0) {
+      assert(remain > 0);
+      h = (flags & FUZZY_FLAG_NOTRUNC) != 0 ? self->bh[bi].h :
+	self->bh[bi].halfh;
+      *result = b64[h % 64];
+      if ((flags & FUZZY_FLAG_ELIMSEQ) == 0 || i < 3 ||
+	  *result != result[-1] ||
+	  *result != result[-2] ||
+	  *result != result[-3])
+      {
+	++result;
+	--remain;
+      }
+    }
+  } else if (h != 0)
+    {
+      assert(self->bh[bi].dlen == 0);
+      assert(remain > 0);
+      *result++ = b64[self->bh[bi].h % 64];
+      /* No need to bother with FUZZY_FLAG_ELIMSEQ, because this
+       * digest has length 1. */
+      --remain;
+    }
+  *result = '\0';
+  return 0;
+}
+
+static void ref_free(/*@only@*/ struct ref_state *self)
+{
+  free(self);
+}
+// Test driver.
+
+static const unsigned int flag_sets[] = {
+	0,
+	FUZZY_FLAG_ELIMSEQ,
+	FUZZY_FLAG_NOTRUNC,
+	FUZZY_FLAG_ELIMSEQ | FUZZY_FLAG_NOTRUNC,
+};
+
+#define NUM_FLAG_SETS (sizeof(flag_sets) / sizeof(flag_sets[0]))
+
+static double total_ref, total_new;
+static uint64_t total_bytes;
+static uint64_t rng_state = 0x9e3779b97f4a7c15ULL;
+
+static uint64_t rng(void) {
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 7;
+	rng_state ^= rng_state << 17;
+	return rng_state;
+}
+
+// Feeds `data` to the engine in pieces of random size, including runs of
+// single bytes, so the state carried between fuzzy_update calls is exercised.
+static int update_in_pieces(struct fuzzy_state *state, const unsigned char *data, size_t size) {
+	while (size > 0) {
+		size_t piece = rng() % 4 == 0 ? 1 : 1 + rng() % 8192;
+		if (piece > size)
+			piece = size;
+		if (fuzzy_update(state, data, piece) != 0)
+			return -1;
+		data += piece;
+		size -= piece;
+	}
+	return 0;
+}
+
+static int compare(const char *label, const unsigned char *data, size_t size) {
+	char expected[FUZZY_MAX_RESULT], actual[FUZZY_MAX_RESULT];
+	int failures = 0;
+
+	struct ref_state *ref = ref_new();
+	struct fuzzy_state *whole = fuzzy_new();
+	struct fuzzy_state *pieces = fuzzy_new();
+	if (ref == NULL || whole == NULL || pieces == NULL) {
+		fprintf(stderr, "%s: allocation failure\n", label);
+		failures++;
+		goto out;
+	}
+
+	double start = now();
+	ref_update(ref, data, size);
+	const double elapsed_ref = now() - start;
+
+	start = now();
+	fuzzy_update(whole, data, size);
+	const double elapsed_new = now() - start;
+
+	failures += update_in_pieces(pieces, data, size) != 0;
+
+	for (size_t i=0; i < NUM_FLAG_SETS; i++) {
+		if (ref_digest(ref, expected, flag_sets[i]) != 0) {
+			// Too large for ssdeep; the engine has to refuse it too.
+			failures += fuzzy_digest(whole, actual, flag_sets[i]) == 0;
+			continue;
+		}
+		if (fuzzy_digest(whole, actual, flag_sets[i]) != 0 || strcmp(expected, actual) != 0) {
+			fprintf(stderr, "%s: flags %u: expected %s, got %s\n", label, flag_sets[i], expected, actual);
+			failures++;
+		}
+		if (fuzzy_digest(pieces, actual, flag_sets[i]) != 0 || strcmp(expected, actual) != 0) {
+			fprintf(stderr, "%s: flags %u, in pieces: expected %s, got %s\n", label, flag_sets[i], expected, actual);
+			failures++;
+		}
+	}
+
+	total_ref += elapsed_ref;
+	total_new += elapsed_new;
+	total_bytes += size;
+
+	printf("%s: %s ref=%.0fMB/s new=%.0fMB/s\n", label, failures ? "FAILED" : "ok",
+		elapsed_ref > 0 ? size / elapsed_ref / 1e6 : 0,
+		elapsed_new > 0 ? size / elapsed_new / 1e6 : 0);
+
+out:
+	if (ref != NULL)
+		ref_free(ref);
+	if (whole != NULL)
+		fuzzy_free(whole);
+	if (pieces != NULL)
+		fuzzy_free(pieces);
+	return failures;
+}
+
+static int compare_sample(const char *path) {
+	pe_ctx_t ctx;
+	if (pe_load_file(&ctx, path) != LIBPE_E_OK) {
+		pe_unload(&ctx);
+		return 0; // Not something we can load, nothing to compare.
+	}
+
+	const int failures = compare(path, ctx.map_addr, pe_filesize(&ctx));
+
+	pe_unload(&ctx);
+	return failures;
+}
+
+// Inputs that take the engine through its corner cases: too short to emit
+// anything, long runs of the same byte whose rolling hash never or always
+// triggers, and short periods that keep hitting the same reset points.
+static int compare_synthetic(void) {
+	static const size_t sizes[] = { 0, 1, 6, 7, 8, 191, 192, 193, 4096, 65537, 1 << 20, 3 << 20 };
+	const size_t max_size = sizes[sizeof(sizes) / sizeof(sizes[0]) - 1];
+	unsigned char *data = malloc(max_size);
+	char label[64];
+	int failures = 0;
+
+	if (data == NULL)
+		return 1;
+
+	for (size_t i=0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		const size_t size = sizes[i];
+
+		for (size_t j=0; j < size; j++)
+			data[j] = (unsigned char)rng();
+		snprintf(label, sizeof(label), "random-%zu", size);
+		failures += compare(label, data, size);
+
+		memset(data, 0, size);
+		snprintf(label, sizeof(label), "zero-%zu", size);
+		failures += compare(label, data, size);
+
+		memset(data, 0xff, size);
+		snprintf(label, sizeof(label), "ff-%zu", size);
+		failures += compare(label, data, size);
+
+		for (size_t period=2; period <= 64; period *= 4) {
+			for (size_t j=0; j < size; j++)
+				data[j] = (unsigned char)(j % period * 37);
+			snprintf(label, sizeof(label), "period%zu-%zu", period, size);
+			failures += compare(label, data, size);
+		}
+	}
+
+	free(data);
+	return failures;
+}
+
+int main(int argc, char *argv[]) {
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s <sample>...\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	int failures = compare_synthetic();
+	for (int i=1; i < argc; i++)
+		failures += compare_sample(argv[i]);
+
+	printf("total: ref=%.0fMB/s new=%.0fMB/s\n",
+		total_ref > 0 ? total_bytes / total_ref / 1e6 : 0,
+		total_new > 0 ? total_bytes / total_new / 1e6 : 0);
+
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,135 @@
+/*
+    libpe - the PE library
+
+    Copyright (C) 2010 - 2023 libpe authors
+
+    This file is part of libpe.
+
+    libpe is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libpe is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with libpe.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Parses buffers that stop short of the headers with pe_load_buffer: a bare
+// "MZ", then every prefix of each sample up to MAX_PREFIX bytes. Each buffer
+// ends right before a page that can't be accessed, so reading past it faults
+// instead of going unnoticed. Then each sample is handed over whole, in a
+// pe_malloc()ed buffer with LIBPE_OPT_BUFFER_OWNED, and pe_unload must give
+// all of it back through the allocator, as it must when an owned buffer is
+// refused for being empty.
+
+#include <libpe/pe.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define MAX_PREFIX 4096
+
+static uint8_t *guarded;   // MAX_PREFIX bytes, rounded up to pages, then the guard page
+static size_t guarded_size;
+
+static bool guard_setup(void) {
+	const size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+	guarded_size = (MAX_PREFIX + page_size - 1) / page_size * page_size;
+
+	guarded = mmap(NULL, guarded_size + page_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (guarded == MAP_FAILED)
+		return false;
+	return mprotect(guarded + guarded_size, page_size, PROT_NONE) == 0;
+}
+
+// Parses `size` bytes of `data` copied right before the guard page. Returns
+// whether it was taken for a PE file.
+static bool parse_guarded(const void *data, size_t size) {
+	uint8_t *buffer = guarded + guarded_size - size;
+	memcpy(buffer, data, size);
+
+	pe_ctx_t ctx;
+	pe_err_e err = pe_load_buffer(&ctx, buffer, size, 0);
+	if (err == LIBPE_E_OK)
+		err = pe_parse(&ctx);
+	pe_unload(&ctx);
+	return err == LIBPE_E_OK;
+}
+
+// Returns whether libpe released an owned copy of `data` through pe_free.
+// A `load_size` of 0 hands over an empty buffer, which must be refused.
+static bool check_owned(const void *data, size_t size, size_t load_size) {
+	pe_alloc_stats_t before, after;
+	pe_get_alloc_stats(&before);
+
+	void *buffer = pe_malloc(size);
+	if (buffer == NULL)
+		return false;
+	memcpy(buffer, data, size);
+
+	pe_ctx_t ctx;
+	const pe_err_e err = pe_load_buffer(&ctx, buffer, load_size, LIBPE_OPT_BUFFER_OWNED);
+	if (err == LIBPE_E_OK)
+		pe_parse(&ctx);
+	else if (load_size != 0 || err != LIBPE_E_INVALID_BUFFER)
+		return false;
+	pe_unload(&ctx);
+
+	pe_get_alloc_stats(&after);
+	return after.bytes_in_use == before.bytes_in_use && after.free_calls > before.free_calls;
+}
+
+static int check_sample(const char *path) {
+	pe_ctx_t ctx;
+	if (pe_load_file(&ctx, path) != LIBPE_E_OK) {
+		pe_unload(&ctx);
+		return 0; // Not something we can load, nothing to cut short.
+	}
+
+	const size_t size = pe_filesize(&ctx) < MAX_PREFIX ? pe_filesize(&ctx) : MAX_PREFIX;
+	int failures = 0;
+	for (size_t len=1; len <= size; len++) {
+		// Nothing shorter than the DOS header is a PE file.
+		if (parse_guarded(ctx.map_addr, len) && len < sizeof(IMAGE_DOS_HEADER))
+			failures++;
+	}
+	failures += !check_owned(ctx.map_addr, pe_filesize(&ctx), pe_filesize(&ctx));
+
+	pe_unload(&ctx);
+	return failures;
+}
+
+int main(int argc, char *argv[]) {
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s <sample>...\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	if (!guard_setup()) {
+		perror("mmap");
+		return EXIT_FAILURE;
+	}
+
+	int failures = parse_guarded("MZ", 2);
+	printf("MZ: %s\n", failures ? "FAILED" : "ok");
+	const bool empty_freed = check_owned("MZ", 2, 0);
+	printf("empty owned buffer: %s\n", empty_freed ? "ok" : "FAILED");
+	failures += !empty_freed;
+
+	for (int i=1; i < argc; i++) {
+		const int sample_failures = check_sample(argv[i]);
+		printf("%s: %s\n", argv[i], sample_failures ? "FAILED" : "ok");
+		failures += sample_failures;
+	}
+
+	pe_library_shutdown();
+
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,258 @@
+/*
+    libpe - the PE library
+
+    Copyright (C) 2010 - 2023 libpe authors
+
+    This file is part of libpe.
+
+    libpe is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libpe is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with libpe.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Indexes the ssdeep of overlapping ranges of each sample, slightly altered
+// copies of them and many random signatures, then searches the index for
+// each sample signature and some of the others. The matches must be those
+// of comparing with every signature, before and after a save and load, and
+// with signatures added after the first search. Reports the time of a
+// search against the time of comparing with every signature.
+
+#include <libpe/pe.h>
+#include "../../lib/libpe/libfuzzy/fuzzy.h"
+#include "test_common.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NUM_RANDOM       100000
+#define NUM_ALTERED      4     // Altered copies of each sample signature
+#define MAX_QUERIES      200
+
+typedef struct {
+	size_t count;
+	size_t capacity;
+	char (*signatures)[FUZZY_MAX_RESULT];
+} signatures_t;
+
+static const char b64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static uint64_t random_state = 0x9e3779b97f4a7c15;
+
+static uint32_t random_next(void) {
+	random_state ^= random_state << 13;
+	random_state ^= random_state >> 7;
+	random_state ^= random_state << 17;
+	return (uint32_t)(random_state >> 32);
+}
+
+static bool add_signature(signatures_t *list, const char *signature) {
+	if (list->count == list->capacity) {
+		list->capacity = list->capacity ? 2 * list->capacity : 256;
+		void *signatures = realloc(list->signatures, list->capacity * sizeof(*list->signatures));
+		if (signatures == NULL)
+			return false;
+		list->signatures = signatures;
+	}
+
+	snprintf(list->signatures[list->count++], FUZZY_MAX_RESULT, "%s", signature);
+	return true;
+}
+
+static bool add_range_signature(void *list, const char *signature) {
+	return add_signature(list, signature);
+}
+
+// A copy of the signature with a few of its digest characters changed.
+static bool add_altered(signatures_t *list, const char *signature) {
+	char altered[FUZZY_MAX_RESULT];
+	snprintf(altered, sizeof(altered), "%s", signature);
+
+	const char *digests = strchr(altered, ':');
+	const size_t len = strlen(altered);
+	if (digests == NULL || (size_t)(digests - altered) + 1 >= len)
+		return add_signature(list, altered);
+
+	const size_t first = digests - altered + 1;
+	const unsigned int changes = 1 + random_next() % 3;
+	for (unsigned int i=0; i < changes; i++) {
+		const size_t at = first + random_next() % (len - first);
+		if (altered[at] != ':')
+			altered[at] = b64[random_next() % 64];
+	}
+
+	return add_signature(list, altered);
+}
+
+static bool add_random(signatures_t *list) {
+	char signature[FUZZY_MAX_RESULT];
+	int len = snprintf(signature, sizeof(signature), "%u:", 3u << (random_next() % 20));
+
+	const unsigned int len1 = 1 + random_next() % 64;
+	const unsigned int len2 = 1 + random_next() % 32;
+	for (unsigned int i=0; i < len1; i++)
+		signature[len++] = b64[random_next() % 64];
+	signature[len++] = ':';
+	for (unsigned int i=0; i < len2; i++)
+		signature[len++] = b64[random_next() % 64];
+	signature[len] = '\0';
+
+	return add_signature(list, signature);
+}
+
+static int compare_matches(const void *a, const void *b) {
+	const struct fuzzy_index_match *match_a = a;
+	const struct fuzzy_index_match *match_b = b;
+	if (match_a->score != match_b->score)
+		return match_a->score > match_b->score ? -1 : 1;
+	return match_a->id < match_b->id ? -1 : match_a->id > match_b->id;
+}
+
+// The matches of comparing with every signature, in the order of
+// fuzzy_index_search.
+static size_t search_linear(const struct fuzzy_prepared *prepared, size_t count, const char *signature,
+	struct fuzzy_index_match *matches)
+{
+	struct fuzzy_prepared query;
+	if (fuzzy_prepare(signature, &query) != 0)
+		return 0;
+
+	size_t num_matches = 0;
+	for (size_t i=0; i < count; i++) {
+		const int score = fuzzy_compare_prepared(&query, &prepared[i]);
+		if (score > 0) {
+			matches[num_matches].id = (uint32_t)i;
+			matches[num_matches].score = score;
+			num_matches++;
+		}
+	}
+
+	qsort(matches, num_matches, sizeof(struct fuzzy_index_match), compare_matches);
+	return num_matches;
+}
+
+static int check_search(struct fuzzy_index *index, const char *signature,
+	const struct fuzzy_index_match *expected, size_t num_expected, double *elapsed)
+{
+	struct fuzzy_index_match *matches;
+	size_t num_matches;
+
+	const double start = now();
+	const int rv = fuzzy_index_search(index, signature, 1, &matches, &num_matches);
+	*elapsed += now() - start;
+
+	const int failed = rv != 0 || num_matches != num_expected
+		|| (num_matches > 0 && memcmp(matches, expected, num_matches * sizeof(*matches)) != 0);
+	free(matches);
+	return failed;
+}
+
+int main(int argc, char *argv[]) {
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s <sample>...\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	signatures_t list = { 0 };
+	int failures = 0;
+	for (int i=1; i < argc; i++)
+		failures += hash_sample_ranges(argv[i], add_range_signature, &list);
+
+	const size_t num_samples = list.count;
+	for (size_t i=0; i < num_samples; i++) {
+		for (int j=0; j < NUM_ALTERED; j++)
+			failures += !add_altered(&list, list.signatures[i]);
+	}
+	for (int i=0; i < NUM_RANDOM; i++)
+		failures += !add_random(&list);
+
+	const size_t count = list.count;
+	struct fuzzy_prepared *prepared = malloc(count * sizeof(struct fuzzy_prepared));
+	struct fuzzy_index_match *expected = malloc(count * sizeof(struct fuzzy_index_match));
+	struct fuzzy_index *index = fuzzy_index_new();
+	if (prepared == NULL || expected == NULL || index == NULL)
+		return EXIT_FAILURE;
+
+	// Half of them, searched once so the rest is merged into a built index.
+	const double start = now();
+	for (size_t i=0; i < count; i++) {
+		failures += fuzzy_prepare(list.signatures[i], &prepared[i]) != 0;
+		failures += fuzzy_index_add(index, list.signatures[i]) != 0;
+		if (i == count / 2) {
+			double unused = 0;
+			const size_t num_expected = search_linear(prepared, i + 1, list.signatures[0], expected);
+			failures += check_search(index, list.signatures[0], expected, num_expected, &unused);
+		}
+	}
+	failures += fuzzy_index_build(index) != 0;
+	const double build = now() - start;
+
+	failures += fuzzy_index_count(index) != count;
+	failures += fuzzy_index_add(index, "3:abc") == 0;
+
+	FILE *file = tmpfile();
+	failures += file == NULL || fuzzy_index_save(index, file) != 0;
+	struct fuzzy_index *loaded = NULL;
+	if (file != NULL) {
+		rewind(file);
+		loaded = fuzzy_index_load(file);
+		failures += loaded == NULL || fuzzy_index_count(loaded) != count;
+
+		// Truncated, it is not an index any more.
+		fseek(file, 0, SEEK_END);
+		const long size = ftell(file);
+		rewind(file);
+		char *head = malloc(size / 2);
+		FILE *truncated = tmpfile();
+		if (head != NULL && truncated != NULL && fread(head, 1, size / 2, file) == (size_t)size / 2) {
+			fwrite(head, 1, size / 2, truncated);
+			rewind(truncated);
+			struct fuzzy_index *bad = fuzzy_index_load(truncated);
+			failures += bad != NULL;
+			fuzzy_index_free(bad);
+		} else {
+			failures++;
+		}
+		free(head);
+		if (truncated != NULL)
+			fclose(truncated);
+		fclose(file);
+	}
+
+	// Every sample signature, and others spread over the rest.
+	size_t num_queries = 0, total_matches = 0;
+	double linear = 0, indexed = 0, unused = 0;
+	const size_t step = count / MAX_QUERIES + 1;
+	for (size_t i=0; i < count; i += i < num_samples ? 1 : step) {
+		double t = now();
+		const size_t num_expected = search_linear(prepared, count, list.signatures[i], expected);
+		linear += now() - t;
+
+		failures += check_search(index, list.signatures[i], expected, num_expected, &indexed);
+		if (loaded != NULL)
+			failures += check_search(loaded, list.signatures[i], expected, num_expected, &unused);
+		num_queries++;
+		total_matches += num_expected;
+	}
+
+	printf("signatures=%zu queries=%zu matches=%zu: %s build=%.3fs linear=%.3fms index=%.3fms per search\n",
+		count, num_queries, total_matches, failures ? "FAILED" : "ok", build,
+		linear * 1e3 / num_queries, indexed * 1e3 / num_queries);
+
+	fuzzy_index_free(loaded);
+	fuzzy_index_free(index);
+	free(expected);
+	free(prepared);
+	free(list.signatures);
+	pe_library_shutdown();
+
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
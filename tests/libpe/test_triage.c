@@ -0,0 +1,171 @@
+/*
+    libpe - the PE library
+
+    Copyright (C) 2010 - 2023 libpe authors
+
+    This file is part of libpe.
+
+    libpe is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libpe is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with libpe.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Copies each sample with a sparse overlay of OVERLAY_SIZE bytes, then reads
+// what `readpe --triage` shows from a LIBPE_OPT_HEADERS_ONLY load: the
+// headers, the directories and the section table. The file must never be
+// mapped, and the process must read less than MAX_READ bytes. When READPE
+// names the readpe binary, it is run with --triage on the copy too, and must
+// fault in and spend no more than a header-only read would.
+
+#include <libpe/pe.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define OVERLAY_SIZE     (16ULL << 30) // 16 GiB, all of it a hole
+#define MAX_READ         (1 << 20)
+#define MAX_FAULTS       20000         // Reading the overlay takes millions
+#define MAX_CPU_SECONDS  1.0
+
+// Bytes this process read so far, or 0 if the kernel doesn't tell.
+static uint64_t bytes_read(void) {
+	FILE *io = fopen("/proc/self/io", "r");
+	if (io == NULL)
+		return 0;
+
+	char line[128];
+	uint64_t rchar = 0;
+	while (fgets(line, sizeof(line), io) != NULL) {
+		if (sscanf(line, "rchar: %" SCNu64, &rchar) == 1)
+			break;
+	}
+	fclose(io);
+	return rchar;
+}
+
+// A copy of the sample at `path` followed by the overlay.
+static bool make_sparse_copy(const char *path, char *copy_path) {
+	pe_ctx_t ctx;
+	if (pe_load_file(&ctx, path) != LIBPE_E_OK) {
+		pe_unload(&ctx);
+		return false;
+	}
+
+	const int fd = mkstemp(copy_path);
+	const size_t size = pe_filesize(&ctx);
+	bool copied = fd != -1 && write(fd, ctx.map_addr, size) == (ssize_t)size
+		&& ftruncate(fd, size + OVERLAY_SIZE) == 0;
+	pe_unload(&ctx);
+	if (fd != -1)
+		close(fd);
+	if (!copied && fd != -1)
+		unlink(copy_path);
+	return copied;
+}
+
+// Everything readpe -H -d -S shows, the computed checksum aside.
+static int read_triage(pe_ctx_t *ctx) {
+	int failures = 0;
+	failures += pe_dos(ctx) == NULL || pe_coff(ctx) == NULL || pe_optional(ctx) == NULL;
+
+	IMAGE_DATA_DIRECTORY ** const directories = pe_directories(ctx);
+	for (uint32_t i=0; directories != NULL && i < pe_directories_count(ctx); i++)
+		failures += !pe_can_read(ctx, directories[i], sizeof(IMAGE_DATA_DIRECTORY));
+
+	IMAGE_SECTION_HEADER ** const sections = pe_sections(ctx);
+	for (uint16_t i=0; sections != NULL && i < pe_sections_count(ctx); i++)
+		failures += !pe_can_read(ctx, sections[i], sizeof(IMAGE_SECTION_HEADER));
+
+	return failures;
+}
+
+static int check_libpe(const char *path) {
+	const uint64_t start = bytes_read();
+
+	pe_ctx_t ctx;
+	pe_err_e err = pe_load_file_ext(&ctx, path, LIBPE_OPT_HEADERS_ONLY);
+	if (err == LIBPE_E_OK)
+		err = pe_parse(&ctx);
+	if (err != LIBPE_E_OK) {
+		pe_unload(&ctx);
+		return 0; // Not a PE file, nothing to triage.
+	}
+
+	int failures = read_triage(&ctx);
+	failures += ctx.map_kind != LIBPE_MAP_HEADERS;
+	failures += bytes_read() - start > MAX_READ;
+
+	pe_unload(&ctx);
+	return failures;
+}
+
+static int check_readpe(const char *readpe, const char *path) {
+	const pid_t pid = fork();
+	if (pid == -1)
+		return 1;
+	if (pid == 0) {
+		const int null_fd = open("/dev/null", O_WRONLY);
+		if (null_fd != -1) {
+			dup2(null_fd, STDOUT_FILENO);
+			dup2(null_fd, STDERR_FILENO);
+		}
+		execl(readpe, readpe, "--triage", path, (char *)NULL);
+		_exit(127);
+	}
+
+	int status;
+	struct rusage usage;
+	if (wait4(pid, &status, 0, &usage) != pid)
+		return 1;
+
+	const double cpu = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6
+		+ usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+	return !WIFEXITED(status) || WEXITSTATUS(status) != 0
+		|| usage.ru_minflt + usage.ru_majflt > MAX_FAULTS
+		|| cpu > MAX_CPU_SECONDS;
+}
+
+int main(int argc, char *argv[]) {
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s <sample>...\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	const char *readpe = getenv("READPE");
+	if (readpe != NULL && access(readpe, X_OK) != 0)
+		readpe = NULL;
+
+	int failures = 0;
+	for (int i=1; i < argc; i++) {
+		char copy_path[] = "/tmp/test_triage.XXXXXX";
+		if (!make_sparse_copy(argv[i], copy_path))
+			continue; // Not something we can load, or no room for the copy.
+
+		int sample_failures = check_libpe(copy_path);
+		if (readpe != NULL)
+			sample_failures += check_readpe(readpe, copy_path);
+		unlink(copy_path);
+
+		printf("%s: %s%s\n", argv[i], sample_failures ? "FAILED" : "ok", readpe != NULL ? "" : " (readpe not run)");
+		failures += sample_failures;
+	}
+
+	pe_library_shutdown();
+
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}